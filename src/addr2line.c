@@ -1,12 +1,22 @@
+#define _GNU_SOURCE // pipe2()
+
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "addr2line.h"
 #include "config.h"
+#include "pipe_io.h"
+#include "probes.h"
 
 
 // Available addr2line backends
@@ -34,18 +44,51 @@ enum {
 	#error "No addr2line backend available"
 #endif
 
+// Pseudo-backends that are resolved per mapping instead of naming an addr2line command
+#define USE_ADAPTIVE (NUM_AVAILABLE_BACKENDS)     // Pick the backend for each mapping (see adaptive_select)
+#define USE_SYMTAB   (NUM_AVAILABLE_BACKENDS + 1) // Resolve in-process through the function symbols (objects without debugging information)
+
+#define ADAPTIVE_PROBE_QUERIES  4                 // Timed translations per backend before settling on the fastest one for a mapping
+#define ADAPTIVE_PROBE_MIN_SIZE (4 * 1024 * 1024) // Objects smaller than this are not probed, as backends perform alike on them
+
+#define BATCH_WINDOW 1024 // Addresses written at once to an addr2line process in batch mode (their text must fit in the pipe, see addr2line_translate_batch)
+#define ASYNC_BATCH  4096 // Maximum requests taken at once from the queue by the asynchronous I/O thread
+
+#define SCHEDULE_CHUNK 64 // Addresses sent at once to an addr2line process by addr2line_translate_scheduled (bounds the overrun of the deadline)
+
+#define MULTI_INITIAL_CAPACITY 4096 // Initial number of slots of the translation cache of addr2line_multi_t (kept below 3/4 full)
+
+#define STACK_CACHE_INITIAL_CAPACITY 1024 // Initial number of frames and stack nodes of the stack cache (doubled on demand)
+
+#define RANGE_CACHE_INITIAL_CAPACITY 256 // Initial number of function ranges of the range cache (doubled on demand)
+
+// Process-wide registry of running addr2line commands, shared by all handles (see acquire_child)
+static addr2line_child_t *child_registry = NULL;
+static pthread_mutex_t child_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static addr2line_t *addr2line_init(char *object, maps_t *maps, int options);
+static void adaptive_init(addr2line_t *backend);
+static void adaptive_reset(addr2line_t *backend, int index, maps_entry_t *exec_entry);
+static void close_translator(addr2line_process_t *translator);
+static void copy_code_loc(code_loc_t *dst, code_loc_t *src);
+static void stack_cache_free(addr2line_stack_cache_t *cache);
+static void range_cache_free(addr2line_range_cache_t *cache);
+static int deadline_passed(struct timespec *deadline);
 
 /**
  * select_backend
  * 
- * Check the environment variable LIBADDR2LINE_BACKEND to determine whether to use elfutils (default) or binutils .
+ * Check the environment variable LIBADDR2LINE_BACKEND to determine whether to use elfutils (default), llvm-tools, binutils,
+ * or to select one of them per mapping (adaptive).
  */
 static int select_backend() 
 {
     char *env_libaddr2line_backend = getenv("LIBADDR2LINE_BACKEND");
 
 	if (env_libaddr2line_backend != NULL) {
+		if (!strcmp(env_libaddr2line_backend, "adaptive")) {
+			return USE_ADAPTIVE;
+		}
 		#if defined(HAVE_ELFUTILS)
 			if (!strcmp(env_libaddr2line_backend, "elfutils")) {
 				return USE_ELFUTILS;
@@ -92,34 +135,6 @@ static int is_binary_file(const char *filename) {
     return 0; // Text file
 }
 
-/**
- * write_with_retry
- * 
- * Safe write wrapper that retries the write operation until all data is written. 
- */
-static ssize_t write_with_retry(int fd, const void *buf, size_t count) {
-    ssize_t written = 0, result = 0;
-
-    while (count > 0) {
-        result = write(fd, buf, count);
-        
-        if (result < 0) {
-            if (errno != EINTR) {
-				// Retry the full write if EINTR, other errors are fatal				
-                perror("write failed");
-                exit(EXIT_FAILURE);
-            }
-        }
-		else {
-        	// Successfully wrote some data, continue writing the rest if the write was partial
-        	written += result;
-        	buf = (const char *)buf + result;
-        	count -= result;
-		}
-    }
-    return written;
-}
-
 /** 
  * addr2line_exec
  * 
@@ -143,6 +158,26 @@ addr2line_t *addr2line_init_maps(maps_t *parsed_maps, int options)
 	return addr2line_init(maps_path(parsed_maps), parsed_maps, options);
 }
 
+/**
+ * addr2line_init_self
+ *
+ * Initializes the addr2line backend for the running process, with the mappings taken from the
+ * dynamic loader (see maps_from_self) rather than from parsing /proc/self/maps. Objects loaded
+ * or unloaded later are picked up through maps_refresh() on the backend's maps.
+ *
+ * @param options Configuration options for the addr2line process.
+ * @return Pointer to the addr2line backend handler.
+ */
+addr2line_t *addr2line_init_self(int options)
+{
+	maps_t *self_maps = maps_from_self(0);
+	if (self_maps == NULL) {
+		fprintf(stderr, "ERROR: addr2line_init_self: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return addr2line_init_maps(self_maps, options);
+}
+
 static addr2line_t *addr2line_init(char *object, maps_t *parsed_maps, int options)
 {
 	addr2line_t *backend = NULL;
@@ -168,6 +203,21 @@ static addr2line_t *addr2line_init(char *object, maps_t *parsed_maps, int option
 
 	// Check the backend to use
 	backend->useBackend = select_backend();
+	if (options & OPTION_ADAPTIVE_BACKEND) backend->useBackend = USE_ADAPTIVE;
+#if defined(HAVE_LIBSYMTAB)
+	// Functions-only mode is adaptive mode with every mapping routed to its symbol table
+	if (options & OPTION_FUNCTIONS_ONLY) backend->useBackend = USE_ADAPTIVE;
+#else
+	if (options & OPTION_FUNCTIONS_ONLY) fprintf(stderr, "WARNING: addr2line_init: OPTION_FUNCTIONS_ONLY requires libsymtab, translating through the addr2line processes instead\n");
+	if (options & OPTION_LEARN_FUNCTIONS) fprintf(stderr, "WARNING: addr2line_init: OPTION_LEARN_FUNCTIONS requires libsymtab, no function ranges will be learned\n");
+#endif
+	backend->adaptiveList = NULL;
+	backend->numAdaptive = 0;
+	backend->lastAdaptive = 0;
+	pthread_mutex_init(&backend->lock, NULL);
+	backend->async = NULL;
+	backend->stackCache = NULL;
+	backend->rangeCache = NULL;
 
 	int is_binary, is_mapping;
 	// Check if the input is a binary file, a maps file, or a parsed maps object
@@ -177,6 +227,7 @@ static addr2line_t *addr2line_init(char *object, maps_t *parsed_maps, int option
 		is_mapping = 1;
 		backend->inputObject = strdup(maps_path(parsed_maps));
 		backend->procMaps = parsed_maps;
+		backend->mapsGeneration = parsed_maps->generation;
 	}
 	else {
 		// Check if the object is a binary file or a maps file and store it
@@ -186,6 +237,7 @@ static addr2line_t *addr2line_init(char *object, maps_t *parsed_maps, int option
 
 		// Parse the /proc/self/maps file if given
 		backend->procMaps = NULL;
+		backend->mapsGeneration = 0;
 		if (is_mapping)	{
 			backend->procMaps = maps_parse_file(object, 0);
 		}
@@ -201,7 +253,16 @@ static addr2line_t *addr2line_init(char *object, maps_t *parsed_maps, int option
 #endif
 
 	// Determine the number of addr2line processes to spawn
-	if ((is_mapping) && (multiple_addr2line_processes)) 
+	if (backend->useBackend == USE_ADAPTIVE)
+	{
+		/*
+		 * In adaptive mode every backend is given the individual objects (-e mapping),
+		 * so we reserve one addr2line process per executable mapping and backend. 
+		 * Only those that are actually chosen get forked.
+		 */
+		adaptive_init(backend);
+	}
+	else if ((is_mapping) && (multiple_addr2line_processes)) 
 	{
 		/*
 		 * binutils and llvm-tools can not take a /proc/self/maps file as input, 
@@ -243,358 +304,2692 @@ static addr2line_t *addr2line_init(char *object, maps_t *parsed_maps, int option
 	// Defer the fork until the first translation
 	for (int i = 0; i < backend->numProcesses; ++i) 
 	{
-		backend->processList[i].isForked = 0;
+		backend->processList[i].child = NULL;
+		if (backend->useBackend != USE_ADAPTIVE) backend->processList[i].useBackend = backend->useBackend;
 	}
 
 	return backend;
 }
 
 /**
- * adjust_address
+ * adaptive_init
  * 
- * Iterate over the addr2line processes to find the one whose mapping contains the address.
- * Then adjust the address to the mapping offset, and return the adjusted address, as well
- * as the addr2line process to use for the translation. The manual offsetting is only necessary
- * for shared libraries under binutils (see comments below for details).
+ * Initializes the per-mapping backend selection. There is one selection state for each
+ * executable mapping (or a single one for the input binary), and one addr2line process
+ * reserved for each of them and each available backend. 
  * 
  * @param backend Pointer to the addr2line backend handler.
- * @param address Address to adjust (if required).
- * @param translator Pointer to the addr2line process handler.
  */
-static void *adjust_address(addr2line_t *backend, void *address, addr2line_process_t **translator)
+static void adaptive_init(addr2line_t *backend)
 {
-	void *adjusted_address = address;
-	int backend_needs_adjustment = 0;
+	int num_objects = (backend->procMaps != NULL ? exec_mappings_size(backend->procMaps) : 1);
+	if (num_objects < 1) num_objects = 1;
 
-#if defined(HAVE_LLVM_TOOLS)
-	backend_needs_adjustment = backend_needs_adjustment || (backend->useBackend == USE_LLVM_TOOLS);
-#endif
-#if defined(HAVE_BINUTILS)
-	backend_needs_adjustment = backend_needs_adjustment || (backend->useBackend == USE_BINUTILS);
-#endif
+	backend->numAdaptive = num_objects;
+	backend->adaptiveList = malloc(sizeof(addr2line_adaptive_t) * num_objects);
+	backend->numProcesses = num_objects * NUM_AVAILABLE_BACKENDS;
+	backend->processList = malloc(sizeof(addr2line_process_t) * backend->numProcesses);
+	if ((backend->adaptiveList == NULL) || (backend->processList == NULL)) {
+		fprintf(stderr, "ERROR: adaptive_init: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
 
-	// Both llvm-tools and binutils require manual adjustment of the address to the mapping offset.
-	if (backend_needs_adjustment && (backend->procMaps))
+	maps_entry_t *exec_entry = (backend->procMaps != NULL ? exec_mappings(backend->procMaps) : NULL);
+	for (int i = 0; i < num_objects; ++i)
 	{
-		// If multiple addr2line processes are used, find the one whose mapping contains the address
-		for (int i = 0; i < backend->numProcesses; ++i)
-		{
-			addr2line_process_t *current_process = &backend->processList[i];
+		adaptive_reset(backend, i, exec_entry);
+		if (exec_entry != NULL) exec_entry = next_exec_mapping(exec_entry);
+	}
+}
 
-			// The check for mapping_is_position_independent relies entirely on libmagic and is quite heuristic
-			if ((address_in_mapping(current_process->execMapping, (unsigned long)address)) && (!mapping_is_at_fixed_base_address(current_process->execMapping)))
-			{
-				/* TL;DR: Adjust the address to the mapping offset.
-				*        This applies both to shared libraries and -fPIE/-pie executables, regardless of ASLR.
-				*        Offsets do not apply to -no-pie executables that are mapped to a fixed base address (usually 0x400000).
-				*
-				* The following example illustrates the /proc/self/maps for a -no-pie executable linked with a shared library.
-				* We have observed that for a given binary or shared library, there are multiple mappings in the maps file, 
-				* with only one being executable [--x-], which is not the first entry in the list, e.g.:
-				*
-				* 00400000-00403000 r--p 00000000 00:2f 391035422   my_main
-				* 00403000-0047a000 r-xp 00003000 00:2f 391035422   my_main
-				* 0047a000-0049e000 r--p 0007a000 00:2f 391035422   my_main
-				* ...
-				* 7f9c93cf7000-7f9c93d01000 r--p 00000000 00:35 391035434   libshared.so
-				* 7f9c93d01000-7f9c93d78000 r-xp 0000a000 00:35 391035434   libshared.so
-				* 7f9c93d78000-7f9c93d9c000 r--p 00081000 00:35 391035434   libshared.so
-				* 
-				* The addresses that we are capturing belong to the executable mappings [--x-], for instance, 
-				* 0x403e46, which belongs to the executable mapping of my_main; and 0x7f9c93d01e32, which
-				* belongs to the executable mapping of libshared.so. For the latter, we adjust the address
-				* by substracting the base address of the mapping (7f9c93d01000) and adding the offset (0000a000).
-				* The resulting adjusted address (0xae32) can be successfully translated:
-				* 
-				* > binutils-addr2line -e libshared.so 0xae32
-				* bye_world
-				* /home/user/libshared.c:13
-				* 
-				* However, if the same offset operation is applied to an address from the main binary, 
-				* the translation fails. In the example, the adjusted address would be computed as:
-				* 0x403e46 (original) - 00403000 (start) + 00003000 (offset) = 0x3e46
-				* 
-				* Then, the translation fails:
-				* > binutils-addr2line -e my_main 0x3e46
-				* ??
-				* ??:0
-				* 
-				* For the addresses from -no-pie executables that belong to the main binary, we need to leave them 
-				* unchanged for the translation to work:
-				* 
-				* > binutils-addr2line -e my_main 0x403e46 
-				* hello_world
-				* /home/user/my_main.c:42
-				* 
-				*/
+/**
+ * adaptive_reset
+ * 
+ * Initialize the selection state of a mapping and its reserved addr2line processes (not forked).
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param index Index of the selection state.
+ * @param exec_entry Executable mapping (NULL when the input is a binary).
+ */
+static void adaptive_reset(addr2line_t *backend, int index, maps_entry_t *exec_entry)
+{
+	addr2line_adaptive_t *state = &backend->adaptiveList[index];
+	state->execMapping = exec_entry;
+	state->isClassified = 0;
+	state->selectedBackend = -1;
+	state->symtab = NULL;
+	for (int b = 0; b < NUM_AVAILABLE_BACKENDS; ++b)
+	{
+		state->numQueries[b] = 0;
+		state->elapsedTime[b] = 0;
 
-				/*
-				* Regardless of -fPIE / -no-pie, note that the first entry in the maps file for the main binary is mapped at offset zero:
-				*                               
-				* 00400000-00403000 r--p 00000000 00:2f 391035422   my_main <= The first mapping for the main binary is offset zero
-				* 00403000-0047a000 r-xp 00003000 00:2f 391035422   my_main <= Address 0x403e46 belongs to this mapping
-				*  
-				* It's not clear if some extra offsetting would be necessary if the first entry offset was above zero. 
-				* We leave this long explanation as a note for future reference, in case some translations fail.
-				*/
-				*translator = current_process;
-				adjusted_address = absolute_to_relative(current_process->execMapping, address);
-				return adjusted_address;
-			}
-		}
+		backend->processList[index * NUM_AVAILABLE_BACKENDS + b].execMapping = exec_entry;
+		backend->processList[index * NUM_AVAILABLE_BACKENDS + b].useBackend = b;
+		backend->processList[index * NUM_AVAILABLE_BACKENDS + b].child = NULL;
 	}
-	// Default to the first addr2line process and leave the address unchanged
-	*translator = &backend->processList[0]; 
-	return address;
 }
 
 /**
- * invoke_translator
+ * sync_maps
  * 
- * Invokes the addr2line backend to translate the given address. This function
- * determines the addr2line process to use based on the mapping offset, and forks
- * a child process to run addr2line. The forked process runs as a continuous 
- * background process, unless OPTION_NON_PERSISTENT is set, in which case the
- * process is spawned and ended for each translation. 
- * 
- * Depending on the backend used, multiple addr2line processes are spawned (one 
- * for each mapping when using binutils with a maps file), or just a single instance 
- * for other scenarios.
+ * Follow the changes made by maps_refresh() to the parsed maps. The processes (and in adaptive mode,
+ * the selection states) of the executable mappings that are still present are kept as they are, the
+ * ones of the retired mappings are closed, and new mappings get unforked processes. A single elfutils 
+ * process reading the maps file itself (-M) is restarted so that it picks up the new contents. The
+ * retired entries are freed afterwards, so that handles refreshed after every dlopen/dlclose do not grow,
+ * unless the maps are shared with other owners (see maps_retain), which free them with the maps.
  * 
  * @param backend Pointer to the addr2line backend handler.
- * @param address Address to translate.
- * @param[out] adjusted_address_str Address string passed to the addr2line command after adjusting it to the mapping offset if needed.
  */
-static addr2line_process_t *invoke_translator(addr2line_t *backend, void *address, void **adjusted_address_ptr, char **adjusted_address_str)
+static void sync_maps(addr2line_t *backend)
 {
-	addr2line_process_t *translator = NULL;
-	int is_binary = (backend->procMaps == NULL);
-	void *adjusted_address = adjust_address(backend, address, &translator);
+	maps_t *maps = backend->procMaps;
+	int is_adaptive = (backend->useBackend == USE_ADAPTIVE);
 
-	// Format the address string to be passed to the addr2line command
-	char adjusted_address_endl[BUFSIZ];
-	char adjusted_address_chomp[BUFSIZ];
-	sprintf(adjusted_address_endl, "%p\n", adjusted_address); // Append '\n' when parent writes to child through pipe to unblock it
-	sprintf(adjusted_address_chomp, "%p", adjusted_address); // Do not append '\n' when addr2line command receives the address directly
+	backend->mapsGeneration = maps->generation;
+
+	// Cached stacks and function ranges may refer to objects that are gone, or whose addresses were reused
+	stack_cache_free(backend->stackCache);
+	backend->stackCache = NULL;
+	range_cache_free(backend->rangeCache);
+	backend->rangeCache = NULL;
 
-	// Fork the addr2line process if not already forked, or if non-persistent option is set
-	if ((!translator->isForked) || (backend->setOptions & OPTION_NON_PERSISTENT))
+	if ((!is_adaptive) && (backend->processList[0].execMapping == NULL))
 	{
-		// Create pipes for communication between parent and child processes
-		if (pipe(translator->parentWrite) == -1 || pipe(translator->childWrite) == -1)
-		{
-			perror("Failed to create pipes");
-			exit(EXIT_FAILURE);
-		}
+		close_translator(&backend->processList[0]);
+		if (maps->refcount == 1) maps_release_retired(maps);
+		return;
+	}
 
-		if (fork() == 0)
-		{
-			// In the child process
+	int per_object = (is_adaptive ? NUM_AVAILABLE_BACKENDS : 1);
+	int old_num_objects = backend->numProcesses / per_object;
+	addr2line_process_t *old_processes = backend->processList;
+	addr2line_adaptive_t *old_states = backend->adaptiveList;
 
-			// Close unused ends of the pipes
-			close(translator->parentWrite[WRITE_END]);
-			close(translator->childWrite[READ_END]);
+	int num_objects = exec_mappings_size(maps);
+	if (num_objects < 1) num_objects = 1;
 
-			if ((dup2(translator->parentWrite[READ_END], STDIN_FILENO) == -1) || // Get stdin to read from from parent_write[READ_END] pipe
-				(dup2(translator->childWrite[WRITE_END], STDOUT_FILENO) == -1))  // Redirect stdout to write to child_write[WRITE_END] pipe
-			{
-				perror("Failed to duplicate file descriptor");
-				exit(EXIT_FAILURE);
-			}
-			
-			// Close the duplicated file descriptors
-			close(translator->parentWrite[READ_END]);
-			close(translator->childWrite[WRITE_END]);
-
-			/*
-			* Set up arguments for execution
-			* elfutils uses a single addr2line process to handle either the specified binary (-e binary) or /proc/self/maps (-M maps_file).
-			* binutils uses a single addr2line process for a specified binary (-e binary), or multiple processes for each executable mapping (-e mapping1, -e mapping2, etc.).
-			* If the non-persistent option is set, the address is passed directly to the addr2line command and the process will end after the translation.
-			* Otherwise, the process will stall in a read loop until the address is passed later through the pipe.
-			*/
-			char **argv = NULL;
-#if defined(HAVE_ELFUTILS)
-			char *argv_elfutils[] = { ELFUTILS_ADDR2LINE, "-C", "-f", "-i", (is_binary ? "-e" : "-M"), backend->inputObject, (backend->setOptions & OPTION_NON_PERSISTENT ? adjusted_address_chomp : NULL), NULL };
-			if (backend->useBackend == USE_ELFUTILS) {
-				argv = argv_elfutils;			
-			}
-#endif
-#if defined(HAVE_LLVM_TOOLS)
-			char *argv_llvm_tools[] = { LLVM_TOOLS_ADDR2LINE, "-C", "-f", "-e", (is_binary ? backend->inputObject : translator->execMapping->pathname), (backend->setOptions & OPTION_NON_PERSISTENT ? adjusted_address_chomp : NULL), NULL };
-			if (backend->useBackend == USE_LLVM_TOOLS) {
-				argv = argv_llvm_tools;
-			}
-#endif
-#if defined(HAVE_BINUTILS)
-			char *argv_binutils[] = { BINUTILS_ADDR2LINE, "-C", "-f", "-e", (is_binary ? backend->inputObject : translator->execMapping->pathname), (backend->setOptions & OPTION_NON_PERSISTENT ? adjusted_address_chomp : NULL), NULL };
-			if (backend->useBackend == USE_BINUTILS) {
-				argv = argv_binutils;
-			}
-#endif
-			// Replaces the current process with addr2line backend
-			execvp(argv[0], argv);
+	int *reused = calloc(old_num_objects, sizeof(int));
+	backend->numProcesses = num_objects * per_object;
+	backend->processList = malloc(sizeof(addr2line_process_t) * backend->numProcesses);
+	if (is_adaptive) {
+		backend->numAdaptive = num_objects;
+		backend->adaptiveList = malloc(sizeof(addr2line_adaptive_t) * num_objects);
+	}
+	if ((reused == NULL) || (backend->processList == NULL) || ((is_adaptive) && (backend->adaptiveList == NULL))) {
+		fprintf(stderr, "ERROR: sync_maps: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	maps_entry_t *exec_entry = exec_mappings(maps);
+	for (int i = 0; i < num_objects; ++i)
+	{
+		// Look for the processes that were already serving this mapping
+		int found = -1;
+		for (int j = 0; (j < old_num_objects) && (found < 0); ++j) {
+			if ((!reused[j]) && (old_processes[j * per_object].execMapping == exec_entry)) found = j;
+		}
+
+		if (found >= 0)
+		{
+			reused[found] = 1;
+			memcpy(&backend->processList[i * per_object], &old_processes[found * per_object], sizeof(addr2line_process_t) * per_object);
+			if (is_adaptive) backend->adaptiveList[i] = old_states[found];
+		}
+		else if (is_adaptive)
+		{
+			adaptive_reset(backend, i, exec_entry);
 		}
 		else 
 		{
-			// In the parent process
-
-			// Keep forking with every new translation if non-persistent option is set
-			if (!(backend->setOptions & OPTION_NON_PERSISTENT)) translator->isForked = 1; 
-
-			close(translator->parentWrite[READ_END]); // Close unused 'read end' of the parent_write pipe
-			close(translator->childWrite[WRITE_END]); // Close unused 'write end' of the child_write pipe
-
-			// Open a FILE stream to read addr2line's backend output
-			translator->outputStream = fdopen(translator->childWrite[READ_END], "r");
-			if (translator->outputStream == NULL) {
-				perror("fdopen failed");
-				exit(EXIT_FAILURE);
-			}
+			backend->processList[i].execMapping = exec_entry;
+			backend->processList[i].useBackend = backend->useBackend;
+			backend->processList[i].child = NULL;
 		}
+		if (exec_entry != NULL) exec_entry = next_exec_mapping(exec_entry);
 	}
 
-	// If the addr2line process is persistent, pass now the address to translate to the background process
-	if (!(backend->setOptions & OPTION_NON_PERSISTENT))
+	// Release the processes of the retired mappings
+	for (int j = 0; j < old_num_objects; ++j)
 	{
-		write_with_retry(translator->parentWrite[WRITE_END], adjusted_address_endl, strlen(adjusted_address_endl));
+		if (reused[j]) continue;
+		for (int b = 0; b < per_object; ++b) {
+			close_translator(&old_processes[j * per_object + b]);
+		}
+#if defined(HAVE_LIBSYMTAB)
+		if (is_adaptive) symtab_free(old_states[j].symtab);
+#endif
 	}
+	free(reused);
+	free(old_processes);
+	if (is_adaptive) free(old_states);
 
-	// Return the adjusted address string that was passed to addr2line
-	*adjusted_address_ptr = adjusted_address;
-	*adjusted_address_str = strdup(adjusted_address_chomp);
-	return translator;
+	// Nothing refers to the retired mappings any longer, unless other owners of the maps still have to follow the refresh
+	if (maps->refcount == 1) maps_release_retired(maps);
 }
 
+#if defined(HAVE_LIBSYMTAB)
 /**
- * free_translator
+ * read_functions
  * 
- * Close the pipes associated with the given addr2line process, only if flagged as non-persistent!
+ * Get the function symbols of an object, with their names demangled like the backends' -C. The symbol table
+ * of the mapping is shared if the maps were parsed with OPTION_READ_FUNCTIONS and OPTION_DEMANGLE (e.g. once
+ * for several handles translating against the same maps), and read otherwise.
  * 
- * @param backend Pointer to the addr2line backend handler.
- * @param translator Pointer to the addr2line process handler.
+ * @param entry Executable mapping of the object (NULL when the input is a binary).
+ * @param object Path to the object.
+ * @return The symbol table, with a reference taken for the caller.
  */
-static void free_translator(addr2line_t *backend, addr2line_process_t *translator)
+static symtab_t *read_functions(maps_entry_t *entry, char *object)
 {
-	if (backend->setOptions & OPTION_NON_PERSISTENT)
-	{
-		// Clean up remaining descriptors 
-		fclose(translator->outputStream);
-		close(translator->parentWrite[WRITE_END]);
-		close(translator->childWrite[READ_END]);
-	} 
+	symtab_t *shared = (entry != NULL ? entry->symtab : NULL);
+	if ((shared != NULL) && (shared->kind == SYMTAB_FUNCTIONS) && (shared->options & SYMTAB_DEMANGLE_LAZY)) return symtab_retain(shared);
+	return symtab_read_filtered(object, SYMTAB_FUNCTIONS | SYMTAB_DEMANGLE_LAZY);
 }
+#endif
 
 /**
- * addr2line_translate
+ * adaptive_classify
  * 
- * Translate a memory address into the corresponding function, file, line, column (elfutils only) and mapping (if maps file was given).
+ * Inspects the object behind a mapping the first time it is queried. Objects without
+ * debugging information are routed to the symbol table, since every backend would only
+ * return "??" for them after paying its full cost. Small objects skip the probing phase
+ * and go to the default backend (or llvm-tools when a .debug_names index is present).
+ * Everything else is left to be probed. In functions-only mode, every object is routed to
+ * its symbol table without inspecting its debugging information.
  * 
- * @param backend  The handler of the running addr2line process
- * @param address  The memory address to translate.
- * @param code_loc The structure to store the translation results.
+ * @param backend Pointer to the addr2line backend handler.
+ * @param state Selection state of the mapping.
  */
-
-void addr2line_translate(addr2line_t *backend, void *address, code_loc_t *code_loc)
+static void adaptive_classify(addr2line_t *backend, addr2line_adaptive_t *state)
 {
-	char buf[BUFSIZ];
-	void *adjusted_address_ptr = NULL;
-	char *adjusted_address_str = NULL;
-	int translated = 0; 
+	char *object = (state->execMapping != NULL ? state->execMapping->pathname : backend->inputObject);
+#if defined(HAVE_LIBSYMTAB) || defined(HAVE_LLVM_TOOLS)
+	int debug_info = 0;
+#endif
+	struct stat object_stat;
 
-	// Select the addr2line process to use and invoke it
-	addr2line_process_t *translator = invoke_translator(backend, address, &adjusted_address_ptr, &adjusted_address_str);
-	code_loc->adjusted_address = adjusted_address_ptr;
+	state->isClassified = 1;
 
-	// Read the function name from addr2line's output
-	code_loc->function = NULL;
-	if (fgets(buf, sizeof(buf), translator->outputStream) != NULL)
+#if defined(HAVE_LIBSYMTAB)
+	if (!(backend->setOptions & OPTION_FUNCTIONS_ONLY)) debug_info = symtab_debug_info(object);
+	if ((backend->setOptions & OPTION_FUNCTIONS_ONLY) || (!(debug_info & SYMTAB_HAS_DEBUG_INFO)))
 	{
-		if (buf[strlen(buf)-1] == '\n') {
-			buf[strlen(buf)-1] = '\0'; // Remove the newline character
-		} 
-		// Copying the function name only if has been translated
-		if (strcmp(buf, UNKNOWN_ADDRESS) != 0) {
-			code_loc->function = strdup(buf);
-			translated = 1;
-		}
+		state->symtab = read_functions(state->execMapping, object);
+		state->selectedBackend = USE_SYMTAB;
+		return;
 	}
+#endif
 
-	// Read the filename, line number, and column number from addr2line's output
-	code_loc->file = NULL;
-	code_loc->line = code_loc->column = 0;
-	if (fgets(buf, sizeof(buf), translator->outputStream) != NULL)
+	if ((stat(object, &object_stat) == 0) && (object_stat.st_size < ADAPTIVE_PROBE_MIN_SIZE))
 	{
-#if defined(HAVE_ELFUTILS)
-		// Parsing the column number (currently only available with elfutils)
-		if (backend->useBackend == USE_ELFUTILS)
-		{	
-			char *last_colon = strrchr(buf, ':'); 
-			if (last_colon != NULL)
-			{
-				code_loc->column = atoi(last_colon + 1);
-				*last_colon = '\0'; 
-				if (code_loc->column > 0) translated = 1;
-			}
-		}
+		state->selectedBackend = DEFAULT_BACKEND;
+#if defined(HAVE_LLVM_TOOLS)
+		if (debug_info & SYMTAB_HAS_DEBUG_NAMES) state->selectedBackend = USE_LLVM_TOOLS;
 #endif
-		// Parsing the line number
-		char *first_colon = strrchr(buf, ':');
-		if (first_colon != NULL)
-		{
-			code_loc->line = atoi(first_colon + 1);
-			*first_colon = '\0'; 
-			if (code_loc->line > 0) translated = 1;
-		}
-		// Copying the filename only if has been translated
-		if (strcmp(buf, UNKNOWN_ADDRESS) != 0) {
-			code_loc->file = strdup(buf);
-			translated = 1;
-		}
 	}
-	code_loc->translated = translated;
+}
 
-	// Make sure we return something for function and file when the translation fails
-	if (code_loc->function == NULL) code_loc->function = strdup((backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? adjusted_address_str : UNKNOWN_ADDRESS);
-	if (code_loc->file == NULL) code_loc->file = strdup((backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? adjusted_address_str : UNKNOWN_ADDRESS);
+/**
+ * adaptive_find
+ * 
+ * Find the selection state of the mapping that contains the given address. The mapping of the previous
+ * address is checked first, then the states are searched by bisection, since they follow the executable
+ * mappings, which are sorted by address.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address Address to look up.
+ * @return Index of the selection state, or -1 if the address does not belong to any executable mapping.
+ */
+static int adaptive_find(addr2line_t *backend, void *address)
+{
+	int found = -1;
+	int last = backend->lastAdaptive;
+	maps_entry_t *mapping = (last < backend->numAdaptive ? backend->adaptiveList[last].execMapping : NULL);
+	if ((last < backend->numAdaptive) && ((mapping == NULL) || (address_in_mapping(mapping, (unsigned long)address)))) found = last;
 
-	// Get the mapping name
-	if (translator->execMapping != NULL) {
-		// If the addr2line process is associated with a specific mapping (binutils), use that mapping name
-		code_loc->mapping_name = strdup(mapping_path(translator->execMapping));
-	}
-	else if (backend->procMaps != NULL) {
-		// If the input was a maps file (elfutils), find the mapping that contains the address
-		maps_entry_t *entry = search_in_exec_mappings(backend->procMaps, (unsigned long)address);
-		code_loc->mapping_name = strdup(mapping_path(entry));
-	}
-	else {
-		// If no maps file was given (binutils/elfutils), use the input binary as the mapping name only when the translation was successful
-		if (translated) code_loc->mapping_name = strdup(backend->inputObject);
-		else code_loc->mapping_name = strdup(UNKNOWN_MAPPING);
+	int low = 0, high = backend->numAdaptive - 1;
+	while ((found < 0) && (low <= high))
+	{
+		int middle = low + (high - low) / 2;
+		mapping = backend->adaptiveList[middle].execMapping;
+		if ((mapping == NULL) || (address_in_mapping(mapping, (unsigned long)address))) found = middle;
+		else if ((unsigned long)address < mapping->start) high = middle - 1;
+		else low = middle + 1;
 	}
+	if (found < 0) return -1;
 
-	// Free resources
-	free(adjusted_address_str);
-	free_translator(backend, translator);
+	if (!backend->adaptiveList[found].isClassified) adaptive_classify(backend, &backend->adaptiveList[found]);
+	backend->lastAdaptive = found;
+	return found;
 }
 
 /**
- * addr2line_close
+ * adaptive_select
  * 
- * Close the addr2line backend and free all resources.
+ * Choose the backend to translate the next address of the given mapping. While probing, the 
+ * backends are queried round-robin. The first query of each backend is not timed because it 
+ * pays for the fork and the DWARF loading. Once all backends have been timed ADAPTIVE_PROBE_QUERIES 
+ * times, the one with the lowest latency is kept and the other processes of the mapping are closed.
  * 
  * @param backend Pointer to the addr2line backend handler.
+ * @param index Index of the selection state of the mapping.
+ * @return The backend to use.
  */
-void addr2line_close(addr2line_t *backend)
+static int adaptive_select(addr2line_t *backend, int index)
 {
-	if (backend->procMaps != NULL) maps_free(backend->procMaps);
-	free(backend->inputObject);
-	for (int i = 0; i < backend->numProcesses; ++i)	{
-		// Clear the non-persistent flag to force closing all descriptors
-		backend->setOptions &= ~OPTION_NON_PERSISTENT;
-		free_translator(backend, &backend->processList[i]);
+	addr2line_adaptive_t *state = &backend->adaptiveList[index];
+
+	if (state->selectedBackend >= 0) return state->selectedBackend;
+
+	int next = 0;
+	for (int b = 1; b < NUM_AVAILABLE_BACKENDS; ++b) {
+		if (state->numQueries[b] < state->numQueries[next]) next = b;
+	}
+	if (state->numQueries[next] <= ADAPTIVE_PROBE_QUERIES) return next;
+
+	// All backends have the same number of timed queries, so comparing the totals is enough
+	int best = 0;
+	for (int b = 1; b < NUM_AVAILABLE_BACKENDS; ++b) {
+		if (state->elapsedTime[b] < state->elapsedTime[best]) best = b;
+	}
+	state->selectedBackend = best;
+
+	for (int b = 0; b < NUM_AVAILABLE_BACKENDS; ++b) {
+		if (b != best) close_translator(&backend->processList[index * NUM_AVAILABLE_BACKENDS + b]);
+	}
+	return best;
+}
+
+/**
+ * adaptive_record
+ * 
+ * Account the latency of a translation to the backend that served it, while the mapping is still being probed.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param translator The addr2line process that served the translation.
+ * @param address The translated address.
+ * @param start Time when the translation was issued.
+ */
+static void adaptive_record(addr2line_t *backend, addr2line_process_t *translator, void *address, struct timespec *start)
+{
+	struct timespec end;
+	int index = (translator - backend->processList) / NUM_AVAILABLE_BACKENDS;
+	addr2line_adaptive_t *state = &backend->adaptiveList[index];
+
+	// Skip mappings already settled, and addresses that fell back to the first process without belonging to its mapping
+	if (state->selectedBackend >= 0) return;
+	if ((state->execMapping != NULL) && (!address_in_mapping(state->execMapping, (unsigned long)address))) return;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (state->numQueries[translator->useBackend] > 0) {
+		state->elapsedTime[translator->useBackend] += (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+	}
+	state->numQueries[translator->useBackend] ++;
+}
+
+/**
+ * translate_with_symtab
+ * 
+ * In adaptive mode, resolve the function name in-process for objects without debugging information.
+ * In functions-only mode, every address is resolved this way, including those outside of any executable mapping.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address The memory address to translate.
+ * @param code_loc The structure to store the translation results.
+ * @return 1 if the address was handled through the symbol table, 0 if it has to go to an addr2line process.
+ */
+static int translate_with_symtab(addr2line_t *backend, void *address, code_loc_t *code_loc)
+{
+	int index = adaptive_find(backend, address);
+	int functions_only = (backend->setOptions & OPTION_FUNCTIONS_ONLY);
+	if ((!functions_only) && ((index < 0) || (backend->adaptiveList[index].selectedBackend != USE_SYMTAB))) return 0;
+
+	// Symbols hold virtual addresses of the object, which differ from file offsets when the segments are not aligned alike
+	addr2line_adaptive_t *state = (index >= 0 ? &backend->adaptiveList[index] : NULL);
+	void *adjusted_address = address;
+	if ((state != NULL) && (state->execMapping != NULL) && (backend->procMaps != NULL)) {
+		adjusted_address = (void *)((unsigned long)address - maps_load_bias(backend->procMaps, state->execMapping));
+	}
+
+	// The address is only formatted if it is kept in place of an unresolved name
+	char adjusted_address_str[32];
+	char *unresolved = UNKNOWN_ADDRESS;
+	if (backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) {
+		format_address(adjusted_address_str, adjusted_address);
+		unresolved = adjusted_address_str;
+	}
+
+	code_loc->adjusted_address = adjusted_address;
+	code_loc->function = NULL;
+	code_loc->translated = 0;
+#if defined(HAVE_LIBSYMTAB)
+	if (state != NULL)
+	{
+		code_loc->function = symtab_translate(state->symtab, (unsigned long)adjusted_address);
+		if (strcmp(code_loc->function, UNKNOWN_SYMBOL) != 0) {
+			code_loc->translated = 1;
+		}
+		else {
+			free(code_loc->function);
+			code_loc->function = NULL;
+		}
+	}
+#endif
+	if (code_loc->function == NULL) code_loc->function = strdup(unresolved);
+	code_loc->file = strdup(unresolved);
+	code_loc->line = code_loc->column = 0;
+
+	if ((state != NULL) && (state->execMapping != NULL)) code_loc->mapping_name = strdup(mapping_path(state->execMapping));
+	else code_loc->mapping_name = strdup(code_loc->translated ? backend->inputObject : UNKNOWN_MAPPING);
+	return 1;
+}
+
+/**
+ * translate_with_jit
+ * 
+ * Resolve the addresses of anonymous executable mappings in-process through the JIT code index of the
+ * maps (see maps_load_jit). There is no object for the addr2line commands to read for these mappings.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address The memory address to translate.
+ * @param code_loc The structure to store the translation results.
+ * @return 1 if the address belongs to JIT-compiled code and was handled, 0 if it has to go to an addr2line process.
+ */
+static int translate_with_jit(addr2line_t *backend, void *address, code_loc_t *code_loc)
+{
+	if ((backend->procMaps == NULL) || (backend->procMaps->jit == NULL)) return 0;
+
+	maps_entry_t *entry = search_in_all_mappings(backend->procMaps, (unsigned long)address);
+	if ((entry == NULL) || (entry->jit == NULL)) return 0;
+
+	char address_str[32];
+	format_address(address_str, address);
+	char *unresolved = ((backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? address_str : UNKNOWN_ADDRESS);
+
+	const char *function = maps_resolve_jit(backend->procMaps, (unsigned long)address, NULL);
+	code_loc->adjusted_address = address;
+	code_loc->function = strdup(function != NULL ? function : unresolved);
+	code_loc->file = strdup(unresolved);
+	code_loc->line = code_loc->column = 0;
+	code_loc->mapping_name = strdup(function != NULL ? entry->jit->path : UNKNOWN_MAPPING);
+	code_loc->translated = (function != NULL);
+	return 1;
+}
+
+/**
+ * is_functions_only
+ * 
+ * Check if every mapping of the handler is served by its symbol table (OPTION_FUNCTIONS_ONLY with libsymtab).
+ */
+static int is_functions_only(addr2line_t *backend)
+{
+	return ((backend->useBackend == USE_ADAPTIVE) && (backend->setOptions & OPTION_FUNCTIONS_ONLY));
+}
+
+/**
+ * translate_functions
+ * 
+ * Translate many addresses in functions-only mode. No addr2line process is involved, so each address goes
+ * straight to the JIT code index or to the symbol table of its mapping, without the per-address checks and
+ * timing of addr2line_translate.
+ * 
+ * @param backend   Pointer to the addr2line backend handler.
+ * @param addresses The memory addresses to translate.
+ * @param order     Order in which to translate the addresses (NULL for input order).
+ * @param count     Number of addresses.
+ * @param deadline  Time after which the translation stops, checked every SCHEDULE_CHUNK addresses (NULL if none).
+ * @param code_locs Array of count structures to store the translation results, in the same order as the addresses.
+ * @param done      Flag per address set once translated (NULL if not needed).
+ * @return Number of addresses translated.
+ */
+static int translate_functions(addr2line_t *backend, void **addresses, int *order, int count, struct timespec *deadline, code_loc_t *code_locs, char *done)
+{
+	int i = 0;
+	for (; i < count; ++i)
+	{
+		if ((deadline != NULL) && (i % SCHEDULE_CHUNK == 0) && (deadline_passed(deadline))) break;
+
+		int item = (order != NULL ? order[i] : i);
+		if (!translate_with_jit(backend, addresses[item], &code_locs[item])) translate_with_symtab(backend, addresses[item], &code_locs[item]);
+		if (done != NULL) done[item] = 1;
+	}
+	return i;
+}
+
+/**
+ * range_cache_free
+ *
+ * Free the function ranges learned by a handler, and the symbol tables they were learned from.
+ */
+static void range_cache_free(addr2line_range_cache_t *cache)
+{
+	if (cache == NULL) return;
+	for (int i = 0; i < cache->numRanges; ++i)
+	{
+		free(cache->ranges[i].function);
+		free(cache->ranges[i].mappingName);
+	}
+#if defined(HAVE_LIBSYMTAB)
+	for (int i = 0; i < cache->numObjects; ++i) {
+		symtab_free(cache->objects[i].symtab);
+	}
+#endif
+	free(cache->ranges);
+	free(cache->objects);
+	free(cache);
+}
+
+/**
+ * range_find
+ *
+ * Binary search of the learned function range containing an address.
+ *
+ * @param cache The range cache.
+ * @param address The address to look up.
+ * @param[out] insert_at Index of the first range starting after the address (where a range containing it would go).
+ * @return Index of the range containing the address, or -1 if none does.
+ */
+static int range_find(addr2line_range_cache_t *cache, unsigned long address, int *insert_at)
+{
+	int low = 0, high = cache->numRanges - 1;
+	while (low <= high)
+	{
+		int mid = low + (high - low) / 2;
+		if (cache->ranges[mid].start <= address) low = mid + 1;
+		else high = mid - 1;
+	}
+	*insert_at = low;
+	return (((high >= 0) && (address < cache->ranges[high].end)) ? high : -1);
+}
+
+/**
+ * translate_with_ranges
+ *
+ * Answer the address from the function ranges learned by earlier translations (see range_learn), without any
+ * addr2line round trip. Only the function and the mapping are known, so this is restricted to the handlers
+ * created with OPTION_LEARN_FUNCTIONS.
+ *
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address The memory address to translate.
+ * @param code_loc The structure to store the translation results.
+ * @return 1 if the address falls in a learned function, 0 if it has to be translated.
+ */
+static int translate_with_ranges(addr2line_t *backend, void *address, code_loc_t *code_loc)
+{
+	addr2line_range_cache_t *cache = backend->rangeCache;
+	if ((!(backend->setOptions & OPTION_LEARN_FUNCTIONS)) || (cache == NULL)) return 0;
+
+	int insert_at = 0;
+	int index = range_find(cache, (unsigned long)address, &insert_at);
+	if (index < 0) {
+		PROBE(libaddr2line, cache__miss, "range", address);
+		return 0;
+	}
+	PROBE(libaddr2line, cache__hit, "range", address);
+
+	addr2line_range_t *range = &cache->ranges[index];
+	void *adjusted_address = (void *)((unsigned long)address - range->bias);
+	char adjusted_address_str[32];
+	format_address(adjusted_address_str, adjusted_address);
+
+	code_loc->adjusted_address = adjusted_address;
+	code_loc->function = strdup(range->function);
+	code_loc->file = strdup((backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? adjusted_address_str : UNKNOWN_ADDRESS);
+	code_loc->line = code_loc->column = 0;
+	code_loc->mapping_name = strdup(range->mappingName);
+	code_loc->translated = 1;
+	cache->numHits ++;
+	return 1;
+}
+
+/**
+ * range_learn
+ *
+ * Learn the extent of the function of a translated address, from the size of the ELF function symbol that
+ * contains it in the symbol table of its object (read on the first translation of the object). The range is
+ * only learned when the backend reported the function of the symbol itself, not a function inlined in it,
+ * so later addresses of the range are answered with the enclosing function (see translate_with_ranges).
+ *
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address The memory address translated.
+ * @param code_loc The translation of the address.
+ */
+static void range_learn(addr2line_t *backend, void *address, code_loc_t *code_loc)
+{
+#if defined(HAVE_LIBSYMTAB)
+	if ((!(backend->setOptions & OPTION_LEARN_FUNCTIONS)) || (!code_loc->translated) || (!strcmp(code_loc->function, UNKNOWN_ADDRESS))) return;
+
+	if (backend->rangeCache == NULL) 
+	{
+		backend->rangeCache = calloc(1, sizeof(addr2line_range_cache_t));
+		if (backend->rangeCache == NULL) {
+			fprintf(stderr, "ERROR: range_learn: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	addr2line_range_cache_t *cache = backend->rangeCache;
+
+	// Find the object of the address, whose symbols are relative to its load bias
+	maps_entry_t *entry = NULL;
+	char *object = backend->inputObject;
+	unsigned long bias = 0;
+	if (backend->procMaps != NULL)
+	{
+		entry = search_in_exec_mappings(backend->procMaps, (unsigned long)address);
+		if ((entry == NULL) || (entry->pathname[0] == '\0') || (entry->pathname[0] == '[')) return;
+		object = entry->pathname;
+		bias = maps_load_bias(backend->procMaps, entry);
+	}
+
+	int o = 0;
+	while ((o < cache->numObjects) && (cache->objects[o].execMapping != entry)) o ++;
+	if (o == cache->numObjects)
+	{
+		if (cache->numObjects == cache->maxObjects)
+		{
+			cache->maxObjects = (cache->maxObjects == 0 ? 16 : cache->maxObjects * 2);
+			cache->objects = realloc(cache->objects, cache->maxObjects * sizeof(addr2line_range_object_t));
+			if (cache->objects == NULL) {
+				fprintf(stderr, "ERROR: range_learn: Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		cache->objects[o].execMapping = entry;
+		cache->objects[o].symtab = read_functions(entry, object);
+		cache->numObjects ++;
+	}
+	symtab_t *symtab = cache->objects[o].symtab;
+
+	unsigned long start = 0, end = 0;
+	unsigned long relative = (unsigned long)address - bias;
+	if (!symtab_lookup_range(symtab, relative, &start, &end)) return;
+
+	// Addresses of inlined code are reported with the inlined function, which does not span the symbol
+	char *symbol = symtab_translate(symtab, relative);
+	size_t len = strlen(code_loc->function);
+	int is_symbol = ((strncmp(symbol, code_loc->function, len) == 0) && ((symbol[len] == '\0') || (symbol[len] == '.'))); // Also clones, e.g. foo.constprop.0
+	free(symbol);
+	if (!is_symbol) return;
+
+	// Nested or overlapping symbols are left to the backend
+	int insert_at = 0;
+	start += bias;
+	end += bias;
+	if ((range_find(cache, start, &insert_at) >= 0) || ((insert_at < cache->numRanges) && (cache->ranges[insert_at].start < end))) return;
+
+	if (cache->numRanges == cache->maxRanges)
+	{
+		cache->maxRanges = (cache->maxRanges == 0 ? RANGE_CACHE_INITIAL_CAPACITY : cache->maxRanges * 2);
+		cache->ranges = realloc(cache->ranges, cache->maxRanges * sizeof(addr2line_range_t));
+		if (cache->ranges == NULL) {
+			fprintf(stderr, "ERROR: range_learn: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memmove(&cache->ranges[insert_at + 1], &cache->ranges[insert_at], (cache->numRanges - insert_at) * sizeof(addr2line_range_t));
+	addr2line_range_t *range = &cache->ranges[insert_at];
+	range->start = start;
+	range->end = end;
+	range->bias = bias;
+	range->function = strdup(code_loc->function);
+	range->mappingName = strdup(code_loc->mapping_name);
+	cache->numRanges ++;
+#endif
+}
+
+/**
+ * adjust_address
+ * 
+ * Iterate over the addr2line processes to find the one whose mapping contains the address.
+ * Then adjust the address to the mapping offset, and return the adjusted address, as well
+ * as the addr2line process to use for the translation. The manual offsetting is only necessary
+ * for shared libraries under binutils (see comments below for details).
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address Address to adjust (if required).
+ * @param translator Pointer to the addr2line process handler.
+ */
+static void *adjust_address(addr2line_t *backend, void *address, addr2line_process_t **translator)
+{
+	void *adjusted_address = address;
+	int backend_needs_adjustment = 0;
+
+	// In adaptive mode, every process is bound to one object, so only -no-pie executables keep the address unchanged 
+	if (backend->useBackend == USE_ADAPTIVE)
+	{
+		int index = adaptive_find(backend, address);
+		if (index >= 0)
+		{
+			addr2line_adaptive_t *state = &backend->adaptiveList[index];
+			*translator = &backend->processList[index * NUM_AVAILABLE_BACKENDS + adaptive_select(backend, index)];
+			if ((state->execMapping != NULL) && (!mapping_is_at_fixed_base_address(state->execMapping))) {
+				adjusted_address = absolute_to_relative(state->execMapping, address);
+			}
+			return adjusted_address;
+		}
+	}
+
+#if defined(HAVE_LLVM_TOOLS)
+	backend_needs_adjustment = backend_needs_adjustment || (backend->useBackend == USE_LLVM_TOOLS);
+#endif
+#if defined(HAVE_BINUTILS)
+	backend_needs_adjustment = backend_needs_adjustment || (backend->useBackend == USE_BINUTILS);
+#endif
+
+	// Both llvm-tools and binutils require manual adjustment of the address to the mapping offset.
+	if (backend_needs_adjustment && (backend->procMaps))
+	{
+		// If multiple addr2line processes are used, find the one whose mapping contains the address
+		for (int i = 0; i < backend->numProcesses; ++i)
+		{
+			addr2line_process_t *current_process = &backend->processList[i];
+
+			// The check for mapping_is_position_independent relies entirely on libmagic and is quite heuristic
+			if ((address_in_mapping(current_process->execMapping, (unsigned long)address)) && (!mapping_is_at_fixed_base_address(current_process->execMapping)))
+			{
+				/* TL;DR: Adjust the address to the mapping offset.
+				*        This applies both to shared libraries and -fPIE/-pie executables, regardless of ASLR.
+				*        Offsets do not apply to -no-pie executables that are mapped to a fixed base address (usually 0x400000).
+				*
+				* The following example illustrates the /proc/self/maps for a -no-pie executable linked with a shared library.
+				* We have observed that for a given binary or shared library, there are multiple mappings in the maps file, 
+				* with only one being executable [--x-], which is not the first entry in the list, e.g.:
+				*
+				* 00400000-00403000 r--p 00000000 00:2f 391035422   my_main
+				* 00403000-0047a000 r-xp 00003000 00:2f 391035422   my_main
+				* 0047a000-0049e000 r--p 0007a000 00:2f 391035422   my_main
+				* ...
+				* 7f9c93cf7000-7f9c93d01000 r--p 00000000 00:35 391035434   libshared.so
+				* 7f9c93d01000-7f9c93d78000 r-xp 0000a000 00:35 391035434   libshared.so
+				* 7f9c93d78000-7f9c93d9c000 r--p 00081000 00:35 391035434   libshared.so
+				* 
+				* The addresses that we are capturing belong to the executable mappings [--x-], for instance, 
+				* 0x403e46, which belongs to the executable mapping of my_main; and 0x7f9c93d01e32, which
+				* belongs to the executable mapping of libshared.so. For the latter, we adjust the address
+				* by substracting the base address of the mapping (7f9c93d01000) and adding the offset (0000a000).
+				* The resulting adjusted address (0xae32) can be successfully translated:
+				* 
+				* > binutils-addr2line -e libshared.so 0xae32
+				* bye_world
+				* /home/user/libshared.c:13
+				* 
+				* However, if the same offset operation is applied to an address from the main binary, 
+				* the translation fails. In the example, the adjusted address would be computed as:
+				* 0x403e46 (original) - 00403000 (start) + 00003000 (offset) = 0x3e46
+				* 
+				* Then, the translation fails:
+				* > binutils-addr2line -e my_main 0x3e46
+				* ??
+				* ??:0
+				* 
+				* For the addresses from -no-pie executables that belong to the main binary, we need to leave them 
+				* unchanged for the translation to work:
+				* 
+				* > binutils-addr2line -e my_main 0x403e46 
+				* hello_world
+				* /home/user/my_main.c:42
+				* 
+				*/
+
+				/*
+				* Regardless of -fPIE / -no-pie, note that the first entry in the maps file for the main binary is mapped at offset zero:
+				*                               
+				* 00400000-00403000 r--p 00000000 00:2f 391035422   my_main <= The first mapping for the main binary is offset zero
+				* 00403000-0047a000 r-xp 00003000 00:2f 391035422   my_main <= Address 0x403e46 belongs to this mapping
+				*  
+				* It's not clear if some extra offsetting would be necessary if the first entry offset was above zero. 
+				* We leave this long explanation as a note for future reference, in case some translations fail.
+				*/
+				*translator = current_process;
+				adjusted_address = absolute_to_relative(current_process->execMapping, address);
+				return adjusted_address;
+			}
+		}
+	}
+	// Default to the first addr2line process and leave the address unchanged
+	*translator = &backend->processList[0]; 
+	return address;
+}
+
+/**
+ * translator_object
+ * 
+ * Determine the object given to the addr2line command of a process.
+ * elfutils uses a single addr2line process to handle either the specified binary (-e binary) or /proc/self/maps (-M maps_file),
+ * unless it is bound to a mapping in adaptive mode (-e mapping).
+ * binutils and llvm-tools use a single addr2line process for a specified binary (-e binary), or multiple processes for each executable mapping (-e mapping1, -e mapping2, etc.).
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param translator Pointer to the addr2line process handler.
+ * @param[out] uses_maps_file Set to 1 if the object is a maps file (-M), 0 if it is a binary (-e).
+ * @return Path to the object.
+ */
+static char *translator_object(addr2line_t *backend, addr2line_process_t *translator, int *uses_maps_file)
+{
+	int is_binary = (backend->procMaps == NULL);
+
+	*uses_maps_file = 0;
+	if (is_binary) return backend->inputObject;
+#if defined(HAVE_ELFUTILS)
+	if ((translator->useBackend == USE_ELFUTILS) && (translator->execMapping == NULL))
+	{
+		*uses_maps_file = 1;
+		return backend->inputObject;
+	}
+#endif
+	return translator->execMapping->pathname;
+}
+
+/**
+ * spawn_child
+ * 
+ * Fork a child process running the addr2line command of the given backend.
+ * If an address is given, it is passed directly to the addr2line command and the process will end after the translation.
+ * Otherwise, the process will stall in a read loop until the addresses are passed later through the pipe.
+ * 
+ * @param use_backend Backend to run.
+ * @param object Path to the binary or maps file.
+ * @param uses_maps_file Flag to indicate if the object is a maps file (-M, elfutils only).
+ * @param address Address to translate for non-persistent processes, or NULL.
+ * @return The child process handler, with a single reference.
+ */
+static addr2line_child_t *spawn_child(int use_backend, char *object, int uses_maps_file, char *address)
+{
+	addr2line_child_t *child = malloc(sizeof(addr2line_child_t));
+	if (child == NULL) {
+		fprintf(stderr, "ERROR: spawn_child: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * Create pipes for communication between parent and child processes.
+	 * The ends kept by the parent are close-on-exec, otherwise other addr2line children would inherit them
+	 * and keep this one from seeing the end of its input when it is released.
+	 */
+	if (pipe2(child->parentWrite, O_CLOEXEC) == -1 || pipe2(child->childWrite, O_CLOEXEC) == -1)
+	{
+		perror("Failed to create pipes");
+		exit(EXIT_FAILURE);
+	}
+
+	PROBE(libaddr2line, spawn__start, use_backend, object);
+	child->pid = fork();
+	if (child->pid == 0)
+	{
+		// In the child process
+
+		if ((dup2(child->parentWrite[READ_END], STDIN_FILENO) == -1) || // Get stdin to read from from parent_write[READ_END] pipe
+			(dup2(child->childWrite[WRITE_END], STDOUT_FILENO) == -1))  // Redirect stdout to write to child_write[WRITE_END] pipe
+		{
+			perror("Failed to duplicate file descriptor");
+			exit(EXIT_FAILURE);
+		}
+		// The original descriptors are closed on exec
+
+		char **argv = NULL;
+#if defined(HAVE_ELFUTILS)
+		char *argv_elfutils[] = { ELFUTILS_ADDR2LINE, "-C", "-f", "-i", (uses_maps_file ? "-M" : "-e"), object, address, NULL };
+		if (use_backend == USE_ELFUTILS) {
+			argv = argv_elfutils;			
+		}
+#endif
+#if defined(HAVE_LLVM_TOOLS)
+		char *argv_llvm_tools[] = { LLVM_TOOLS_ADDR2LINE, "-C", "-f", "-e", object, address, NULL };
+		if (use_backend == USE_LLVM_TOOLS) {
+			argv = argv_llvm_tools;
+		}
+#endif
+#if defined(HAVE_BINUTILS)
+		char *argv_binutils[] = { BINUTILS_ADDR2LINE, "-C", "-f", "-e", object, address, NULL };
+		if (use_backend == USE_BINUTILS) {
+			argv = argv_binutils;
+		}
+#endif
+		// Replaces the current process with addr2line backend
+		execvp(argv[0], argv);
+		_exit(EXIT_FAILURE);
+	}
+	else if (child->pid < 0)
+	{
+		perror("fork failed");
+		exit(EXIT_FAILURE);
+	}
+
+	// In the parent process
+	close(child->parentWrite[READ_END]); // Close unused 'read end' of the parent_write pipe
+	close(child->childWrite[WRITE_END]); // Close unused 'write end' of the child_write pipe
+
+	// Enlarge the pipes so that batches of requests and responses flow without blocking
+	set_pipe_capacity(child->parentWrite[WRITE_END]);
+	set_pipe_capacity(child->childWrite[READ_END]);
+
+	// Buffered reader for addr2line's backend output
+	child->reader = reader_open(child->childWrite[READ_END]);
+
+	child->useBackend = use_backend;
+	child->usesMapsFile = uses_maps_file;
+	child->object = strdup(object);
+	child->objectDevice = child->objectInode = child->objectSize = 0;
+	child->objectMtime = 0;
+	child->refcount = 1;
+	child->isShared = 0;
+	child->next = NULL;
+	pthread_mutex_init(&child->lock, NULL);
+
+	PROBE(libaddr2line, spawn__end, use_backend, object, child->pid);
+	return child;
+}
+
+/**
+ * destroy_child
+ * 
+ * Close the pipes of the child process, which makes addr2line exit, and reap it.
+ * 
+ * @param child The child process handler.
+ */
+static void destroy_child(addr2line_child_t *child)
+{
+	reader_close(child->reader); // Also closes childWrite[READ_END]
+	close(child->parentWrite[WRITE_END]);
+	waitpid(child->pid, NULL, 0);
+	pthread_mutex_destroy(&child->lock);
+	free(child->object);
+	free(child);
+}
+
+/**
+ * acquire_child
+ * 
+ * Get the addr2line command for the given process. Persistent commands are looked up in the process-wide 
+ * registry by backend and object identity (device, inode, size and modification time, or the path if it can 
+ * not be stat'ed), so that all handles translating the same object share one child and its warm DWARF state.
+ * A new child is only spawned if none is running yet. Non-persistent commands and handles created with
+ * OPTION_PRIVATE_TRANSLATORS always get a child of their own, and so do the commands reading a maps file
+ * under /proc (-M): its contents change with every dlopen/dlclose while its identity stays the same, and
+ * each child only reads it when it starts, so it can only serve the handle that started it.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param translator Pointer to the addr2line process handler.
+ * @param address Address to pass on the command line for non-persistent processes.
+ * @return The child process handler, with a reference taken for the caller.
+ */
+static addr2line_child_t *acquire_child(addr2line_t *backend, addr2line_process_t *translator, char *address)
+{
+	int uses_maps_file = 0;
+	char *object = translator_object(backend, translator, &uses_maps_file);
+
+	if (backend->setOptions & OPTION_NON_PERSISTENT) {
+		return spawn_child(translator->useBackend, object, uses_maps_file, address);
+	}
+	if ((backend->setOptions & OPTION_PRIVATE_TRANSLATORS) || ((uses_maps_file) && (!strncmp(object, "/proc/", 6)))) {
+		return spawn_child(translator->useBackend, object, uses_maps_file, NULL);
+	}
+
+	struct stat object_stat;
+	unsigned long device = 0, inode = 0, size = 0;
+	long long mtime = 0;
+	if (stat(object, &object_stat) == 0) {
+		device = object_stat.st_dev;
+		inode = object_stat.st_ino;
+		size = object_stat.st_size;
+		mtime = (long long)object_stat.st_mtim.tv_sec * 1000000000 + object_stat.st_mtim.tv_nsec;
+	}
+
+	pthread_mutex_lock(&child_registry_lock);
+	addr2line_child_t *child = child_registry;
+	while (child != NULL)
+	{
+		if ((child->useBackend == translator->useBackend) && (child->usesMapsFile == uses_maps_file) && 
+		    (((inode != 0) && (child->objectDevice == device) && (child->objectInode == inode) && 
+		      (child->objectSize == size) && (child->objectMtime == mtime)) ||
+		     ((inode == 0) && (child->objectInode == 0) && (!strcmp(child->object, object))))) 
+		{
+			child->refcount ++;
+			break;
+		}
+		child = child->next;
+	}
+	if (child == NULL)
+	{
+		child = spawn_child(translator->useBackend, object, uses_maps_file, NULL);
+		child->objectDevice = device;
+		child->objectInode = inode;
+		child->objectSize = size;
+		child->objectMtime = mtime;
+		child->isShared = 1;
+		child->next = child_registry;
+		child_registry = child;
+	}
+	pthread_mutex_unlock(&child_registry_lock);
+	return child;
+}
+
+/**
+ * release_child
+ * 
+ * Drop a reference to the child process, ending it when the last handle using it lets it go.
+ * 
+ * @param child The child process handler.
+ */
+static void release_child(addr2line_child_t *child)
+{
+	if (child->isShared)
+	{
+		pthread_mutex_lock(&child_registry_lock);
+		int last = (-- child->refcount == 0);
+		if (last)
+		{
+			addr2line_child_t **link = &child_registry;
+			while (*link != child) link = &(*link)->next;
+			*link = child->next;
+		}
+		pthread_mutex_unlock(&child_registry_lock);
+		if (last) destroy_child(child);
+	}
+	else destroy_child(child);
+}
+
+/**
+ * invoke_translator
+ * 
+ * Invokes the addr2line backend to translate the given address. This function
+ * determines the addr2line process to use based on the mapping offset, and gets
+ * a child process running addr2line for it. The child runs as a continuous 
+ * background process, unless OPTION_NON_PERSISTENT is set, in which case the
+ * process is spawned and ended for each translation. The child is locked for 
+ * the caller until free_translator, as it may be shared with other handles.
+ * 
+ * Depending on the backend used, multiple addr2line processes are spawned (one 
+ * for each mapping when using binutils with a maps file), or just a single instance 
+ * for other scenarios.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param address Address to translate.
+ * @param[out] adjusted_address_ptr Address passed to the addr2line command after adjusting it to the mapping offset if needed.
+ */
+static addr2line_process_t *invoke_translator(addr2line_t *backend, void *address, void **adjusted_address_ptr)
+{
+	addr2line_process_t *translator = NULL;
+	void *adjusted_address = adjust_address(backend, address, &translator);
+
+	// Format the address string to be passed to the addr2line command
+	char adjusted_address_endl[32];
+	int len = format_address(adjusted_address_endl, adjusted_address); // Passed as is when addr2line command receives the address directly
+
+	// Get the addr2line process if not already running, or a new one for each translation if non-persistent option is set
+	if (translator->child == NULL)
+	{
+		translator->child = acquire_child(backend, translator, adjusted_address_endl);
+	}
+	pthread_mutex_lock(&translator->child->lock);
+
+	// If the addr2line process is persistent, pass now the address to translate to the background process
+	if (!(backend->setOptions & OPTION_NON_PERSISTENT))
+	{
+		adjusted_address_endl[len++] = '\n'; // Append '\n' when parent writes to child through pipe to unblock it
+		write_with_retry(translator->child->parentWrite[WRITE_END], adjusted_address_endl, len);
+		PROBE(libaddr2line, request__write, translator->useBackend, translator->child->pid, translator->child->object, address, 1);
+	}
+
+	// Return the adjusted address that was passed to addr2line
+	*adjusted_address_ptr = adjusted_address;
+	return translator;
+}
+
+/**
+ * close_translator
+ * 
+ * Release the child process of the given addr2line process if it has one, which ends it unless other handles share it.
+ * 
+ * @param translator Pointer to the addr2line process handler.
+ */
+static void close_translator(addr2line_process_t *translator)
+{
+	if (translator->child != NULL)
+	{
+		release_child(translator->child);
+		translator->child = NULL;
+	}
+}
+
+/**
+ * free_translator
+ * 
+ * Unlock the child process after a translation, and close it only if flagged as non-persistent!
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param translator Pointer to the addr2line process handler.
+ */
+static void free_translator(addr2line_t *backend, addr2line_process_t *translator)
+{
+	pthread_mutex_unlock(&translator->child->lock);
+	if (backend->setOptions & OPTION_NON_PERSISTENT)
+	{
+		close_translator(translator);
+	} 
+}
+
+/**
+ * read_response
+ * 
+ * Read the record printed by the addr2line process for one address (function name, then file:line[:column]).
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ * @param translator The addr2line process that received the address.
+ * @param address The original address.
+ * @param adjusted_address The address passed to the addr2line process.
+ * @param code_loc The structure to store the translation results.
+ */
+static void read_response(addr2line_t *backend, addr2line_process_t *translator, void *address, void *adjusted_address, code_loc_t *code_loc)
+{
+	line_reader_t *reader = translator->child->reader;
+	char *buf = NULL;
+	size_t len = 0;
+	int translated = 0; 
+
+	code_loc->adjusted_address = adjusted_address;
+
+	// Read the function name from addr2line's output
+	code_loc->function = NULL;
+	if ((buf = reader_getline(reader, &len)) != NULL)
+	{
+		// Copying the function name only if has been translated
+		if (strcmp(buf, UNKNOWN_ADDRESS) != 0) {
+			code_loc->function = strndup(buf, len);
+			translated = 1;
+		}
+	}
+
+	// Read the filename, line number, and column number (currently only available with elfutils) from addr2line's output
+	code_loc->file = NULL;
+	code_loc->line = code_loc->column = 0;
+	if ((buf = reader_getline(reader, &len)) != NULL)
+	{
+		int has_column = 0;
+#if defined(HAVE_ELFUTILS)
+		has_column = (translator->useBackend == USE_ELFUTILS);
+#endif
+		parse_source_location(buf, len, has_column, &code_loc->line, &code_loc->column);
+		if ((code_loc->line > 0) || (code_loc->column > 0)) translated = 1;
+
+		// Copying the filename only if has been translated
+		if (strcmp(buf, UNKNOWN_ADDRESS) != 0) {
+			code_loc->file = strdup(buf);
+			translated = 1;
+		}
+	}
+	code_loc->translated = translated;
+
+	// Make sure we return something for function and file when the translation fails
+	if ((code_loc->function == NULL) || (code_loc->file == NULL))
+	{
+		char adjusted_address_str[32];
+		format_address(adjusted_address_str, adjusted_address);
+		char *unresolved = ((backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? adjusted_address_str : UNKNOWN_ADDRESS);
+		if (code_loc->function == NULL) code_loc->function = strdup(unresolved);
+		if (code_loc->file == NULL) code_loc->file = strdup(unresolved);
+	}
+
+	// Get the mapping name
+	if (translator->execMapping != NULL) {
+		// If the addr2line process is associated with a specific mapping (binutils), use that mapping name
+		code_loc->mapping_name = strdup(mapping_path(translator->execMapping));
+	}
+	else if (backend->procMaps != NULL) {
+		// If the input was a maps file (elfutils), find the mapping that contains the address
+		maps_entry_t *entry = search_in_exec_mappings(backend->procMaps, (unsigned long)address);
+		code_loc->mapping_name = strdup(mapping_path(entry));
+	}
+	else {
+		// If no maps file was given (binutils/elfutils), use the input binary as the mapping name only when the translation was successful
+		if (translated) code_loc->mapping_name = strdup(backend->inputObject);
+		else code_loc->mapping_name = strdup(UNKNOWN_MAPPING);
+	}
+
+	PROBE(libaddr2line, response__received, translator->useBackend, translator->child->pid, address, translated, code_loc->function);
+}
+
+/**
+ * translate_address
+ * 
+ * Body of addr2line_translate (the lock of the handler must be held).
+ */
+static void translate_address(addr2line_t *backend, void *address, code_loc_t *code_loc)
+{
+	void *adjusted_address_ptr = NULL;
+	struct timespec start;
+
+	// Follow the mappings added or removed through maps_refresh()
+	if ((backend->procMaps != NULL) && (backend->procMaps->generation != backend->mapsGeneration)) sync_maps(backend);
+
+	// JIT-compiled code is resolved in-process, and so are the functions already learned if only functions are needed
+	if (translate_with_jit(backend, address, code_loc)) return;
+	if (translate_with_ranges(backend, address, code_loc)) return;
+
+	if (backend->useBackend == USE_ADAPTIVE)
+	{
+		// Objects without debugging information are resolved through their symbol table
+		if (translate_with_symtab(backend, address, code_loc)) return;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	}
+
+	// Select the addr2line process to use and invoke it
+	addr2line_process_t *translator = invoke_translator(backend, address, &adjusted_address_ptr);
+	read_response(backend, translator, address, adjusted_address_ptr, code_loc);
+	range_learn(backend, address, code_loc);
+
+	// Free resources
+	free_translator(backend, translator);
+
+	if (backend->useBackend == USE_ADAPTIVE) adaptive_record(backend, translator, address, &start);
+}
+
+/**
+ * addr2line_translate
+ * 
+ * Translate a memory address into the corresponding function, file, line, column (elfutils only) and mapping (if maps file was given).
+ * 
+ * @param backend  The handler of the running addr2line process
+ * @param address  The memory address to translate.
+ * @param code_loc The structure to store the translation results.
+ */
+
+void addr2line_translate(addr2line_t *backend, void *address, code_loc_t *code_loc)
+{
+	pthread_mutex_lock(&backend->lock);
+	translate_address(backend, address, code_loc);
+	pthread_mutex_unlock(&backend->lock);
+}
+
+/**
+ * translate_batch
+ * 
+ * Body of addr2line_translate_batch (the lock of the handler must be held).
+ */
+static void translate_batch(addr2line_t *backend, void **addresses, int count, code_loc_t *code_locs)
+{
+	if (is_functions_only(backend))
+	{
+		if ((backend->procMaps != NULL) && (backend->procMaps->generation != backend->mapsGeneration)) sync_maps(backend);
+		translate_functions(backend, addresses, NULL, count, NULL, code_locs, NULL);
+		return;
+	}
+	if ((backend->useBackend == USE_ADAPTIVE) || (backend->setOptions & OPTION_NON_PERSISTENT))
+	{
+		for (int i = 0; i < count; ++i) translate_address(backend, addresses[i], &code_locs[i]);
+		return;
+	}
+
+	// Follow the mappings added or removed through maps_refresh()
+	if ((backend->procMaps != NULL) && (backend->procMaps->generation != backend->mapsGeneration)) sync_maps(backend);
+
+	addr2line_process_t **translators = malloc(BATCH_WINDOW * sizeof(addr2line_process_t *));
+	void **adjusted = malloc(BATCH_WINDOW * sizeof(void *));
+	char *pending = malloc(BATCH_WINDOW * sizeof(char));
+	line_writer_t *writer = malloc(sizeof(line_writer_t));
+	if ((translators == NULL) || (adjusted == NULL) || (pending == NULL) || (writer == NULL)) {
+		fprintf(stderr, "ERROR: addr2line_translate_batch: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (int base = 0; base < count; base += BATCH_WINDOW)
+	{
+		int window = (count - base < BATCH_WINDOW ? count - base : BATCH_WINDOW);
+		for (int i = 0; i < window; ++i)
+		{
+			if ((translate_with_jit(backend, addresses[base + i], &code_locs[base + i])) || (translate_with_ranges(backend, addresses[base + i], &code_locs[base + i]))) {
+				translators[i] = NULL;
+				pending[i] = 0;
+				continue;
+			}
+			adjusted[i] = adjust_address(backend, addresses[base + i], &translators[i]);
+			pending[i] = 1;
+		}
+
+		// Serve one addr2line process at a time, so that only one child is locked at once
+		for (int i = 0; i < window; ++i)
+		{
+			if (!pending[i]) continue;
+
+			addr2line_process_t *translator = translators[i];
+			if (translator->child == NULL) translator->child = acquire_child(backend, translator, NULL);
+			pthread_mutex_lock(&translator->child->lock);
+
+			int num_requests = 0;
+			writer_init(writer, translator->child->parentWrite[WRITE_END]);
+			for (int j = i; j < window; ++j) {
+				if (translators[j] == translator) {
+					writer_append_address(writer, adjusted[j]);
+					num_requests ++;
+				}
+			}
+			writer_flush(writer);
+			PROBE(libaddr2line, request__write, translator->useBackend, translator->child->pid, translator->child->object, addresses[base + i], num_requests);
+
+			for (int j = i; j < window; ++j) 
+			{
+				if (translators[j] == translator) 
+				{
+					read_response(backend, translator, addresses[base + j], adjusted[j], &code_locs[base + j]);
+					range_learn(backend, addresses[base + j], &code_locs[base + j]);
+					pending[j] = 0;
+				}
+			}
+			pthread_mutex_unlock(&translator->child->lock);
+		}
+	}
+	free(translators);
+	free(adjusted);
+	free(pending);
+	free(writer);
+}
+
+/**
+ * addr2line_translate_batch
+ * 
+ * Translate many addresses at once. Within each window of BATCH_WINDOW addresses, the addresses that go
+ * to the same addr2line process are written in a single coalesced write and their records are read back
+ * afterwards, instead of paying a write/read round trip per address. The window is small enough for its 
+ * addresses to fit in the pipe, so the write never blocks while the addr2line process is blocked writing
+ * its output back. Functions-only mode resolves the addresses from the symbol tables in a single loop (see
+ * translate_functions), and adaptive and non-persistent modes fall back to translating one address at a time.
+ * 
+ * @param backend   The handler of the running addr2line process
+ * @param addresses The memory addresses to translate.
+ * @param count     Number of addresses.
+ * @param code_locs Array of count structures to store the translation results, in the same order as the addresses.
+ */
+void addr2line_translate_batch(addr2line_t *backend, void **addresses, int count, code_loc_t *code_locs)
+{
+	pthread_mutex_lock(&backend->lock);
+	translate_batch(backend, addresses, count, code_locs);
+	pthread_mutex_unlock(&backend->lock);
+}
+
+/**
+ * compare_by_weight
+ *
+ * Order the weighted addresses by decreasing weight, and by input order for equal weights.
+ */
+static int compare_by_weight(const void *a, const void *b)
+{
+	const addr2line_weighted_t *wa = (const addr2line_weighted_t *)a, *wb = (const addr2line_weighted_t *)b;
+	if (wa->weight > wb->weight) return -1;
+	if (wa->weight < wb->weight) return 1;
+	return (wa->index < wb->index ? -1 : (wa->index > wb->index ? 1 : 0));
+}
+
+/**
+ * deadline_passed
+ *
+ * Check if the deadline of a time-budgeted translation has been reached (never, if tv_sec is 0).
+ */
+static int deadline_passed(struct timespec *deadline)
+{
+	if (deadline->tv_sec == 0) return 0;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec > deadline->tv_sec) || ((now.tv_sec == deadline->tv_sec) && (now.tv_nsec >= deadline->tv_nsec)));
+}
+
+/**
+ * skip_translation
+ *
+ * Fill in the result of an address that was not translated before the deadline, as a failed translation.
+ */
+static void skip_translation(addr2line_t *backend, void *address, void *adjusted_address, code_loc_t *code_loc)
+{
+	char adjusted_address_str[32];
+	format_address(adjusted_address_str, adjusted_address);
+	char *unresolved = ((backend->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? adjusted_address_str : UNKNOWN_ADDRESS);
+
+	code_loc->adjusted_address = adjusted_address;
+	code_loc->function = strdup(unresolved);
+	code_loc->file = strdup(unresolved);
+	code_loc->line = code_loc->column = 0;
+	code_loc->translated = 0;
+
+	maps_entry_t *entry = (backend->procMaps != NULL ? search_in_exec_mappings(backend->procMaps, (unsigned long)address) : NULL);
+	code_loc->mapping_name = strdup(mapping_path(entry));
+}
+
+/**
+ * schedule_worker
+ *
+ * Body of the threads of addr2line_translate_scheduled. Each round takes the idle queue whose next address has
+ * the highest weight, and sends its next SCHEDULE_CHUNK addresses in a single write to the addr2line process of
+ * the queue, so that the processes work in parallel and the hottest pending addresses always go first. No more
+ * chunks are taken once the deadline has passed.
+ */
+static void *schedule_worker(void *arg)
+{
+	addr2line_schedule_t *schedule = (addr2line_schedule_t *)arg;
+	addr2line_t *backend = schedule->backend;
+	line_writer_t *writer = malloc(sizeof(line_writer_t));
+	if (writer == NULL) {
+		fprintf(stderr, "ERROR: schedule_worker: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	while (1)
+	{
+		// Pick the idle queue with the hottest pending address, which is the one with the lowest rank
+		addr2line_queue_t *queue = NULL;
+		pthread_mutex_lock(&schedule->lock);
+		if (!deadline_passed(&schedule->deadline))
+		{
+			for (int q = 0; q < schedule->numQueues; ++q)
+			{
+				addr2line_queue_t *candidate = &schedule->queues[q];
+				if ((candidate->busy) || (candidate->next == candidate->numItems)) continue;
+				if ((queue == NULL) || (candidate->items[candidate->next] < queue->items[queue->next])) queue = candidate;
+			}
+		}
+		int first = 0, num_requests = 0;
+		if (queue != NULL)
+		{
+			first = queue->next;
+			num_requests = (queue->numItems - first < SCHEDULE_CHUNK ? queue->numItems - first : SCHEDULE_CHUNK);
+			queue->next += num_requests;
+			queue->busy = 1;
+		}
+		pthread_mutex_unlock(&schedule->lock);
+		if (queue == NULL) break;
+
+		addr2line_process_t *translator = queue->translator;
+		if (translator->child == NULL)
+		{
+			int uses_maps_file = 0;
+			char *object = translator_object(backend, translator, &uses_maps_file);
+			translator->child = (queue->isPrivate ? spawn_child(translator->useBackend, object, uses_maps_file, NULL) : acquire_child(backend, translator, NULL));
+		}
+		pthread_mutex_lock(&translator->child->lock);
+
+		writer_init(writer, translator->child->parentWrite[WRITE_END]);
+		for (int i = first; i < first + num_requests; ++i) {
+			writer_append_address(writer, schedule->adjusted[schedule->order[queue->items[i]]]);
+		}
+		writer_flush(writer);
+		PROBE(libaddr2line, request__write, translator->useBackend, translator->child->pid, translator->child->object, schedule->addresses[schedule->order[queue->items[first]]], num_requests);
+
+		for (int i = first; i < first + num_requests; ++i)
+		{
+			int item = schedule->order[queue->items[i]];
+			read_response(backend, translator, schedule->addresses[item], schedule->adjusted[item], &schedule->code_locs[item]);
+			schedule->done[item] = 1;
+		}
+		pthread_mutex_unlock(&translator->child->lock);
+
+		// The function ranges are shared by the threads, so they are learned under the lock of the schedule
+		pthread_mutex_lock(&schedule->lock);
+		for (int i = first; i < first + num_requests; ++i)
+		{
+			int item = schedule->order[queue->items[i]];
+			range_learn(backend, schedule->addresses[item], &schedule->code_locs[item]);
+		}
+		queue->busy = 0;
+		schedule->numTranslated += num_requests;
+		pthread_mutex_unlock(&schedule->lock);
+	}
+	free(writer);
+	return NULL;
+}
+
+/**
+ * translate_scheduled
+ * 
+ * Body of addr2line_translate_scheduled (the lock of the handler must be held).
+ */
+static int translate_scheduled(addr2line_t *backend, void **addresses, unsigned long *weights, int count, double budget, code_loc_t *code_locs)
+{
+	if (count <= 0) return 0;
+
+	// Follow the mappings added or removed through maps_refresh()
+	if ((backend->procMaps != NULL) && (backend->procMaps->generation != backend->mapsGeneration)) sync_maps(backend);
+
+	addr2line_schedule_t schedule;
+	schedule.backend = backend;
+	schedule.addresses = addresses;
+	schedule.weights = weights;
+	schedule.code_locs = code_locs;
+	schedule.numTranslated = 0;
+	schedule.deadline.tv_sec = schedule.deadline.tv_nsec = 0;
+	if (budget > 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &schedule.deadline);
+		long nsec = schedule.deadline.tv_nsec + (long)((budget - (long)budget) * 1e9);
+		schedule.deadline.tv_sec += (time_t)budget + nsec / 1000000000L;
+		schedule.deadline.tv_nsec = nsec % 1000000000L;
+	}
+
+	addr2line_weighted_t *weighted = malloc(count * sizeof(addr2line_weighted_t));
+	int *order = malloc(count * sizeof(int));
+	schedule.adjusted = malloc(count * sizeof(void *));
+	schedule.done = calloc(count, sizeof(char));
+	if ((weighted == NULL) || (order == NULL) || (schedule.adjusted == NULL) || (schedule.done == NULL)) {
+		fprintf(stderr, "ERROR: addr2line_translate_scheduled: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < count; ++i) {
+		weighted[i].weight = (weights != NULL ? weights[i] : 0);
+		weighted[i].index = i;
+		schedule.adjusted[i] = addresses[i];
+	}
+	qsort(weighted, count, sizeof(addr2line_weighted_t), compare_by_weight);
+	for (int i = 0; i < count; ++i) order[i] = weighted[i].index;
+	free(weighted);
+	schedule.order = order;
+
+	if (is_functions_only(backend))
+	{
+		schedule.numTranslated = translate_functions(backend, addresses, order, count, &schedule.deadline, code_locs, schedule.done);
+	}
+	else if ((backend->useBackend == USE_ADAPTIVE) || (backend->setOptions & OPTION_NON_PERSISTENT))
+	{
+		for (int i = 0; (i < count) && (!deadline_passed(&schedule.deadline)); ++i)
+		{
+			translate_address(backend, addresses[order[i]], &code_locs[order[i]]);
+			schedule.done[order[i]] = 1;
+			schedule.numTranslated ++;
+		}
+	}
+	else
+	{
+		// Route the addresses to their addr2line processes
+		int *routes = malloc(count * sizeof(int));
+		if (routes == NULL) {
+			fprintf(stderr, "ERROR: addr2line_translate_scheduled: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		int num_routed = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			routes[i] = -1;
+			if ((translate_with_jit(backend, addresses[i], &code_locs[i])) || (translate_with_ranges(backend, addresses[i], &code_locs[i]))) {
+				schedule.done[i] = 1;
+				schedule.numTranslated ++;
+				continue;
+			}
+			addr2line_process_t *translator = NULL;
+			schedule.adjusted[i] = adjust_address(backend, addresses[i], &translator);
+			routes[i] = translator - backend->processList;
+			num_routed ++;
+		}
+
+		/*
+		 * There is one queue per addr2line process, except when the handler has a single one (a maps file given 
+		 * to elfutils, or a binary), whose addresses are dealt round-robin to as many queues as processors. The 
+		 * extra queues are served by private children of the same command, ended when the translation is over.
+		 */
+		long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+		schedule.numQueues = backend->numProcesses;
+		if (schedule.numQueues == 1)
+		{
+			long num_chunks = (num_routed + SCHEDULE_CHUNK - 1) / SCHEDULE_CHUNK;
+			schedule.numQueues = (num_chunks < num_processors ? num_chunks : num_processors);
+			if (schedule.numQueues < 1) schedule.numQueues = 1;
+		}
+		schedule.queues = calloc(schedule.numQueues, sizeof(addr2line_queue_t));
+		if (schedule.queues == NULL) {
+			fprintf(stderr, "ERROR: addr2line_translate_scheduled: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		int dealt = 0;
+		for (int i = 0; i < count; ++i) {
+			if (routes[i] >= 0) schedule.queues[(backend->numProcesses == 1 ? (dealt ++) % schedule.numQueues : routes[i])].numItems ++;
+		}
+		int num_busy_queues = 0;
+		for (int q = 0; q < schedule.numQueues; ++q)
+		{
+			addr2line_queue_t *queue = &schedule.queues[q];
+			queue->translator = &backend->processList[(backend->numProcesses == 1 ? 0 : q)];
+			if ((backend->numProcesses == 1) && (q > 0))
+			{
+				queue->privateTranslator = *queue->translator;
+				queue->privateTranslator.child = NULL;
+				queue->translator = &queue->privateTranslator;
+				queue->isPrivate = 1;
+			}
+			queue->items = malloc((queue->numItems + 1) * sizeof(int));
+			if (queue->items == NULL) {
+				fprintf(stderr, "ERROR: addr2line_translate_scheduled: Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			if (queue->numItems > 0) num_busy_queues ++;
+			queue->numItems = 0;
+		}
+		dealt = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			int q = routes[order[i]];
+			if (q < 0) continue;
+			if (backend->numProcesses == 1) q = (dealt ++) % schedule.numQueues;
+			schedule.queues[q].items[schedule.queues[q].numItems ++] = i;
+		}
+		free(routes);
+
+		// Serve the queues with as many threads as processors, or inline if there is a single queue
+		long num_threads = (num_processors < num_busy_queues ? num_processors : num_busy_queues);
+		pthread_mutex_init(&schedule.lock, NULL);
+		if (num_threads <= 1) schedule_worker(&schedule);
+		else
+		{
+			pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+			if (threads == NULL) {
+				fprintf(stderr, "ERROR: addr2line_translate_scheduled: Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			for (int t = 0; t < num_threads; ++t)
+			{
+				if (pthread_create(&threads[t], NULL, schedule_worker, &schedule) != 0) {
+					perror("pthread_create failed");
+					exit(EXIT_FAILURE);
+				}
+			}
+			for (int t = 0; t < num_threads; ++t) {
+				pthread_join(threads[t], NULL);
+			}
+			free(threads);
+		}
+		pthread_mutex_destroy(&schedule.lock);
+
+		for (int q = 0; q < schedule.numQueues; ++q)
+		{
+			if (schedule.queues[q].isPrivate) close_translator(&schedule.queues[q].privateTranslator);
+			free(schedule.queues[q].items);
+		}
+		free(schedule.queues);
+	}
+
+	// The addresses left behind are reported as not translated
+	for (int i = 0; i < count; ++i) {
+		if (!schedule.done[i]) skip_translation(backend, addresses[i], schedule.adjusted[i], &code_locs[i]);
+	}
+	free(order);
+	free(schedule.adjusted);
+	free(schedule.done);
+	return schedule.numTranslated;
+}
+
+/**
+ * addr2line_translate_scheduled
+ *
+ * Translate as many addresses as possible within a time budget, the ones with the highest weight (e.g. the
+ * number of samples) first. Every addr2line process of the handler gets a queue of the addresses routed to it,
+ * by decreasing weight, and up to one thread per processor serves the queues in parallel, always taking next
+ * the queue with the hottest pending address (see schedule_worker). A handler with a single addr2line process
+ * (a maps file with elfutils, or a binary) gets one queue per processor instead, each extra queue served by a
+ * private child of the same command, so the addresses are also translated in parallel at the cost of starting
+ * those children. Like addr2line_translate, JIT-compiled code and the functions already learned with 
+ * OPTION_LEARN_FUNCTIONS are answered before routing, and the functions translated are learned. Addresses are 
+ * sent in chunks, so the deadline is checked often and is overrun by at most one chunk per thread (plus the start of an addr2line 
+ * process, if the chunk is the first one of its queue). Functions-only mode resolves the addresses from the
+ * symbol tables in a single loop, and adaptive and non-persistent modes translate one address at a time, both
+ * also by decreasing weight.
+ *
+ * @param backend   The handler of the running addr2line process
+ * @param addresses The memory addresses to translate.
+ * @param weights   Weight of each address (NULL to translate them in input order).
+ * @param count     Number of addresses.
+ * @param budget    Time budget in seconds (no limit if zero or negative).
+ * @param code_locs Array of count structures to store the translation results, in the same order as the addresses.
+ *                  The addresses left when the deadline passes are filled in as not translated.
+ * @return Number of addresses translated (resolved or not) before the deadline.
+ */
+int addr2line_translate_scheduled(addr2line_t *backend, void **addresses, unsigned long *weights, int count, double budget, code_loc_t *code_locs)
+{
+	pthread_mutex_lock(&backend->lock);
+	int result = translate_scheduled(backend, addresses, weights, count, budget, code_locs);
+	pthread_mutex_unlock(&backend->lock);
+	return result;
+}
+
+/**
+ * stack_cache_create
+ *
+ * Allocate an empty stack cache.
+ */
+static addr2line_stack_cache_t *stack_cache_create()
+{
+	addr2line_stack_cache_t *cache = malloc(sizeof(addr2line_stack_cache_t));
+	if (cache != NULL)
+	{
+		cache->numFrames = cache->numNodes = 0;
+		cache->maxFrames = cache->maxNodes = STACK_CACHE_INITIAL_CAPACITY;
+		cache->frames = malloc(cache->maxFrames * sizeof(addr2line_frame_t));
+		cache->frameBuckets = malloc(cache->maxFrames * sizeof(int));
+		cache->nodes = malloc(cache->maxNodes * sizeof(addr2line_stack_node_t));
+		cache->nodeBuckets = malloc(cache->maxNodes * sizeof(int));
+	}
+	if ((cache == NULL) || (cache->frames == NULL) || (cache->frameBuckets == NULL) || (cache->nodes == NULL) || (cache->nodeBuckets == NULL)) {
+		fprintf(stderr, "ERROR: stack_cache_create: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(cache->frameBuckets, -1, cache->maxFrames * sizeof(int));
+	memset(cache->nodeBuckets, -1, cache->maxNodes * sizeof(int));
+	return cache;
+}
+
+/**
+ * stack_cache_free
+ *
+ * Free a stack cache and its translations.
+ */
+static void stack_cache_free(addr2line_stack_cache_t *cache)
+{
+	if (cache == NULL) return;
+	for (int i = 0; i < cache->numFrames; ++i)
+	{
+		free(cache->frames[i].code_loc.function);
+		free(cache->frames[i].code_loc.file);
+		free(cache->frames[i].code_loc.mapping_name);
+	}
+	free(cache->frames);
+	free(cache->frameBuckets);
+	free(cache->nodes);
+	free(cache->nodeBuckets);
+	free(cache);
+}
+
+/**
+ * stack_hash
+ *
+ * Hash a pair of words into a bucket of a table of the given capacity (power of 2).
+ */
+static int stack_hash(uint64_t a, uint64_t b, int capacity)
+{
+	uint64_t h = (a * 0x9e3779b97f4a7c15ULL) ^ (b + 0x632be59bd9b4e019ULL + (a << 6) + (a >> 2));
+	h *= 0xff51afd7ed558ccdULL;
+	return (int)((h ^ (h >> 32)) & (uint64_t)(capacity - 1));
+}
+
+/**
+ * stack_find_frame
+ *
+ * Get the frame of an address, adding an untranslated one if it is not in the cache yet.
+ *
+ * @param cache The stack cache.
+ * @param address The address to look up.
+ * @param[out] is_new Set to 1 if the frame was added and has to be translated.
+ * @return Index of the frame.
+ */
+static int stack_find_frame(addr2line_stack_cache_t *cache, void *address, int *is_new)
+{
+	int bucket = stack_hash((uintptr_t)address, 0, cache->maxFrames);
+	for (int i = cache->frameBuckets[bucket]; i >= 0; i = cache->frames[i].next) {
+		if (cache->frames[i].address == address) {
+			*is_new = 0;
+			return i;
+		}
+	}
+
+	if (cache->numFrames == cache->maxFrames)
+	{
+		// Double the table and rehash the chains
+		cache->maxFrames *= 2;
+		cache->frames = realloc(cache->frames, cache->maxFrames * sizeof(addr2line_frame_t));
+		cache->frameBuckets = realloc(cache->frameBuckets, cache->maxFrames * sizeof(int));
+		if ((cache->frames == NULL) || (cache->frameBuckets == NULL)) {
+			fprintf(stderr, "ERROR: stack_find_frame: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(cache->frameBuckets, -1, cache->maxFrames * sizeof(int));
+		for (int i = 0; i < cache->numFrames; ++i) {
+			int b = stack_hash((uintptr_t)cache->frames[i].address, 0, cache->maxFrames);
+			cache->frames[i].next = cache->frameBuckets[b];
+			cache->frameBuckets[b] = i;
+		}
+		bucket = stack_hash((uintptr_t)address, 0, cache->maxFrames);
+	}
+
+	int frame = cache->numFrames ++;
+	cache->frames[frame].address = address;
+	cache->frames[frame].next = cache->frameBuckets[bucket];
+	cache->frameBuckets[bucket] = frame;
+	*is_new = 1;
+	return frame;
+}
+
+/**
+ * stack_find_node
+ *
+ * Get the trie node of a frame called from the given parent node, adding it if it is not in the cache yet.
+ *
+ * @param cache The stack cache.
+ * @param parent Node of the calling frames (-1 for the outermost frame).
+ * @param frame Index of the frame.
+ * @return Index of the node.
+ */
+static int stack_find_node(addr2line_stack_cache_t *cache, int parent, int frame)
+{
+	int bucket = stack_hash((uint64_t)(int64_t)parent, frame, cache->maxNodes);
+	for (int i = cache->nodeBuckets[bucket]; i >= 0; i = cache->nodes[i].next) {
+		if ((cache->nodes[i].parent == parent) && (cache->nodes[i].frame == frame)) return i;
+	}
+
+	if (cache->numNodes == cache->maxNodes)
+	{
+		// Double the table and rehash the chains
+		cache->maxNodes *= 2;
+		cache->nodes = realloc(cache->nodes, cache->maxNodes * sizeof(addr2line_stack_node_t));
+		cache->nodeBuckets = realloc(cache->nodeBuckets, cache->maxNodes * sizeof(int));
+		if ((cache->nodes == NULL) || (cache->nodeBuckets == NULL)) {
+			fprintf(stderr, "ERROR: stack_find_node: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(cache->nodeBuckets, -1, cache->maxNodes * sizeof(int));
+		for (int i = 0; i < cache->numNodes; ++i) {
+			int b = stack_hash((uint64_t)(int64_t)cache->nodes[i].parent, cache->nodes[i].frame, cache->maxNodes);
+			cache->nodes[i].next = cache->nodeBuckets[b];
+			cache->nodeBuckets[b] = i;
+		}
+		bucket = stack_hash((uint64_t)(int64_t)parent, frame, cache->maxNodes);
+	}
+
+	int node = cache->numNodes ++;
+	cache->nodes[node].parent = parent;
+	cache->nodes[node].frame = frame;
+	cache->nodes[node].next = cache->nodeBuckets[bucket];
+	cache->nodeBuckets[bucket] = node;
+	return node;
+}
+
+/**
+ * translate_stack
+ * 
+ * Body of addr2line_translate_stack (the lock of the handler must be held).
+ */
+static int translate_stack(addr2line_t *backend, void **pcs, int depth, code_loc_t *frames)
+{
+	if (depth <= 0) return -1;
+
+	// Follow the mappings added or removed through maps_refresh(), which also empties the cache
+	if ((backend->procMaps != NULL) && (backend->procMaps->generation != backend->mapsGeneration)) sync_maps(backend);
+	if (backend->stackCache == NULL) backend->stackCache = stack_cache_create();
+	addr2line_stack_cache_t *cache = backend->stackCache;
+
+	int *frame_ids = malloc(depth * sizeof(int));
+	void **missing = malloc(depth * sizeof(void *));
+	if ((frame_ids == NULL) || (missing == NULL)) {
+		fprintf(stderr, "ERROR: addr2line_translate_stack: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Look up the frames, collecting the ones that were never translated
+	int num_missing = 0;
+	for (int i = 0; i < depth; ++i)
+	{
+		int is_new = 0;
+		void *lookup = (i == 0 ? pcs[0] : (void *)((uintptr_t)pcs[i] - 1));
+		frame_ids[i] = stack_find_frame(cache, lookup, &is_new);
+		if (is_new) {
+			PROBE(libaddr2line, cache__miss, "stack", lookup);
+			missing[num_missing++] = lookup;
+		}
+		else PROBE(libaddr2line, cache__hit, "stack", lookup);
+	}
+	if (num_missing > 0)
+	{
+		code_loc_t *code_locs = malloc(num_missing * sizeof(code_loc_t));
+		if (code_locs == NULL) {
+			fprintf(stderr, "ERROR: addr2line_translate_stack: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		translate_batch(backend, missing, num_missing, code_locs);
+
+		// The new frames were appended to the cache in the same order
+		for (int i = 0; i < num_missing; ++i) {
+			cache->frames[cache->numFrames - num_missing + i].code_loc = code_locs[i];
+		}
+		free(code_locs);
+	}
+
+	// Walk down the trie from the outermost frame
+	int node = -1;
+	for (int i = depth - 1; i >= 0; --i) {
+		node = stack_find_node(cache, node, frame_ids[i]);
+	}
+
+	for (int i = 0; i < depth; ++i) {
+		copy_code_loc(&frames[i], &cache->frames[frame_ids[i]].code_loc);
+	}
+	free(frame_ids);
+	free(missing);
+	return node;
+}
+
+/**
+ * addr2line_translate_stack
+ *
+ * Translate a whole call stack. pcs[0] is the PC of the innermost frame and is translated as is, while the
+ * outer entries are return addresses, which point to the instruction after the call. Those are translated
+ * at the return address minus one, so that they resolve to the line of the call (which may even belong to
+ * a different function, e.g. for calls to noreturn functions at the end of a function).
+ *
+ * Every distinct frame is translated once for the lifetime of the handler (the frames that are new to
+ * the cache are sent together through addr2line_translate_batch), and stacks are hash-consed into a trie
+ * rooted at the outermost frame, so stacks sharing their outer frames share their nodes. The identifier
+ * returned is the same for identical stacks, and can be used to aggregate them.
+ *
+ * @param backend The handler of the running addr2line process
+ * @param pcs     The PCs of the frames, from the innermost to the outermost.
+ * @param depth   Number of frames.
+ * @param frames  Array of depth structures to store the translation of each frame (strings owned by the caller).
+ * @return Identifier of the stack, or -1 if depth is 0.
+ */
+int addr2line_translate_stack(addr2line_t *backend, void **pcs, int depth, code_loc_t *frames)
+{
+	pthread_mutex_lock(&backend->lock);
+	int result = translate_stack(backend, pcs, depth, frames);
+	pthread_mutex_unlock(&backend->lock);
+	return result;
+}
+
+/**
+ * addr2line_aggregate_init
+ * 
+ * Create an aggregator that folds samples into counts per function, per line or per stack. Samples are
+ * only collapsed by unique PC (and stack) as they are added; the translation is deferred to 
+ * addr2line_aggregate_finish, which translates each unique PC once, so the cost grows with the number
+ * of distinct PCs rather than with the number of samples.
+ * 
+ * @param backend The handler used to translate the PCs (owned by the caller, and only used by addr2line_aggregate_finish).
+ * @param mode    AGGREGATE_FUNCTIONS, AGGREGATE_LINES or AGGREGATE_STACKS.
+ * @return The aggregator.
+ */
+addr2line_aggregate_t *addr2line_aggregate_init(addr2line_t *backend, int mode)
+{
+	addr2line_aggregate_t *aggregate = malloc(sizeof(addr2line_aggregate_t));
+	if (aggregate == NULL) {
+		fprintf(stderr, "ERROR: addr2line_aggregate_init: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	aggregate->backend = backend;
+	aggregate->mode = mode;
+	aggregate->samples = stack_cache_create();
+	aggregate->numTranslated = 0;
+	aggregate->weights = NULL;
+	aggregate->maxWeights = 0;
+	aggregate->folded = NULL;
+	aggregate->numFolded = 0;
+	aggregate->numSamples = 0;
+	return aggregate;
+}
+
+/**
+ * aggregate_weigh
+ * 
+ * Add weight to a unique PC or stack node, growing the weights along with the sample tables.
+ */
+static void aggregate_weigh(addr2line_aggregate_t *aggregate, int index, unsigned long weight)
+{
+	if (index >= aggregate->maxWeights)
+	{
+		int max_weights = (aggregate->maxWeights == 0 ? STACK_CACHE_INITIAL_CAPACITY : aggregate->maxWeights);
+		while (index >= max_weights) max_weights *= 2;
+		aggregate->weights = realloc(aggregate->weights, max_weights * sizeof(unsigned long));
+		if (aggregate->weights == NULL) {
+			fprintf(stderr, "ERROR: aggregate_weigh: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(&aggregate->weights[aggregate->maxWeights], 0, (max_weights - aggregate->maxWeights) * sizeof(unsigned long));
+		aggregate->maxWeights = max_weights;
+	}
+	aggregate->weights[index] += weight;
+}
+
+/**
+ * aggregate_find_pc
+ * 
+ * Get the unique PC of an address, adding it untranslated if it was never sampled.
+ */
+static int aggregate_find_pc(addr2line_aggregate_t *aggregate, void *address)
+{
+	int is_new = 0;
+	int frame = stack_find_frame(aggregate->samples, address, &is_new);
+	if (is_new)
+	{
+		code_loc_t *code_loc = &aggregate->samples->frames[frame].code_loc;
+		code_loc->function = code_loc->file = code_loc->mapping_name = NULL;
+	}
+	return frame;
+}
+
+/**
+ * addr2line_aggregate_add
+ * 
+ * Add a sample of a single address.
+ * 
+ * @param aggregate The aggregator.
+ * @param address   The sampled PC.
+ * @param weight    Weight of the sample (e.g. 1, or the period of the sampling event).
+ */
+void addr2line_aggregate_add(addr2line_aggregate_t *aggregate, void *address, unsigned long weight)
+{
+	addr2line_aggregate_add_stack(aggregate, &address, 1, weight);
+}
+
+/**
+ * addr2line_aggregate_add_stack
+ * 
+ * Add a sample of a call stack. pcs[0] is the PC of the innermost frame, and the outer entries are
+ * return addresses, which are looked up at the return address minus one as in addr2line_translate_stack.
+ * Only the innermost frame is counted for AGGREGATE_FUNCTIONS and AGGREGATE_LINES.
+ * 
+ * @param aggregate The aggregator.
+ * @param pcs       The PCs of the frames, from the innermost to the outermost.
+ * @param depth     Number of frames.
+ * @param weight    Weight of the sample.
+ */
+void addr2line_aggregate_add_stack(addr2line_aggregate_t *aggregate, void **pcs, int depth, unsigned long weight)
+{
+	if (depth <= 0) return;
+	aggregate->numSamples ++;
+
+	if (aggregate->mode != AGGREGATE_STACKS)
+	{
+		aggregate_weigh(aggregate, aggregate_find_pc(aggregate, pcs[0]), weight);
+		return;
+	}
+
+	// Walk down the trie from the outermost frame
+	int node = -1;
+	for (int i = depth - 1; i >= 0; --i)
+	{
+		void *lookup = (i == 0 ? pcs[0] : (void *)((uintptr_t)pcs[i] - 1));
+		node = stack_find_node(aggregate->samples, node, aggregate_find_pc(aggregate, lookup));
+	}
+	aggregate_weigh(aggregate, node, weight);
+}
+
+/**
+ * fold_hash
+ * 
+ * FNV-1a hash of a folded key.
+ */
+static size_t fold_hash(const char *key)
+{
+	size_t hash = 2166136261u;
+	for (const unsigned char *c = (const unsigned char *)key; *c != '\0'; ++c) {
+		hash = (hash ^ *c) * 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * compare_folded
+ * 
+ * Order folded counts by decreasing weight, then by key.
+ */
+static int compare_folded(const void *a, const void *b)
+{
+	const addr2line_folded_t *fa = (const addr2line_folded_t *)a;
+	const addr2line_folded_t *fb = (const addr2line_folded_t *)b;
+	if (fa->weight != fb->weight) return (fa->weight > fb->weight ? -1 : 1);
+	return strcmp(fa->key, fb->key);
+}
+
+/**
+ * fold_key
+ * 
+ * Build the key a unique PC or stack node is folded into.
+ */
+static char *fold_key(addr2line_aggregate_t *aggregate, int index)
+{
+	addr2line_stack_cache_t *samples = aggregate->samples;
+	char *key = NULL;
+
+	if (aggregate->mode == AGGREGATE_FUNCTIONS) {
+		key = strdup(samples->frames[index].code_loc.function);
+	}
+	else if (aggregate->mode == AGGREGATE_LINES) {
+		code_loc_t *code_loc = &samples->frames[index].code_loc;
+		size_t len = strlen(code_loc->file) + 16;
+		if ((key = malloc(len)) != NULL) snprintf(key, len, "%s:%d", code_loc->file, code_loc->line);
+	}
+	else {
+		// Function names from the outermost frame, separated by semicolons
+		size_t len = 0;
+		for (int node = index; node >= 0; node = samples->nodes[node].parent) {
+			len += strlen(samples->frames[samples->nodes[node].frame].code_loc.function) + 1;
+		}
+		if ((key = malloc(len)) != NULL)
+		{
+			size_t end = len - 1;
+			key[end] = '\0';
+			for (int node = index; node >= 0; node = samples->nodes[node].parent)
+			{
+				const char *function = samples->frames[samples->nodes[node].frame].code_loc.function;
+				size_t function_len = strlen(function);
+				end -= function_len;
+				memcpy(&key[end], function, function_len);
+				if (end > 0) key[--end] = ';';
+			}
+		}
+	}
+	if (key == NULL) {
+		fprintf(stderr, "ERROR: fold_key: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return key;
+}
+
+/**
+ * addr2line_aggregate_finish
+ * 
+ * Translate the unique PCs sampled since the last call in a single batch, and fold the weights of the 
+ * PCs (or stacks) that share a function, line or folded stack. More samples can be added afterwards,
+ * and the counts folded again.
+ * 
+ * @param aggregate The aggregator.
+ * @param[out] folded Array of folded counts by decreasing weight (owned by the aggregator, valid until the next call or addr2line_aggregate_free).
+ * @return Number of folded counts.
+ */
+int addr2line_aggregate_finish(addr2line_aggregate_t *aggregate, addr2line_folded_t **folded)
+{
+	addr2line_stack_cache_t *samples = aggregate->samples;
+
+	// Translate the new PCs
+	int num_new = samples->numFrames - aggregate->numTranslated;
+	if (num_new > 0)
+	{
+		void **addresses = malloc(num_new * sizeof(void *));
+		code_loc_t *code_locs = malloc(num_new * sizeof(code_loc_t));
+		if ((addresses == NULL) || (code_locs == NULL)) {
+			fprintf(stderr, "ERROR: addr2line_aggregate_finish: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < num_new; ++i) {
+			addresses[i] = samples->frames[aggregate->numTranslated + i].address;
+		}
+		addr2line_translate_batch(aggregate->backend, addresses, num_new, code_locs);
+		for (int i = 0; i < num_new; ++i) {
+			samples->frames[aggregate->numTranslated + i].code_loc = code_locs[i];
+		}
+		aggregate->numTranslated = samples->numFrames;
+		free(addresses);
+		free(code_locs);
+	}
+
+	for (int i = 0; i < aggregate->numFolded; ++i) free(aggregate->folded[i].key);
+	free(aggregate->folded);
+	aggregate->folded = NULL;
+	aggregate->numFolded = 0;
+
+	// Fold through an open-addressing table of the keys (indices of the folded counts, -1 if empty)
+	int num_weighted = (aggregate->mode == AGGREGATE_STACKS ? samples->numNodes : samples->numFrames);
+	size_t capacity = 1;
+	while (capacity < (size_t)num_weighted * 2) capacity <<= 1;
+	int *table = malloc(capacity * sizeof(int));
+	aggregate->folded = malloc((num_weighted > 0 ? num_weighted : 1) * sizeof(addr2line_folded_t));
+	if ((table == NULL) || (aggregate->folded == NULL)) {
+		fprintf(stderr, "ERROR: addr2line_aggregate_finish: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(table, -1, capacity * sizeof(int));
+
+	for (int i = 0; (i < num_weighted) && (i < aggregate->maxWeights); ++i)
+	{
+		if (aggregate->weights[i] == 0) continue;
+
+		char *key = fold_key(aggregate, i);
+		size_t slot = fold_hash(key) & (capacity - 1);
+		while ((table[slot] >= 0) && (strcmp(aggregate->folded[table[slot]].key, key) != 0)) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if (table[slot] >= 0)
+		{
+			aggregate->folded[table[slot]].weight += aggregate->weights[i];
+			free(key);
+		}
+		else
+		{
+			table[slot] = aggregate->numFolded;
+			aggregate->folded[aggregate->numFolded].key = key;
+			aggregate->folded[aggregate->numFolded].weight = aggregate->weights[i];
+			aggregate->numFolded ++;
+		}
+	}
+	free(table);
+
+	qsort(aggregate->folded, aggregate->numFolded, sizeof(addr2line_folded_t), compare_folded);
+	if (folded != NULL) *folded = aggregate->folded;
+	return aggregate->numFolded;
+}
+
+/**
+ * addr2line_aggregate_write
+ * 
+ * Fold the samples (see addr2line_aggregate_finish) and write one "key weight" line per folded count,
+ * which for AGGREGATE_STACKS is the collapsed stack format read by flame graph tools.
+ * 
+ * @param aggregate The aggregator.
+ * @param output    The output stream.
+ */
+void addr2line_aggregate_write(addr2line_aggregate_t *aggregate, FILE *output)
+{
+	addr2line_folded_t *folded = NULL;
+	int num_folded = addr2line_aggregate_finish(aggregate, &folded);
+	for (int i = 0; i < num_folded; ++i) {
+		fprintf(output, "%s %lu\n", folded[i].key, folded[i].weight);
+	}
+}
+
+/**
+ * addr2line_aggregate_free
+ * 
+ * Free the aggregator, its samples and its folded counts (the handler is left open).
+ * 
+ * @param aggregate The aggregator.
+ */
+void addr2line_aggregate_free(addr2line_aggregate_t *aggregate)
+{
+	if (aggregate == NULL) return;
+	for (int i = 0; i < aggregate->numFolded; ++i) free(aggregate->folded[i].key);
+	free(aggregate->folded);
+	free(aggregate->weights);
+	stack_cache_free(aggregate->samples);
+	free(aggregate);
+}
+
+/**
+ * async_thread
+ * 
+ * Body of the background I/O thread. Takes the queued requests in batches, translates them with 
+ * addr2line_translate_batch, and moves them to the completions queue in the same order.
+ * 
+ * @param arg The addr2line backend handler.
+ */
+static void *async_thread(void *arg)
+{
+	addr2line_t *backend = (addr2line_t *)arg;
+	addr2line_async_t *async = backend->async;
+	void **addresses = malloc(ASYNC_BATCH * sizeof(void *));
+	code_loc_t *code_locs = malloc(ASYNC_BATCH * sizeof(code_loc_t));
+	if ((addresses == NULL) || (code_locs == NULL)) {
+		fprintf(stderr, "ERROR: async_thread: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&async->lock);
+	while (1)
+	{
+		while ((async->requests == NULL) && (!async->shutdown)) {
+			pthread_cond_wait(&async->requestsReady, &async->lock);
+		}
+		// Pending requests are still served after a shutdown request
+		if (async->requests == NULL) break;
+
+		// Detach up to ASYNC_BATCH requests from the queue
+		addr2line_request_t *first = async->requests, *last = first;
+		int count = 1;
+		while ((last->next != NULL) && (count < ASYNC_BATCH)) {
+			last = last->next;
+			count ++;
+		}
+		async->requests = last->next;
+		if (async->requests == NULL) async->lastRequest = NULL;
+		last->next = NULL;
+		pthread_mutex_unlock(&async->lock);
+
+		// Translate the batch without holding the lock of the queues, so that the application keeps enqueueing
+		addr2line_request_t *request = first;
+		for (int i = 0; i < count; ++i, request = request->next) addresses[i] = request->address;
+		addr2line_translate_batch(backend, addresses, count, code_locs);
+		request = first;
+		for (int i = 0; i < count; ++i, request = request->next) request->code_loc = code_locs[i];
+
+		pthread_mutex_lock(&async->lock);
+		if (async->lastCompletion != NULL) async->lastCompletion->next = first;
+		else async->completions = first;
+		async->lastCompletion = last;
+		pthread_cond_broadcast(&async->completionsReady);
+	}
+	pthread_mutex_unlock(&async->lock);
+
+	free(addresses);
+	free(code_locs);
+	return NULL;
+}
+
+/**
+ * async_start
+ * 
+ * Create the request queues and start the background I/O thread.
+ * 
+ * @param backend The addr2line backend handler.
+ */
+static void async_start(addr2line_t *backend)
+{
+	addr2line_async_t *async = malloc(sizeof(addr2line_async_t));
+	if (async == NULL) {
+		fprintf(stderr, "ERROR: async_start: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_cond_init(&async->requestsReady, NULL);
+	pthread_cond_init(&async->completionsReady, NULL);
+	async->requests = async->lastRequest = NULL;
+	async->completions = async->lastCompletion = NULL;
+	async->freeList = NULL;
+	async->numPending = 0;
+	async->shutdown = 0;
+	backend->async = async;
+
+	if (pthread_create(&async->thread, NULL, async_thread, backend) != 0) {
+		perror("pthread_create failed");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * async_stop
+ * 
+ * Deliver all the pending requests, then stop the background I/O thread and free the queues.
+ * 
+ * @param backend The addr2line backend handler.
+ */
+static void async_stop(addr2line_t *backend)
+{
+	addr2line_async_t *async = backend->async;
+
+	addr2line_drain(backend);
+
+	pthread_mutex_lock(&async->lock);
+	async->shutdown = 1;
+	pthread_cond_signal(&async->requestsReady);
+	pthread_mutex_unlock(&async->lock);
+	pthread_join(async->thread, NULL);
+
+	while (async->freeList != NULL) {
+		addr2line_request_t *next = async->freeList->next;
+		free(async->freeList);
+		async->freeList = next;
+	}
+	pthread_cond_destroy(&async->requestsReady);
+	pthread_cond_destroy(&async->completionsReady);
+	pthread_mutex_destroy(&async->lock);
+	free(async);
+	backend->async = NULL;
+}
+
+/**
+ * addr2line_translate_async
+ * 
+ * Queue a memory address to be translated by a background I/O thread, without waiting for the addr2line process.
+ * The translation is delivered to the callback from addr2line_poll or addr2line_drain, in the same order the 
+ * requests were queued. The synchronous calls can still be used while requests are pending: they are serialized
+ * with the I/O thread through the lock of the handler, so they wait for the batch being translated, if any.
+ * 
+ * @param backend  The handler of the running addr2line process
+ * @param address  The memory address to translate.
+ * @param callback Function that receives the translation.
+ * @param userdata Opaque argument passed to the callback.
+ */
+void addr2line_translate_async(addr2line_t *backend, void *address, addr2line_callback_t callback, void *userdata)
+{
+	if (backend->async == NULL) async_start(backend);
+	addr2line_async_t *async = backend->async;
+
+	pthread_mutex_lock(&async->lock);
+	addr2line_request_t *request = async->freeList;
+	if (request != NULL) async->freeList = request->next;
+	else if ((request = malloc(sizeof(addr2line_request_t))) == NULL) {
+		fprintf(stderr, "ERROR: addr2line_translate_async: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	request->address = address;
+	request->callback = callback;
+	request->userdata = userdata;
+	request->next = NULL;
+
+	if (async->lastRequest != NULL) async->lastRequest->next = request;
+	else async->requests = request;
+	async->lastRequest = request;
+	async->numPending ++;
+	pthread_cond_signal(&async->requestsReady);
+	pthread_mutex_unlock(&async->lock);
+}
+
+/**
+ * addr2line_poll
+ * 
+ * Deliver the translations completed so far to their callbacks, without waiting for the rest.
+ * Callbacks run in the calling thread.
+ * 
+ * @param backend The handler of the running addr2line process
+ * @return Number of translations delivered
+ */
+int addr2line_poll(addr2line_t *backend)
+{
+	addr2line_async_t *async = backend->async;
+	if (async == NULL) return 0;
+
+	// Detach all the completions at once, and deliver them out of the lock
+	pthread_mutex_lock(&async->lock);
+	addr2line_request_t *first = async->completions, *last = NULL;
+	async->completions = async->lastCompletion = NULL;
+	pthread_mutex_unlock(&async->lock);
+	if (first == NULL) return 0;
+
+	int delivered = 0;
+	for (addr2line_request_t *request = first; request != NULL; request = request->next)
+	{
+		request->callback(request->address, &request->code_loc, request->userdata);
+		last = request;
+		delivered ++;
+	}
+
+	// Recycle the delivered requests
+	pthread_mutex_lock(&async->lock);
+	last->next = async->freeList;
+	async->freeList = first;
+	async->numPending -= delivered;
+	if (async->numPending == 0) pthread_cond_broadcast(&async->completionsReady);
+	pthread_mutex_unlock(&async->lock);
+	return delivered;
+}
+
+/**
+ * addr2line_drain
+ * 
+ * Wait for all the queued translations and deliver them to their callbacks.
+ * 
+ * @param backend The handler of the running addr2line process
+ */
+void addr2line_drain(addr2line_t *backend)
+{
+	addr2line_async_t *async = backend->async;
+	if (async == NULL) return;
+
+	while (1)
+	{
+		addr2line_poll(backend);
+
+		pthread_mutex_lock(&async->lock);
+		while ((async->completions == NULL) && (async->numPending > 0)) {
+			pthread_cond_wait(&async->completionsReady, &async->lock);
+		}
+		int done = (async->numPending == 0);
+		pthread_mutex_unlock(&async->lock);
+		if (done) break;
+	}
+}
+
+/**
+ * addr2line_close
+ * 
+ * Close the addr2line backend and free all resources.
+ * 
+ * @param backend Pointer to the addr2line backend handler.
+ */
+void addr2line_close(addr2line_t *backend)
+{
+	if (backend->async != NULL) async_stop(backend);
+	stack_cache_free(backend->stackCache);
+	range_cache_free(backend->rangeCache);
+	if (backend->procMaps != NULL) maps_free(backend->procMaps);
+	free(backend->inputObject);
+	for (int i = 0; i < backend->numProcesses; ++i)	{
+		// Non-persistent processes are already closed after each translation
+		close_translator(&backend->processList[i]);
 	}
 	free(backend->processList);
+	for (int i = 0; i < backend->numAdaptive; ++i) {
+#if defined(HAVE_LIBSYMTAB)
+		symtab_free(backend->adaptiveList[i].symtab);
+#endif
+	}
+	free(backend->adaptiveList);
+	pthread_mutex_destroy(&backend->lock);
 	free(backend);
 }
+
+/**
+ * addr2line_multi_init
+ * 
+ * Create a translator for the addresses of many processes of the same job (e.g. MPI ranks). Each 
+ * process has its own maps file and address space layout, but addresses are normalized to (object, 
+ * offset) keys (see maps_normalize), so each distinct code location is translated once for all of them.
+ * 
+ * @param options Options for the addr2line handlers of the objects (OPTION_*).
+ * @return The multi-process translator.
+ */
+addr2line_multi_t *addr2line_multi_init(int options)
+{
+	addr2line_multi_t *multi = malloc(sizeof(addr2line_multi_t));
+	if (multi != NULL) multi->cache = calloc(MULTI_INITIAL_CAPACITY, sizeof(addr2line_multi_slot_t));
+	if ((multi == NULL) || (multi->cache == NULL)) {
+		fprintf(stderr, "ERROR: addr2line_multi_init: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	multi->setOptions = options;
+	multi->rankList = NULL;
+	multi->numRanks = multi->maxRanks = 0;
+	multi->objectList = NULL;
+	multi->numObjects = multi->maxObjects = 0;
+	multi->cacheCapacity = MULTI_INITIAL_CAPACITY;
+	multi->cacheUsed = 0;
+	multi->numLookups = multi->numTranslated = 0;
+	for (size_t i = 0; i < multi->cacheCapacity; ++i) multi->cache[i].object = -1;
+	return multi;
+}
+
+/**
+ * addr2line_multi_add_rank
+ * 
+ * Register the parsed maps of a process. The translator takes ownership of the maps, which are freed by addr2line_multi_close.
+ * 
+ * @param multi The multi-process translator.
+ * @param parsed_maps The parsed maps file of the process.
+ * @return Identifier of the process for addr2line_multi_translate.
+ */
+int addr2line_multi_add_rank(addr2line_multi_t *multi, maps_t *parsed_maps)
+{
+	if (multi->numRanks == multi->maxRanks)
+	{
+		multi->maxRanks = (multi->maxRanks > 0 ? multi->maxRanks * 2 : 16);
+		multi->rankList = realloc(multi->rankList, multi->maxRanks * sizeof(addr2line_multi_rank_t));
+		if (multi->rankList == NULL) {
+			fprintf(stderr, "ERROR: addr2line_multi_add_rank: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	addr2line_multi_rank_t *rank = &multi->rankList[multi->numRanks];
+	rank->procMaps = parsed_maps;
+	rank->numMappings = all_mappings_size(parsed_maps);
+	rank->objectOf = malloc((rank->numMappings > 0 ? rank->numMappings : 1) * sizeof(int));
+	if (rank->objectOf == NULL) {
+		fprintf(stderr, "ERROR: addr2line_multi_add_rank: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < rank->numMappings; ++i) rank->objectOf[i] = -1;
+	return multi->numRanks ++;
+}
+
+/**
+ * multi_find_object
+ * 
+ * Get the index of the object of a normalized key, registering the object the first time it is seen.
+ * The result is remembered per mapping of the rank, so that the objects are only compared once.
+ * 
+ * @param multi The multi-process translator.
+ * @param rank The process the key comes from.
+ * @param key The normalized address.
+ * @return Index of the object in the objects array.
+ */
+static int multi_find_object(addr2line_multi_t *multi, addr2line_multi_rank_t *rank, maps_key_t *key)
+{
+	int mapping = key->entry->index;
+	if ((mapping >= 0) && (mapping < rank->numMappings) && (rank->objectOf[mapping] >= 0)) return rank->objectOf[mapping];
+
+	int found = -1;
+	for (int i = 0; (i < multi->numObjects) && (found < 0); ++i) {
+		addr2line_multi_object_t *object = &multi->objectList[i];
+		if ((object->inode == key->inode) && (!strcmp(object->object, key->object))) found = i;
+	}
+	if (found < 0)
+	{
+		if (multi->numObjects == multi->maxObjects)
+		{
+			multi->maxObjects = (multi->maxObjects > 0 ? multi->maxObjects * 2 : 16);
+			multi->objectList = realloc(multi->objectList, multi->maxObjects * sizeof(addr2line_multi_object_t));
+			if (multi->objectList == NULL) {
+				fprintf(stderr, "ERROR: multi_find_object: Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		found = multi->numObjects ++;
+		multi->objectList[found].object = strdup(key->object);
+		multi->objectList[found].inode = key->inode;
+		multi->objectList[found].backend = NULL; // Deferred until the first cache miss
+	}
+	if ((mapping >= 0) && (mapping < rank->numMappings)) rank->objectOf[mapping] = found;
+	return found;
+}
+
+/**
+ * multi_hash
+ * 
+ * Hash an (object, offset) key.
+ */
+static size_t multi_hash(int object, unsigned long offset)
+{
+	uint64_t h = ((uint64_t)offset ^ ((uint64_t)object << 48)) * 0x9e3779b97f4a7c15ULL;
+	return (size_t)(h ^ (h >> 29));
+}
+
+/**
+ * multi_cache_grow
+ * 
+ * Double the capacity of the translation cache and rehash its slots.
+ */
+static void multi_cache_grow(addr2line_multi_t *multi)
+{
+	size_t old_capacity = multi->cacheCapacity;
+	addr2line_multi_slot_t *old_cache = multi->cache;
+
+	multi->cacheCapacity = old_capacity * 2;
+	multi->cache = malloc(multi->cacheCapacity * sizeof(addr2line_multi_slot_t));
+	if (multi->cache == NULL) {
+		fprintf(stderr, "ERROR: multi_cache_grow: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < multi->cacheCapacity; ++i) multi->cache[i].object = -1;
+
+	for (size_t i = 0; i < old_capacity; ++i)
+	{
+		if (old_cache[i].object < 0) continue;
+		size_t slot = multi_hash(old_cache[i].object, old_cache[i].offset) & (multi->cacheCapacity - 1);
+		while (multi->cache[slot].object >= 0) slot = (slot + 1) & (multi->cacheCapacity - 1);
+		multi->cache[slot] = old_cache[i];
+	}
+	free(old_cache);
+}
+
+/**
+ * copy_code_loc
+ * 
+ * Duplicate a translation, so that the caller owns its strings as with addr2line_translate.
+ */
+static void copy_code_loc(code_loc_t *dst, code_loc_t *src)
+{
+	*dst = *src;
+	dst->function = strdup(src->function);
+	dst->file = strdup(src->file);
+	dst->mapping_name = strdup(src->mapping_name);
+}
+
+/**
+ * addr2line_multi_translate
+ * 
+ * Translate an address of one of the registered processes. The address is normalized to its (object, offset)
+ * key, and only translated by the object's addr2line handler if no process asked for that key before. Addresses 
+ * out of any file-backed executable mapping are reported unresolved. The key offset is the virtual address in
+ * the object, which the handler translates directly. The adjusted address of the result is the address as
+ * given, as seen by that process.
+ * 
+ * @param multi The multi-process translator.
+ * @param rank Identifier of the process (see addr2line_multi_add_rank).
+ * @param address The memory address to translate, as seen by that process.
+ * @param code_loc The structure to store the translation results.
+ */
+void addr2line_multi_translate(addr2line_multi_t *multi, int rank, void *address, code_loc_t *code_loc)
+{
+	maps_key_t key;
+
+	multi->numLookups ++;
+	if ((rank < 0) || (rank >= multi->numRanks) || (maps_normalize(multi->rankList[rank].procMaps, (unsigned long)address, &key) < 0))
+	{
+		char address_str[32];
+		format_address(address_str, address);
+		char *unresolved = ((multi->setOptions & OPTION_KEEP_UNRESOLVED_ADDRESSES) ? address_str : UNKNOWN_ADDRESS);
+		code_loc->adjusted_address = address;
+		code_loc->function = strdup(unresolved);
+		code_loc->file = strdup(unresolved);
+		code_loc->mapping_name = strdup(UNKNOWN_MAPPING);
+		code_loc->line = code_loc->column = code_loc->translated = 0;
+		return;
+	}
+
+	int object = multi_find_object(multi, &multi->rankList[rank], &key);
+	size_t slot = multi_hash(object, key.offset) & (multi->cacheCapacity - 1);
+	while ((multi->cache[slot].object >= 0) && ((multi->cache[slot].object != object) || (multi->cache[slot].offset != key.offset))) {
+		slot = (slot + 1) & (multi->cacheCapacity - 1);
+	}
+
+	if (multi->cache[slot].object < 0)
+	{
+		// First time this code location is seen in any process
+		PROBE(libaddr2line, cache__miss, "multi", address);
+		addr2line_multi_object_t *entry = &multi->objectList[object];
+		if (entry->backend == NULL) entry->backend = addr2line_init_file(entry->object, multi->setOptions);
+		addr2line_translate(entry->backend, (void *)key.offset, &multi->cache[slot].code_loc);
+		multi->cache[slot].object = object;
+		multi->cache[slot].offset = key.offset;
+		multi->cacheUsed ++;
+		multi->numTranslated ++;
+
+		copy_code_loc(code_loc, &multi->cache[slot].code_loc);
+		code_loc->adjusted_address = address; // The cached one is the offset shared by all the processes
+		if (multi->cacheUsed * 4 > multi->cacheCapacity * 3) multi_cache_grow(multi);
+		return;
+	}
+	PROBE(libaddr2line, cache__hit, "multi", address);
+	copy_code_loc(code_loc, &multi->cache[slot].code_loc);
+	code_loc->adjusted_address = address;
+}
+
+/**
+ * addr2line_multi_close
+ * 
+ * Free the multi-process translator, with the maps of its processes, its cached translations and its addr2line handlers.
+ * 
+ * @param multi The multi-process translator.
+ */
+void addr2line_multi_close(addr2line_multi_t *multi)
+{
+	for (size_t i = 0; i < multi->cacheCapacity; ++i)
+	{
+		if (multi->cache[i].object < 0) continue;
+		free(multi->cache[i].code_loc.function);
+		free(multi->cache[i].code_loc.file);
+		free(multi->cache[i].code_loc.mapping_name);
+	}
+	free(multi->cache);
+	for (int i = 0; i < multi->numObjects; ++i)
+	{
+		if (multi->objectList[i].backend != NULL) addr2line_close(multi->objectList[i].backend);
+		free(multi->objectList[i].object);
+	}
+	free(multi->objectList);
+	for (int i = 0; i < multi->numRanks; ++i)
+	{
+		maps_free(multi->rankList[i].procMaps);
+		free(multi->rankList[i].objectOf);
+	}
+	free(multi->rankList);
+	free(multi);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <pthread.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
 #include "maps.h"
 
 #define UNKNOWN_ADDRESS "??"
@@ -9,6 +12,17 @@
 #define OPTION_CLEAR_PRELOAD             (1 << 0) // Clears LD_PRELOAD to prevent other libraries to be loaded when addr2line command is exec'd
 #define OPTION_KEEP_UNRESOLVED_ADDRESSES (1 << 1) // Keep the unresolved addresses in the output instead of "??"
 #define OPTION_NON_PERSISTENT            (1 << 2) // Do not keep the addr2line process running in the background
+#define OPTION_ADAPTIVE_BACKEND          (1 << 3) // Select the backend per mapping from the object properties and measured latency (same as LIBADDR2LINE_BACKEND=adaptive)
+#define OPTION_PRIVATE_TRANSLATORS       (1 << 4) // Do not share the addr2line processes with other handles through the process-wide registry
+#define OPTION_FUNCTIONS_ONLY            (1 << 5) // Resolve only function names in-process from the symbol tables, without any addr2line process (requires libsymtab, ignored with a warning otherwise)
+#define OPTION_LEARN_FUNCTIONS           (1 << 6) // Only function names are needed: addresses in the functions already translated are answered from their symbol extents, without file:line (requires libsymtab, ignored with a warning otherwise)
+
+#define MAX_BACKENDS 3 // Maximum number of addr2line backends that can be enabled at configure time
+
+// Granularity of the folded counts of addr2line_aggregate_t
+#define AGGREGATE_FUNCTIONS 0 // Per function name of the sampled (innermost) PC
+#define AGGREGATE_LINES     1 // Per file:line of the sampled (innermost) PC
+#define AGGREGATE_STACKS    2 // Per folded stack of function names "outer;...;inner" (the input of flame graphs)
 
 enum {
 	READ_END = 0,
@@ -26,15 +40,135 @@ typedef struct code_loc
 	int translated;
 } code_loc_t;
 
-typedef struct addr2line_process
+struct line_reader;
+
+typedef struct addr2line_child
 {
-	int parentWrite[2];        // Pipes for communication between parent and child processes
+	int parentWrite[2];            // Pipes for communication between parent and child processes
 	int childWrite[2];  
-	FILE *outputStream;        // File descriptor for reading addr2line output
+	struct line_reader *reader;    // Buffered reader for addr2line output (see pipe_io.h)
+	pid_t pid;                     // Process id of the addr2line command
+	int useBackend;                // Backend run by the child
+	int usesMapsFile;              // Flag to indicate if the object is a maps file (-M) rather than a binary (-e)
+	char *object;                  // Object given to the addr2line command
+	unsigned long objectDevice;    // Identity of the object (device, inode, size, modification time in nanoseconds) used as the registry key
+	unsigned long objectInode;
+	unsigned long objectSize;
+	long long objectMtime;
+	int refcount;                  // Number of addr2line processes, across all handles, sharing the child
+	int isShared;                  // Flag to indicate if the child is in the process-wide registry
+	pthread_mutex_t lock;          // Serializes the request/response exchanges of the handles sharing the child
+	struct addr2line_child *next;  // Next child in the registry
+} addr2line_child_t;
+
+typedef struct addr2line_process
+{
+	addr2line_child_t *child;  // Running addr2line command, possibly shared with other handles (NULL until the first translation)
 	maps_entry_t *execMapping; // Executable mapping associated with the addr2line process (only used when binutils is the backend and the input is a /proc/self/maps file)
-	int isForked;              // Flag to indicate if the process has been forked already (deferred until the first translation)
+	int useBackend;            // Backend run by this process (differs across processes in adaptive mode)
 } addr2line_process_t;
 
+typedef struct addr2line_adaptive
+{
+	maps_entry_t *execMapping;        // Executable mapping the selection applies to (NULL when the input is a binary)
+	int isClassified;                 // Flag to indicate if the object properties have been inspected (deferred until the first translation)
+	int selectedBackend;              // Backend chosen for the mapping, or -1 while the backends are still being probed
+	int numQueries[MAX_BACKENDS];     // Number of translations issued to each backend while probing
+	double elapsedTime[MAX_BACKENDS]; // Accumulated latency (in seconds) of the timed translations of each backend
+	symtab_t *symtab;                 // Function symbols, used instead of any backend for objects without debugging information
+} addr2line_adaptive_t;
+
+// Completion callback of addr2line_translate_async. The strings in code_loc belong to the callback, as with addr2line_translate
+typedef void (*addr2line_callback_t)(void *address, code_loc_t *code_loc, void *userdata);
+
+typedef struct addr2line_request
+{
+	void *address;                    // Address to translate
+	addr2line_callback_t callback;    // Function to deliver the translation to
+	void *userdata;                   // Opaque argument passed to the callback
+	code_loc_t code_loc;              // Translation result (filled by the I/O thread)
+	struct addr2line_request *next;
+} addr2line_request_t;
+
+typedef struct addr2line_async
+{
+	pthread_t thread;                 // Background I/O thread that drives the addr2line processes
+	pthread_mutex_t lock;             // Protects the queues and counters below
+	pthread_cond_t requestsReady;     // Signaled when requests are queued or on shutdown
+	pthread_cond_t completionsReady;  // Signaled when completions are available or all requests were delivered
+	addr2line_request_t *requests;    // Queue of requests waiting for the I/O thread (FIFO)
+	addr2line_request_t *lastRequest;
+	addr2line_request_t *completions; // Queue of translated requests waiting to be delivered (FIFO)
+	addr2line_request_t *lastCompletion;
+	addr2line_request_t *freeList;    // Delivered requests kept for reuse, so that enqueueing rarely allocates
+	int numPending;                   // Requests not yet delivered (queued, in flight or completed)
+	int shutdown;                     // Flag to stop the I/O thread
+} addr2line_async_t;
+
+typedef struct addr2line_queue
+{
+	addr2line_process_t *translator;  // addr2line process serving the queue
+	addr2line_process_t privateTranslator; // Extra process of the same command, when the handler has a single one to share
+	int isPrivate;                    // Flag to indicate if translator is privateTranslator (ended after the translation)
+	int *items;                       // Ranks (positions in the schedule order) of the addresses routed to the process, increasing
+	int numItems;
+	int next;                         // First item not taken yet
+	int busy;                         // Flag to indicate if a thread is serving the queue
+} addr2line_queue_t;
+
+typedef struct addr2line_range
+{
+	unsigned long start;              // Runtime address range of a function, from its ELF symbol [start, start + size)
+	unsigned long end;
+	unsigned long bias;               // Load bias of the object (subtracted to report the adjusted address)
+	char *function;                   // Function reported by the backend for the first address translated in the range
+	char *mappingName;                // Mapping reported with it
+} addr2line_range_t;
+
+typedef struct addr2line_range_object
+{
+	maps_entry_t *execMapping;        // Executable mapping of the object (NULL when the input is a binary)
+	symtab_t *symtab;                 // Function symbols of the object (NULL if they can not be read)
+} addr2line_range_object_t;
+
+typedef struct addr2line_range_cache
+{
+	addr2line_range_t *ranges;        // Learned function ranges, sorted by start and disjoint
+	int numRanges;
+	int maxRanges;
+	addr2line_range_object_t *objects; // Objects whose symbol tables were read to learn the ranges
+	int numObjects;
+	int maxObjects;
+	unsigned long numHits;            // Number of addresses answered from the ranges
+} addr2line_range_cache_t;
+
+typedef struct addr2line_frame
+{
+	void *address;                    // Address looked up (the PC of the innermost frame, the return address minus one for callers)
+	code_loc_t code_loc;              // Translation of the address
+	int next;                         // Next frame in the same bucket (-1 if last)
+} addr2line_frame_t;
+
+typedef struct addr2line_stack_node
+{
+	int parent;                       // Node of the calling frames (-1 for the outermost frame)
+	int frame;                        // Frame of this node
+	int next;                         // Next node in the same bucket (-1 if last)
+} addr2line_stack_node_t;
+
+typedef struct addr2line_stack_cache
+{
+	addr2line_frame_t *frames;        // Translated frames, hashed by address
+	int numFrames;
+	int maxFrames;
+	int *frameBuckets;                // Heads of the frame chains (-1 if empty), as many as maxFrames (power of 2)
+
+	addr2line_stack_node_t *nodes;    // Trie of the stacks from the outermost frame, hash-consed by (parent, frame)
+	int numNodes;
+	int maxNodes;
+	int *nodeBuckets;                 // Heads of the node chains (-1 if empty), as many as maxNodes (power of 2)
+} addr2line_stack_cache_t;
+
 typedef struct addr2line
 {
 	char *inputObject;                // Path to the input object (either a binary or a dump of the /proc/self/maps)
@@ -42,13 +176,124 @@ typedef struct addr2line
 	int setOptions;                   // Selected configuration options
 
 	maps_t *procMaps;                 // Parsed /proc/self/maps file (only used when the input is a /proc/self/maps file or a parsed maps object)
+	unsigned long mapsGeneration;     // Generation of procMaps the processes were set up for (see maps_refresh)
 
 	addr2line_process_t *processList; // Array of addr2line processes (> 1 when binutils is the backend and the input is a /proc/self/maps file, 1 otherwise)
 	int numProcesses;
+
+	addr2line_adaptive_t *adaptiveList; // Per-mapping backend selection (only used in adaptive mode, NULL otherwise)
+	int numAdaptive;
+	int lastAdaptive;                   // Selection state of the last translated address (checked first, as consecutive addresses tend to share the mapping)
+
+	pthread_mutex_t lock;             // Serializes the translations of the handler (synchronous calls and the asynchronous I/O thread)
+	addr2line_async_t *async;         // Asynchronous translation queues (created on the first addr2line_translate_async, NULL otherwise)
+
+	addr2line_stack_cache_t *stackCache; // Frames and stacks translated by addr2line_translate_stack (NULL until first used)
+	addr2line_range_cache_t *rangeCache; // Function ranges learned with OPTION_LEARN_FUNCTIONS (NULL until first learned)
 } addr2line_t;
 
+typedef struct addr2line_weighted
+{
+	unsigned long weight;             // Weight of the address (0 if none)
+	int index;                        // Index of the address in the input
+} addr2line_weighted_t;
+
+typedef struct addr2line_schedule
+{
+	addr2line_t *backend;             // Handler translating the addresses
+	void **addresses;                 // Addresses to translate
+	void **adjusted;                  // Addresses passed to the addr2line processes
+	unsigned long *weights;           // Weight of each address (NULL if none)
+	code_loc_t *code_locs;            // Translation of each address
+	char *done;                       // Flag per address set once translated
+	int *order;                       // Indices of the addresses by decreasing weight (the rank of an address is its position)
+	addr2line_queue_t *queues;        // One queue per addr2line process of the handler
+	int numQueues;
+	struct timespec deadline;         // Time (CLOCK_MONOTONIC) after which no more addresses are sent (tv_sec 0 if no budget)
+	int numTranslated;                // Number of addresses translated so far
+	pthread_mutex_t lock;             // Protects the queues and counters
+} addr2line_schedule_t;
+
+typedef struct addr2line_folded
+{
+	char *key;                        // Function name, file:line or folded stack
+	unsigned long weight;             // Accumulated weight of the samples
+} addr2line_folded_t;
+
+typedef struct addr2line_aggregate
+{
+	addr2line_t *backend;             // Handler translating the unique PCs
+	int mode;                         // AGGREGATE_FUNCTIONS, AGGREGATE_LINES or AGGREGATE_STACKS
+	addr2line_stack_cache_t *samples; // Unique PCs (translated by addr2line_aggregate_finish) and, for stacks, the trie of the sampled stacks
+	int numTranslated;                // Number of unique PCs already translated
+	unsigned long *weights;           // Weight accumulated by each unique PC, or by each stack node for AGGREGATE_STACKS
+	int maxWeights;
+	addr2line_folded_t *folded;       // Folded counts by decreasing weight (built by addr2line_aggregate_finish)
+	int numFolded;
+	unsigned long numSamples;         // Number of samples added
+} addr2line_aggregate_t;
+
+typedef struct addr2line_multi_object
+{
+	char *object;                     // Path to the object
+	int inode;                        // Inode of the object
+	addr2line_t *backend;             // Handler translating the object's relative addresses (created on first use)
+} addr2line_multi_object_t;
+
+typedef struct addr2line_multi_slot
+{
+	int object;                       // Index of the object in the objects array (-1 if the slot is empty)
+	unsigned long offset;             // Address relative to the object
+	code_loc_t code_loc;              // Cached translation
+} addr2line_multi_slot_t;
+
+typedef struct addr2line_multi_rank
+{
+	maps_t *procMaps;                 // Parsed maps file of the rank (owned)
+	int *objectOf;                    // Object index of each mapping of the rank (by entry index, -1 until resolved)
+	int numMappings;                  // Size of the objectOf array
+} addr2line_multi_rank_t;
+
+typedef struct addr2line_multi
+{
+	int setOptions;                   // Options for the per-object handlers
+
+	addr2line_multi_rank_t *rankList; // Processes whose addresses are translated (e.g. MPI ranks)
+	int numRanks;
+	int maxRanks;
+
+	addr2line_multi_object_t *objectList; // Distinct objects found across all the ranks
+	int numObjects;
+	int maxObjects;
+
+	addr2line_multi_slot_t *cache;    // Open-addressing hash table of translations keyed by (object, offset)
+	size_t cacheCapacity;             // Number of slots (power of 2)
+	size_t cacheUsed;                 // Number of occupied slots
+	unsigned long numLookups;         // Number of translations requested
+	unsigned long numTranslated;      // Number of translations actually resolved by the backends
+} addr2line_multi_t;
+
 // Function prototypes
 addr2line_t * addr2line_init_file(char *object, int options);
 addr2line_t * addr2line_init_maps(maps_t *parsed_maps, int options);
+addr2line_t * addr2line_init_self(int options);
 void addr2line_translate(addr2line_t *backend, void *address, code_loc_t *code_loc);
+void addr2line_translate_batch(addr2line_t *backend, void **addresses, int count, code_loc_t *code_locs);
+int addr2line_translate_scheduled(addr2line_t *backend, void **addresses, unsigned long *weights, int count, double budget, code_loc_t *code_locs);
+int addr2line_translate_stack(addr2line_t *backend, void **pcs, int depth, code_loc_t *frames);
+void addr2line_translate_async(addr2line_t *backend, void *address, addr2line_callback_t callback, void *userdata);
+int addr2line_poll(addr2line_t *backend);
+void addr2line_drain(addr2line_t *backend);
 void addr2line_close(addr2line_t *backend);
+
+addr2line_aggregate_t * addr2line_aggregate_init(addr2line_t *backend, int mode);
+void addr2line_aggregate_add(addr2line_aggregate_t *aggregate, void *address, unsigned long weight);
+void addr2line_aggregate_add_stack(addr2line_aggregate_t *aggregate, void **pcs, int depth, unsigned long weight);
+int addr2line_aggregate_finish(addr2line_aggregate_t *aggregate, addr2line_folded_t **folded);
+void addr2line_aggregate_write(addr2line_aggregate_t *aggregate, FILE *output);
+void addr2line_aggregate_free(addr2line_aggregate_t *aggregate);
+
+addr2line_multi_t * addr2line_multi_init(int options);
+int addr2line_multi_add_rank(addr2line_multi_t *multi, maps_t *parsed_maps);
+void addr2line_multi_translate(addr2line_multi_t *multi, int rank, void *address, code_loc_t *code_loc);
+void addr2line_multi_close(addr2line_multi_t *multi);
@@ -0,0 +1,305 @@
+#include <elf.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "addr2line.h"
+
+#define DEFAULT_CHUNK_SIZE (1024 * 1024) // Addresses read, translated and written at once (bounds the resident memory)
+#define MAX_THREADS        64
+
+#define FORMAT_TSV  0
+#define FORMAT_JSON 1
+
+typedef struct batch_worker
+{
+	pthread_t thread;
+	addr2line_t *backend;   // Private addr2line handle of the thread (sharing the parsed maps with the other threads)
+	void **addresses;       // Slice of the unique addresses of the chunk
+	code_loc_t *code_locs;  // Translations of the slice
+	int count;
+} batch_worker_t;
+
+/**
+ * usage
+ *
+ * Print the command line help.
+ */
+static void usage(char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <maps-file|binary> [address-file]\n"
+		"Translate the addresses read from address-file (or stdin) and print them in input order.\n"
+		"\n"
+		"Options:\n"
+		"  -b          Addresses are native 64-bit binary words instead of hexadecimal text lines\n"
+		"  -c <size>   Number of addresses processed at once (default %d)\n"
+		"  -j          Write JSON lines instead of tab-separated values\n"
+		"  -o <file>   Write the results to file instead of stdout\n"
+		"  -t <num>    Number of translation threads, each with its own addr2line processes (default 1)\n"
+		"  -a          Select the backend per mapping (adaptive mode)\n"
+		"  -F          Resolve function names only, from the symbol tables\n"
+		"  -k          Keep the unresolved addresses in the output instead of \"??\"\n"
+		"  -h          Show this help\n",
+		program, DEFAULT_CHUNK_SIZE);
+}
+
+/**
+ * is_elf_file
+ *
+ * Check if the object to translate against is a binary (ELF) rather than a maps file.
+ */
+static int is_elf_file(const char *path)
+{
+	unsigned char magic[SELFMAG];
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return 0;
+	size_t bytes = fread(magic, 1, SELFMAG, file);
+	fclose(file);
+	return ((bytes == SELFMAG) && (memcmp(magic, ELFMAG, SELFMAG) == 0));
+}
+
+/**
+ * read_chunk
+ *
+ * Read up to max_count addresses from the input stream. Text lines longer than the line buffer
+ * are parsed from their beginning and the rest of the line is discarded.
+ *
+ * @param input The input stream.
+ * @param binary Flag to indicate if addresses are binary words rather than text lines.
+ * @param addresses Array to store the addresses.
+ * @param max_count Capacity of the array.
+ * @param truncated Set to 1 if the binary input ends with a partial word.
+ * @return Number of addresses read (0 at the end of the input).
+ */
+static int read_chunk(FILE *input, int binary, void **addresses, int max_count, int *truncated)
+{
+	if (binary) {
+		// fread only returns short at the end of the input, so leftover bytes are a partial last word
+		size_t bytes = fread(addresses, 1, max_count * sizeof(void *), input);
+		if (bytes % sizeof(void *) != 0) *truncated = 1;
+		return bytes / sizeof(void *);
+	}
+
+	char line[BUFSIZ];
+	int count = 0;
+	while ((count < max_count) && (fgets(line, sizeof(line), input) != NULL))
+	{
+		if (strchr(line, '\n') == NULL) {
+			int c;
+			while (((c = fgetc(input)) != EOF) && (c != '\n'));
+		}
+		char *end = NULL;
+		errno = 0;
+		unsigned long value = strtoul(line, &end, 16);
+		if ((end == line) || (errno != 0)) continue; // Skip empty and malformed lines
+		addresses[count++] = (void *)value;
+	}
+	return count;
+}
+
+/**
+ * compare_addresses
+ *
+ * Order addresses numerically.
+ */
+static int compare_addresses(const void *a, const void *b)
+{
+	uintptr_t aa = (uintptr_t)(*(void * const *)a);
+	uintptr_t bb = (uintptr_t)(*(void * const *)b);
+	return (aa < bb ? -1 : (aa > bb ? 1 : 0));
+}
+
+/**
+ * find_unique
+ *
+ * Binary search of an address in the sorted array of unique addresses.
+ */
+static int find_unique(void **unique, int count, void *address)
+{
+	int low = 0, high = count - 1;
+	while (low <= high)
+	{
+		int mid = low + (high - low) / 2;
+		if (unique[mid] == address) return mid;
+		if ((uintptr_t)unique[mid] < (uintptr_t)address) low = mid + 1;
+		else high = mid - 1;
+	}
+	return -1;
+}
+
+/**
+ * worker_translate
+ *
+ * Body of the translation threads, each translates a contiguous slice of the sorted unique addresses.
+ * Sorting keeps the addresses of a mapping together, so each thread mostly talks to a few addr2line processes.
+ */
+static void *worker_translate(void *arg)
+{
+	batch_worker_t *worker = (batch_worker_t *)arg;
+	addr2line_translate_batch(worker->backend, worker->addresses, worker->count, worker->code_locs);
+	return NULL;
+}
+
+/**
+ * print_json_string
+ *
+ * Print a string as a JSON string literal.
+ */
+static void print_json_string(FILE *output, const char *str)
+{
+	fputc('"', output);
+	for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; ++c)
+	{
+		if ((*c == '"') || (*c == '\\')) fprintf(output, "\\%c", *c);
+		else if (*c < 0x20) fprintf(output, "\\u%04x", *c);
+		else fputc(*c, output);
+	}
+	fputc('"', output);
+}
+
+/**
+ * print_result
+ *
+ * Print the translation of an address in the selected format.
+ */
+static void print_result(FILE *output, int format, void *address, code_loc_t *code_loc)
+{
+	if (format == FORMAT_JSON)
+	{
+		fprintf(output, "{\"address\":\"%p\",\"function\":", address);
+		print_json_string(output, code_loc->function);
+		fprintf(output, ",\"file\":");
+		print_json_string(output, code_loc->file);
+		fprintf(output, ",\"line\":%d,\"column\":%d,\"mapping\":", code_loc->line, code_loc->column);
+		print_json_string(output, code_loc->mapping_name);
+		fprintf(output, ",\"translated\":%s}\n", (code_loc->translated ? "true" : "false"));
+	}
+	else
+	{
+		fprintf(output, "%p\t%s\t%s\t%d\t%d\t%s\n", address, code_loc->function, code_loc->file, code_loc->line, code_loc->column, code_loc->mapping_name);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int binary = 0, format = FORMAT_TSV, num_threads = 1, chunk_size = DEFAULT_CHUNK_SIZE;
+	int options = OPTION_PRIVATE_TRANSLATORS; // Each thread drives its own addr2line processes
+	char *output_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bc:jo:t:aFkh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': binary = 1; break;
+			case 'c': chunk_size = atoi(optarg); break;
+			case 'j': format = FORMAT_JSON; break;
+			case 'o': output_path = optarg; break;
+			case 't': num_threads = atoi(optarg); break;
+			case 'a': options |= OPTION_ADAPTIVE_BACKEND; break;
+			case 'F': options |= OPTION_FUNCTIONS_ONLY; break;
+			case 'k': options |= OPTION_KEEP_UNRESOLVED_ADDRESSES; break;
+			case 'h': usage(argv[0]); return EXIT_SUCCESS;
+			default: usage(argv[0]); return EXIT_FAILURE;
+		}
+	}
+	if ((optind >= argc) || (optind + 2 < argc) || (chunk_size <= 0) || (num_threads <= 0)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+
+	char *object = argv[optind];
+	FILE *input = stdin, *output = stdout;
+	if ((optind + 1 < argc) && ((input = fopen(argv[optind + 1], (binary ? "rb" : "r"))) == NULL)) {
+		perror(argv[optind + 1]);
+		return EXIT_FAILURE;
+	}
+	if ((output_path != NULL) && ((output = fopen(output_path, "w")) == NULL)) {
+		perror(output_path);
+		return EXIT_FAILURE;
+	}
+
+	void **addresses = malloc(chunk_size * sizeof(void *));
+	void **unique = malloc(chunk_size * sizeof(void *));
+	code_loc_t *code_locs = malloc(chunk_size * sizeof(code_loc_t));
+	batch_worker_t *workers = malloc(num_threads * sizeof(batch_worker_t));
+	if ((addresses == NULL) || (unique == NULL) || (code_locs == NULL) || (workers == NULL)) {
+		fprintf(stderr, "ERROR: %s: Out of memory\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// A maps file is parsed once and shared by the handles of all threads, along with the symbol tables in functions-only mode
+	maps_t *maps = NULL;
+	if (!is_elf_file(object))
+	{
+		maps = maps_parse_file(object, ((options & OPTION_FUNCTIONS_ONLY) ? OPTION_READ_FUNCTIONS | OPTION_DEMANGLE : 0));
+		if (maps == NULL) {
+			perror(object);
+			return EXIT_FAILURE;
+		}
+	}
+	for (int t = 0; t < num_threads; ++t) {
+		workers[t].backend = (maps != NULL ? addr2line_init_maps(maps_retain(maps), options) : addr2line_init_file(object, options));
+	}
+	maps_free(maps); // The handles hold their own references
+
+	int count = 0, truncated = 0;
+	while ((count = read_chunk(input, binary, addresses, chunk_size, &truncated)) > 0)
+	{
+		// Dedupe the addresses of the chunk, sorted so that the addresses of each mapping are adjacent
+		memcpy(unique, addresses, count * sizeof(void *));
+		qsort(unique, count, sizeof(void *), compare_addresses);
+		int num_unique = 0;
+		for (int i = 0; i < count; ++i) {
+			if ((num_unique == 0) || (unique[num_unique - 1] != unique[i])) unique[num_unique++] = unique[i];
+		}
+
+		// Fan out contiguous slices to the threads
+		int active = (num_unique < num_threads ? num_unique : num_threads);
+		for (int t = 0; t < active; ++t)
+		{
+			int first = (long)t * num_unique / active;
+			workers[t].addresses = &unique[first];
+			workers[t].code_locs = &code_locs[first];
+			workers[t].count = (long)(t + 1) * num_unique / active - first;
+			if (pthread_create(&workers[t].thread, NULL, worker_translate, &workers[t]) != 0) {
+				perror("pthread_create failed");
+				return EXIT_FAILURE;
+			}
+		}
+		for (int t = 0; t < active; ++t) {
+			pthread_join(workers[t].thread, NULL);
+		}
+
+		// Write the results in input order
+		for (int i = 0; i < count; ++i) {
+			print_result(output, format, addresses[i], &code_locs[find_unique(unique, num_unique, addresses[i])]);
+		}
+		for (int i = 0; i < num_unique; ++i) {
+			free(code_locs[i].function);
+			free(code_locs[i].file);
+			free(code_locs[i].mapping_name);
+		}
+	}
+
+	for (int t = 0; t < num_threads; ++t) {
+		addr2line_close(workers[t].backend);
+	}
+	free(addresses);
+	free(unique);
+	free(code_locs);
+	free(workers);
+	if (input != stdin) fclose(input);
+	if (output != stdout) fclose(output);
+	if (truncated) {
+		fprintf(stderr, "ERROR: %s: Input ends with a partial address (its size is not a multiple of %zu bytes)\n", argv[0], sizeof(void *));
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
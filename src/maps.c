@@ -1,8 +1,19 @@
+#define _GNU_SOURCE // dl_iterate_phdr()
+
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
 #include "config.h"
 #include "maps.h"
+#include "probes.h"
 
 #if defined(HAVE_LIBMAGIC)
 # include "magic.h"
@@ -10,77 +21,208 @@
 
 #define SKIP_SPECIAL_MAPPINGS // Define this to exclude special entries from the list of executable mappings (e.g., stack, heap, vdso, vvar, vsyscall, etc.) 
 
+#define INTERN_BUCKETS 4096 // Buckets of the table of interned pathnames
+#define OBJECT_BUCKETS 1024 // Buckets of the table of distinct objects in maps_parse_many
 
 /**
- * maps_parse_file
+ * Pathnames are interned process-wide, so that the entries of every mapping of an object, in every
+ * maps_t, share a single copy. Each string is reference counted and freed with its last entry.
+ */
+typedef struct interned_string {
+    struct interned_string *next; // Next string in the same bucket
+    int refcount;                 // Number of entries using the string
+    char str[];
+} interned_string_t;
+
+static interned_string_t *intern_table[INTERN_BUCKETS];
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * intern_hash
  * 
- * Parse the /proc/self/maps file and store the entries in a maps_t structure.
- * The list of mappings has two chainings: one for all mappings, and another 
- * one for mappings with execution permissions.
+ * FNV-1a hash of a string.
+ */
+static unsigned int intern_hash(const char *str)
+{
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; ++c) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * intern_string
  * 
- * @param maps_file Path to the /proc/self/maps file
- * @param main_binary Absolute path to the main binary (optional)
- * @param mapping_list Pointer to the maps_t structure to store the mappings
+ * Get the shared copy of a string, creating it if this is the first reference.
+ * Interned strings can be compared by pointer.
+ * 
+ * @param str The string to intern
+ * @return The shared copy, or NULL if out of memory
  */
-maps_t * maps_parse_file(char *maps_file, int options) {
-    int num_all_entries = 0, num_exec_entries = 0; 
-    maps_entry_t *head_all = NULL, *tail_all = NULL;
-    maps_entry_t *head_exec = NULL, *tail_exec = NULL;
+static char * intern_string(const char *str)
+{
+    unsigned int bucket = intern_hash(str) % INTERN_BUCKETS;
 
-    maps_t *mapping_list = (maps_t *)malloc(sizeof(maps_t));
-    if (mapping_list == NULL) {
-        return NULL;
+    pthread_mutex_lock(&intern_lock);
+    interned_string_t *node = intern_table[bucket];
+    while ((node != NULL) && (strcmp(node->str, str) != 0)) node = node->next;
+    if (node == NULL)
+    {
+        size_t len = strlen(str);
+        node = (interned_string_t *)malloc(sizeof(interned_string_t) + len + 1);
+        if (node != NULL) {
+            memcpy(node->str, str, len + 1);
+            node->refcount = 0;
+            node->next = intern_table[bucket];
+            intern_table[bucket] = node;
+        }
     }
-    mapping_list->path = strdup(maps_file);
-    
-    // Open the maps file
-    FILE *fd = fopen(maps_file, "r");
-    if (fd != NULL)
+    if (node != NULL) node->refcount ++;
+    pthread_mutex_unlock(&intern_lock);
+
+    return (node != NULL ? node->str : NULL);
+}
+
+/**
+ * release_string
+ * 
+ * Drop a reference on an interned string, and free it when it was the last one.
+ */
+static void release_string(char *str)
+{
+    if (str == NULL) return;
+
+    interned_string_t *node = (interned_string_t *)(str - offsetof(interned_string_t, str));
+    pthread_mutex_lock(&intern_lock);
+    if (-- node->refcount == 0)
     {
+        interned_string_t **link = &intern_table[intern_hash(str) % INTERN_BUCKETS];
+        while (*link != node) link = &(*link)->next;
+        *link = node->next;
+        free(node);
+    }
+    pthread_mutex_unlock(&intern_lock);
+}
+
+
+/**
+ * open_magic
+ * 
+ * Initialize libmagic and load its database, if available.
+ * 
+ * @return The libmagic cookie, or NULL if libmagic is not available
+ */
+static void * open_magic()
+{
+#if defined(HAVE_LIBMAGIC)
+    magic_t magic = magic_open(MAGIC_NONE);
+    if (magic != NULL) {
+        // Load the magic database
+        if (magic_load(magic, NULL) == 0) {
+            return magic;
+        }
+        magic_close(magic);
+    }
+#endif
+    return NULL;
+}
+
+/**
+ * close_magic
+ * 
+ * Release the libmagic cookie returned by open_magic.
+ */
+static void close_magic(void *magic)
+{
+#if defined(HAVE_LIBMAGIC)
+    if (magic != NULL) magic_close((magic_t)magic);
+#endif
+}
+
+/**
+ * classify_object
+ * 
+ * Get the type of an object based on the file type reported by libmagic.
+ * 
+ * @param magic The libmagic cookie returned by open_magic (OTHER_MAPPING is returned if NULL)
+ * @param pathname Path to the object
+ * @return The type of mapping of the object
+ */
+static mapping_type_t classify_object(void *magic, char *pathname)
+{
+    mapping_type_t mapping_type = OTHER_MAPPING;
 #if defined(HAVE_LIBMAGIC)
-        // Initialize libmagic
-        int magic_exists = 0;
-        magic_t magic = magic_open(MAGIC_NONE);
-        if (magic != NULL) {
-            // Load the magic database
-            if (magic_load(magic, NULL) == 0) {
-                magic_exists = 1;
+    if (magic != NULL)
+    {
+        // Get the file type from libmagic if available
+        const char *file_type = magic_file((magic_t)magic, pathname);
+        if (file_type != NULL) {
+            // Check if the mapping is an executable
+            if (strstr(file_type, "executable")) {
+                // Check if the executable is position-independent
+                if (!strstr(file_type, "pie executable")) {
+                    mapping_type = BINARY_PIE;
+                }
+                else mapping_type = BINARY_NONPIE;
+            }
+            else if (strstr(file_type, "shared object")) {
+                mapping_type = SHARED_LIBRARY;
             }
         }
+    }
 #endif
+    return mapping_type;
+}
+
+/**
+ * classify_entry
+ * 
+ * Set the type of the mapping based on the file type reported by libmagic.
+ * 
+ * @param magic The libmagic cookie returned by open_magic (the entry is left as OTHER_MAPPING if NULL)
+ * @param entry The entry to classify
+ */
+static void classify_entry(void *magic, maps_entry_t *entry)
+{
+    entry->mapping_type = classify_object(magic, entry->pathname);
+}
+
+/**
+ * read_entries
+ * 
+ * Read the lines of a maps file into a list of entries chained through next_all.
+ * The entries are not classified, nor linked into the list of executable mappings.
+ * 
+ * @param maps_file Path to the /proc/self/maps file
+ * @return The head of the list, or NULL if the file could not be read or is empty
+ */
+static maps_entry_t * read_entries(char *maps_file)
+{
+    maps_entry_t *head_all = NULL, *tail_all = NULL;
+
+    // Open the maps file
+    FILE *fd = fopen(maps_file, "r");
+    if (fd != NULL)
+    {
         char line[BUFSIZ];
+        char pathname[4096];
         while (fgets(line, sizeof(line), fd) != NULL)
         {
             maps_entry_t *entry = (maps_entry_t *)malloc(sizeof(maps_entry_t));
             if (entry != NULL)
             {             
-                entry->index = num_all_entries;
                 entry->mapping_type = OTHER_MAPPING;
+                entry->symtab = NULL;
+                entry->index_pinned = 0;
+                entry->jit = NULL;
+                entry->refcount = 1;
+                pathname[0] = '\0';
 
                 // Parse the line and store the values in the entry structure
-                int ret = sscanf(line, "%lx-%lx %4s %lx %x:%x %d %4095[^\n]", &entry->start, &entry->end, entry->perms, &entry->offset, &entry->dev_major, &entry->dev_minor, &entry->inode, entry->pathname);
-                if (ret >= 7)
+                int ret = sscanf(line, "%lx-%lx %4s %lx %x:%x %d %4095[^\n]", &entry->start, &entry->end, entry->perms, &entry->offset, &entry->dev_major, &entry->dev_minor, &entry->inode, pathname);
+                if ((ret >= 7) && ((entry->pathname = intern_string(pathname)) != NULL))
                 {
-#if defined(HAVE_LIBMAGIC)
-                    if (magic_exists)
-                    {
-                        // Get the file type from libmagic if available
-                        const char *file_type = magic_file(magic, entry->pathname);
-                        if (file_type != NULL) {
-                            // Check if the mapping is an executable
-                            if (strstr(file_type, "executable")) {
-                                // Check if the executable is position-independent
-                                if (!strstr(file_type, "pie executable")) {
-                                    entry->mapping_type = BINARY_PIE;
-                                }
-                                else entry->mapping_type = BINARY_NONPIE;
-                            }
-                            else if (strstr(file_type, "shared object")) {
-                                entry->mapping_type = SHARED_LIBRARY;
-                            }
-                        }
-                    }
-#endif
                     entry->next_all = NULL;
                     entry->next_exec = NULL;
                     // Append the entry to the list of all mappings
@@ -94,27 +236,6 @@ maps_t * maps_parse_file(char *maps_file, int options) {
                         tail_all->next_all = entry;
                         tail_all = entry;
                     }
-                    if (entry->perms[2] == 'x')
-                    {
-#if defined(SKIP_SPECIAL_MAPPINGS)
-                        if ((strlen(entry->pathname) > 0) && (entry->pathname[0] != '['))
-#endif
-                        {
-                            // Append the entry to the list of executable mappings
-                            if (head_exec == NULL)
-                            {
-                                head_exec = entry;
-                                tail_exec = entry;
-                            }
-                            else
-                            {
-                                tail_exec->next_exec = entry;
-                                tail_exec = entry;
-                            }
-                            num_exec_entries++;
-                        }
-                    }
-                    num_all_entries++;
                 }
                 else
                 {
@@ -122,80 +243,2116 @@ maps_t * maps_parse_file(char *maps_file, int options) {
                 }
             }
         }
-        // Clean up
-#if defined(HAVE_LIBMAGIC)
-        if (magic_exists) magic_close(magic);
-#endif
         fclose(fd);
     }
+    return head_all;
+}
+
+/**
+ * link_entries
+ * 
+ * Store the given list of entries in the maps_t structure, renumbering them and
+ * rebuilding the chaining of the mappings with execution permissions.
+ * 
+ * @param mapping_list Pointer to the maps_t structure
+ * @param head_all Head of the list of all entries (chained through next_all)
+ */
+static void link_entries(maps_t *mapping_list, maps_entry_t *head_all)
+{
+    int num_all_entries = 0, num_exec_entries = 0; 
+    maps_entry_t *head_exec = NULL, *tail_exec = NULL;
+
+    for (maps_entry_t *entry = head_all; entry != NULL; entry = entry->next_all)
+    {
+        entry->index = num_all_entries;
+        entry->next_exec = NULL;
+        if (entry->perms[2] == 'x')
+        {
+#if defined(SKIP_SPECIAL_MAPPINGS)
+            if ((strlen(entry->pathname) > 0) && (entry->pathname[0] != '['))
+#endif
+            {
+                // Append the entry to the list of executable mappings
+                if (head_exec == NULL)
+                {
+                    head_exec = entry;
+                    tail_exec = entry;
+                }
+                else
+                {
+                    tail_exec->next_exec = entry;
+                    tail_exec = entry;
+                }
+                num_exec_entries++;
+            }
+        }
+        num_all_entries++;
+    }
 
     // Store the lists in the maps_t structure
     mapping_list->all_entries = head_all;
     mapping_list->num_all_entries = num_all_entries;
     mapping_list->exec_entries = head_exec;
     mapping_list->num_exec_entries = num_exec_entries;
+}
 
-    // Read the symbol tables for all mappings if requested
-    maps_entry_t *entry = mapping_list->all_entries;
-    while (entry != NULL) {
-        entry->symtab = NULL;
+/**
+ * read_object_symtab
+ * 
+ * Read the symbol table of an object if requested in the options, keeping the function symbols
+ * with OPTION_READ_FUNCTIONS and the data objects otherwise.
+ * 
+ * @param pathname Path to the object
+ * @param options Configuration options
+ * @return The symbol table, or NULL if not requested or not available
+ */
+static symtab_t * read_object_symtab(char *pathname, int options)
+{
+#if defined(HAVE_LIBSYMTAB)
+    if (options & (OPTION_READ_SYMTAB | OPTION_DATA_INDEX | OPTION_READ_FUNCTIONS)) {
+        int filter = ((options & OPTION_READ_FUNCTIONS) ? SYMTAB_FUNCTIONS : SYMTAB_DATA_OBJECTS);
+        if (options & OPTION_DEMANGLE) filter |= SYMTAB_DEMANGLE_LAZY;
+        return symtab_read_filtered(pathname, filter);
+    }
+#endif
+    return NULL;
+}
+
+/**
+ * load_entry_symtab
+ * 
+ * Read the symbol table of the given mapping if requested in the options.
+ */
+static void load_entry_symtab(maps_entry_t *entry, int options)
+{
+    entry->symtab = read_object_symtab(entry->pathname, options);
+}
 
+/**
+ * free_entry
+ * 
+ * Free a single entry, its symbol table and its reference on the pathname.
+ */
+static void free_entry(maps_entry_t *entry)
+{
 #if defined(HAVE_LIBSYMTAB)
-        if (options & OPTION_READ_SYMTAB) {
-            entry->symtab = symtab_read(entry->pathname);
-        }
+    if (entry->index_pinned) symtab_unpin(entry->symtab);
+    symtab_free(entry->symtab);
 #endif
-        entry = entry->next_all;
+    release_string(entry->pathname);
+    free(entry);
+}
+
+/**
+ * compare_jit_symbols
+ * 
+ * Order JIT symbols by start address, then in the order they were read.
+ */
+static int compare_jit_symbols(const void *a, const void *b)
+{
+    const maps_jit_symbol_t *sym_a = (const maps_jit_symbol_t *)a;
+    const maps_jit_symbol_t *sym_b = (const maps_jit_symbol_t *)b;
+
+    if (sym_a->start != sym_b->start) return (sym_a->start < sym_b->start ? -1 : 1);
+    if (sym_a->serial != sym_b->serial) return (sym_a->serial < sym_b->serial ? -1 : 1);
+    return 0;
+}
+
+/**
+ * jit_append
+ * 
+ * Add a symbol at the end of the JIT index, unsorted (see index_jit_symbols).
+ * 
+ * @return 0 on success, -1 if out of memory
+ */
+static int jit_append(maps_jit_t *jit, unsigned long start, unsigned long size, const char *name)
+{
+    if (jit->num_symbols == jit->max_symbols)
+    {
+        int max_symbols = (jit->max_symbols == 0 ? 1024 : jit->max_symbols * 2);
+        maps_jit_symbol_t *symbols = (maps_jit_symbol_t *)realloc(jit->symbols, max_symbols * sizeof(maps_jit_symbol_t));
+        if (symbols == NULL) return -1;
+        jit->symbols = symbols;
+        jit->max_symbols = max_symbols;
     }
 
-    return mapping_list;
+    maps_jit_symbol_t *symbol = &jit->symbols[jit->num_symbols];
+    if ((symbol->name = strdup(name)) == NULL) return -1;
+    symbol->start = start;
+    symbol->end = start + size;
+    symbol->serial = jit->num_symbols;
+    jit->num_symbols ++;
+    return 0;
 }
 
 /**
- * maps_free
+ * index_jit_symbols
  * 
- * Free the memory used by the maps_t structure.
+ * Restore the order of the JIT index after appending symbols, and extend the running maximum end address.
+ * Compilers mostly generate code at increasing addresses, so the whole index is only sorted again when 
+ * the new symbols are out of order.
  * 
- * @param mapping_list Pointer to the maps_t structure to free
+ * @param jit The JIT index
+ * @param first_new Index of the first symbol appended since the last call
  */
-void maps_free(maps_t *mapping_list) 
+static void index_jit_symbols(maps_jit_t *jit, int first_new)
 {
-    if (mapping_list != NULL) 
+    for (int i = (first_new > 0 ? first_new : 1); i < jit->num_symbols; ++i) 
     {
-        maps_entry_t *entry = mapping_list->all_entries;
-        while (entry != NULL)
-        {
-            maps_entry_t *next = entry->next_all;
-#if defined(HAVE_LIBSYMTAB)
-            symtab_free(entry->symtab);
-#endif
-            free(entry);
-            entry = next;
+        if (compare_jit_symbols(&jit->symbols[i - 1], &jit->symbols[i]) > 0) {
+            qsort(jit->symbols, jit->num_symbols, sizeof(maps_jit_symbol_t), compare_jit_symbols);
+            first_new = 0;
+            break;
         }
-        free(mapping_list);
+    }
+
+    unsigned long max_end = (first_new > 0 ? jit->symbols[first_new - 1].max_end : 0);
+    for (int i = first_new; i < jit->num_symbols; ++i) {
+        if (jit->symbols[i].end > max_end) max_end = jit->symbols[i].end;
+        jit->symbols[i].max_end = max_end;
     }
 }
 
 /**
- * maps_find_by_address
+ * read_perf_map
  * 
- * Find the entry in the list of mappings that contains the specified address.
+ * Read the complete lines of a perf map past the consumed bytes. A line that is still being written
+ * (without its newline) is left for the next read.
  * 
- * @param mapping_list Pointer to the list of mappings
- * @param address Address to search for
- * @return Pointer to the entry that contains the address, or NULL if not found
+ * @return Number of symbols read, or -1 if out of memory
  */
-maps_entry_t * maps_find_by_address(maps_entry_t *mapping_list, unsigned long address, int search_filter)
+static int read_perf_map(maps_jit_t *jit, FILE *fd)
 {
-    maps_entry_t *entry = mapping_list;
-    while (entry != NULL)
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len = 0;
+    int added = 0;
+
+    while ((len = getline(&line, &capacity, fd)) > 0)
     {
-        if ((address >= entry->start) && (address < entry->end))
+        if (line[len - 1] != '\n') break;
+        jit->consumed += len;
+        line[len - 1] = '\0';
+
+        char *size_str = NULL, *name = NULL;
+        unsigned long start = strtoul(line, &size_str, 16);
+        unsigned long size = strtoul(size_str, &name, 16);
+        if ((size_str == line) || (name == size_str) || (size == 0)) continue; // Skip malformed lines
+        while ((*name == ' ') || (*name == '\t')) name ++;
+
+        if (jit_append(jit, start, size, name) < 0) {
+            added = -1;
+            break;
+        }
+        added ++;
+    }
+    free(line);
+    return added;
+}
+
+/**
+ * read_jitdump
+ * 
+ * Read the complete records of a jitdump file past the consumed bytes, keeping the code load records.
+ * A record that is still being written is left for the next read.
+ * 
+ * @return Number of symbols read, or -1 if the file is not a jitdump in the native byte order or out of memory
+ */
+static int read_jitdump(maps_jit_t *jit, FILE *fd)
+{
+    struct {
+        uint32_t magic, version, total_size, elf_mach, pad1, pid;
+        uint64_t timestamp, flags;
+    } header;
+    struct {
+        uint32_t id, total_size;
+        uint64_t timestamp;
+    } record;
+    struct {
+        uint32_t pid, tid;
+        uint64_t vma, code_addr, code_size, code_index;
+    } code_load;
+    char *body = NULL;
+    size_t capacity = 0;
+    int added = 0;
+
+    if (jit->consumed == 0)
+    {
+        if (fread(&header, sizeof(header), 1, fd) != 1) return 0;
+        if ((header.magic != JITDUMP_MAGIC) || (header.total_size < sizeof(header))) return -1;
+        jit->consumed = header.total_size;
+        if (fseek(fd, jit->consumed, SEEK_SET) != 0) return 0;
+    }
+
+    while ((fread(&record, sizeof(record), 1, fd) == 1) && (record.total_size >= sizeof(record)))
+    {
+        size_t body_size = record.total_size - sizeof(record);
+        if (body_size > capacity)
         {
-            return entry;
+            char *grown = (char *)realloc(body, body_size);
+            if (grown == NULL) {
+                added = -1;
+                break;
+            }
+            body = grown;
+            capacity = body_size;
+        }
+        if ((body_size > 0) && (fread(body, body_size, 1, fd) != 1)) break;
+        jit->consumed += record.total_size;
+
+        if (record.id == JITDUMP_CODE_CLOSE) break;
+        if ((record.id == JITDUMP_CODE_LOAD) && (body_size > sizeof(code_load)))
+        {
+            // The name follows the fixed fields, then the code itself
+            memcpy(&code_load, body, sizeof(code_load));
+            char *name = body + sizeof(code_load);
+            if ((memchr(name, '\0', body_size - sizeof(code_load)) == NULL) || (code_load.code_size == 0)) continue;
+            if (jit_append(jit, code_load.code_addr, code_load.code_size, name) < 0) {
+                added = -1;
+                break;
+            }
+            added ++;
         }
-        entry = (search_filter == SEARCH_EXEC) ? entry->next_exec : entry->next_all;
     }
-    return NULL;
+    free(body);
+    return added;
+}
+
+/**
+ * read_jit
+ * 
+ * Read the symbols appended to the file of the JIT index since the last read (jit->lock must be held
+ * once the index is shared).
+ * 
+ * @return Number of new symbols, or -1 on error
+ */
+static int read_jit(maps_jit_t *jit)
+{
+    struct stat file_stat;
+    if (stat(jit->path, &file_stat) == 0) {
+        // Nothing was appended, or only the same partial line or record as in the last read
+        if (file_stat.st_size <= jit->consumed) return 0;
+        if ((file_stat.st_size == jit->size) && (file_stat.st_mtim.tv_sec == jit->mtime.tv_sec) &&
+            (file_stat.st_mtim.tv_nsec == jit->mtime.tv_nsec)) return 0;
+        jit->size = file_stat.st_size;
+        jit->mtime = file_stat.st_mtim;
+    }
+
+    FILE *fd = fopen(jit->path, "rb");
+    if (fd == NULL) return -1;
+
+    int first_new = jit->num_symbols, added = 0;
+    if (fseek(fd, jit->consumed, SEEK_SET) == 0) {
+        added = (jit->format == JIT_FORMAT_JITDUMP ? read_jitdump(jit, fd) : read_perf_map(jit, fd));
+    }
+    fclose(fd);
+
+    if (jit->num_symbols > first_new) index_jit_symbols(jit, first_new);
+    return added;
+}
+
+/**
+ * free_jit
+ * 
+ * Free a JIT index and its symbols.
+ */
+static void free_jit(maps_jit_t *jit)
+{
+    if (jit == NULL) return;
+    for (int i = 0; i < jit->num_symbols; ++i) {
+        free(jit->symbols[i].name);
+    }
+    free(jit->symbols);
+    free(jit->path);
+    pthread_mutex_destroy(&jit->lock);
+    free(jit);
+}
+
+/**
+ * attach_jit
+ * 
+ * Point the anonymous executable mappings to the JIT index of the process.
+ */
+static void attach_jit(maps_t *mapping_list)
+{
+    for (maps_entry_t *entry = mapping_list->all_entries; entry != NULL; entry = entry->next_all) {
+        entry->jit = (mapping_is_anonymous_code(entry) ? mapping_list->jit : NULL);
+    }
 }
 
+/**
+ * load_process_jit
+ * 
+ * Load the perf map of the process the maps file belongs to (/proc/self/maps or /proc/<pid>/maps),
+ * if its JIT compilers wrote one. Other maps files do not tell the process they come from.
+ */
+static void load_process_jit(maps_t *mapping_list)
+{
+    char perf_map[64];
+    int pid = 0;
+
+    if (!strcmp(mapping_list->path, "/proc/self/maps")) pid = getpid();
+    else if (sscanf(mapping_list->path, "/proc/%d/maps", &pid) != 1) pid = 0;
+    if (pid <= 0) return;
+
+    snprintf(perf_map, sizeof(perf_map), "/tmp/perf-%d.map", pid);
+    if (access(perf_map, R_OK) == 0) maps_load_jit(mapping_list, perf_map);
+}
+
+/**
+ * maps_load_jit
+ * 
+ * Load the symbols of the JIT-compiled code of the process from a perf map or jitdump file (the format
+ * is detected from the jitdump magic), and attach the index to the anonymous executable mappings, where
+ * that code lives. Replaces the index loaded before, if any, which must not be in use. 
+ * 
+ * @param mapping_list Pointer to the maps_t structure of the process that wrote the file
+ * @param path Path to the perf map (/tmp/perf-<pid>.map) or jitdump (jit-<pid>.dump) file
+ * @return Number of symbols read, or -1 if the file could not be read or out of memory
+ */
+int maps_load_jit(maps_t *mapping_list, char *path)
+{
+    if ((mapping_list == NULL) || (path == NULL)) return -1;
+
+    FILE *fd = fopen(path, "rb");
+    if (fd == NULL) return -1;
+    uint32_t magic = 0;
+    int format = (((fread(&magic, sizeof(magic), 1, fd) == 1) && (magic == JITDUMP_MAGIC)) ? JIT_FORMAT_JITDUMP : JIT_FORMAT_PERF_MAP);
+    fclose(fd);
+
+    maps_jit_t *jit = (maps_jit_t *)malloc(sizeof(maps_jit_t));
+    if (jit == NULL) return -1;
+    jit->path = strdup(path);
+    jit->format = format;
+    jit->consumed = jit->size = 0;
+    jit->mtime.tv_sec = jit->mtime.tv_nsec = 0;
+    jit->last_check.tv_sec = jit->last_check.tv_nsec = 0;
+    jit->symbols = NULL;
+    jit->num_symbols = jit->max_symbols = 0;
+    pthread_mutex_init(&jit->lock, NULL);
+    if ((jit->path == NULL) || (read_jit(jit) < 0)) {
+        free_jit(jit);
+        return -1;
+    }
+
+    free_jit(mapping_list->jit);
+    mapping_list->jit = jit;
+    attach_jit(mapping_list);
+    return jit->num_symbols;
+}
+
+/**
+ * maps_jit_refresh
+ * 
+ * Read the symbols appended to the perf map or jitdump file since it was last read.
+ * Lookups through maps_resolve_jit already do this when they miss.
+ * 
+ * @param mapping_list Pointer to the maps_t structure
+ * @return Number of new symbols, or -1 on error
+ */
+int maps_jit_refresh(maps_t *mapping_list)
+{
+    if ((mapping_list == NULL) || (mapping_list->jit == NULL)) return 0;
+
+    pthread_mutex_lock(&mapping_list->jit->lock);
+    int added = read_jit(mapping_list->jit);
+    pthread_mutex_unlock(&mapping_list->jit->lock);
+    return added;
+}
+
+/**
+ * find_jit_symbol
+ * 
+ * Find the JIT symbol that contains the given address (jit->lock must be held). When code was 
+ * generated again over a range, the innermost and latest symbol wins.
+ */
+static maps_jit_symbol_t * find_jit_symbol(maps_jit_t *jit, unsigned long address)
+{
+    int low = 0, high = jit->num_symbols - 1, found = -1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        if (jit->symbols[mid].start <= address) {
+            found = mid;
+            low = mid + 1;
+        }
+        else high = mid - 1;
+    }
+
+    for (int i = found; (i >= 0) && (jit->symbols[i].max_end > address); --i) {
+        if (address < jit->symbols[i].end) return &jit->symbols[i];
+    }
+    return NULL;
+}
+
+/**
+ * maps_resolve_jit
+ * 
+ * Find the JIT-compiled function that contains the given absolute address. If the address is not
+ * in the index yet, the entries appended to the file since the last read are loaded and the lookup
+ * is retried, so that long runs see the code generated after the index was loaded. The file is checked
+ * at most once every JIT_CHECK_INTERVAL_NS, and only read again when its size or modification time
+ * changed, so that many unresolved addresses do not put file I/O on the lookup path.
+ * 
+ * @param mapping_list Pointer to the maps_t structure (see maps_load_jit)
+ * @param address Absolute address to resolve
+ * @param offset Optional output for the offset of the address within the function
+ * @return Name of the function (owned by the index, valid until maps_free), or NULL if not found
+ */
+const char * maps_resolve_jit(maps_t *mapping_list, unsigned long address, unsigned long *offset)
+{
+    if ((mapping_list == NULL) || (mapping_list->jit == NULL)) return NULL;
+
+    maps_jit_t *jit = mapping_list->jit;
+    const char *name = NULL;
+
+    pthread_mutex_lock(&jit->lock);
+    maps_jit_symbol_t *symbol = find_jit_symbol(jit, address);
+    if (symbol == NULL)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - jit->last_check.tv_sec) * 1000000000L + (now.tv_nsec - jit->last_check.tv_nsec);
+        if ((jit->last_check.tv_sec == 0) || (elapsed >= JIT_CHECK_INTERVAL_NS))
+        {
+            jit->last_check = now;
+            if (read_jit(jit) > 0) symbol = find_jit_symbol(jit, address);
+        }
+    }
+    if (symbol != NULL)
+    {
+        name = symbol->name;
+        if (offset != NULL) *offset = address - symbol->start;
+    }
+    pthread_mutex_unlock(&jit->lock);
+    return name;
+}
+
+/**
+ * load_symtabs
+ * 
+ * Read the symbol tables of all the entries of a new maps_t structure, and merge them into the data index, as requested in the options.
+ */
+static void load_symtabs(maps_t *mapping_list, int options)
+{
+    // Read the symbol tables for all mappings if requested, once per object (its mappings are consecutive)
+    maps_entry_t *entry = mapping_list->all_entries;
+#if defined(HAVE_LIBSYMTAB)
+    maps_entry_t *previous = NULL;
+#endif
+    while (entry != NULL) {
+#if defined(HAVE_LIBSYMTAB)
+        if ((previous != NULL) && (previous->symtab != NULL) && (previous->pathname == entry->pathname) && (previous->inode == entry->inode)) {
+            entry->symtab = symtab_retain(previous->symtab);
+        }
+        else load_entry_symtab(entry, options);
+        previous = entry;
+#else
+        load_entry_symtab(entry, options);
+#endif
+        entry = entry->next_all;
+    }
+
+    // Merge the symbol tables into a single index if requested
+    if (options & OPTION_DATA_INDEX) {
+        maps_build_data_index(mapping_list);
+    }
+}
+
+/**
+ * maps_parse_file
+ * 
+ * Parse the /proc/self/maps file and store the entries in a maps_t structure.
+ * The list of mappings has two chainings: one for all mappings, and another 
+ * one for mappings with execution permissions.
+ * 
+ * @param maps_file Path to the /proc/self/maps file
+ * @param options Configuration options (OPTION_READ_SYMTAB, OPTION_READ_FUNCTIONS, OPTION_DATA_INDEX)
+ * @return Pointer to the maps_t structure with the mappings, or NULL if out of memory
+ */
+maps_t * maps_parse_file(char *maps_file, int options) {
+    maps_t *mapping_list = (maps_t *)malloc(sizeof(maps_t));
+    if (mapping_list == NULL) {
+        return NULL;
+    }
+    mapping_list->path = strdup(maps_file);
+    mapping_list->options = options;
+    mapping_list->refcount = 1;
+    mapping_list->generation = 0;
+    mapping_list->retired_entries = NULL;
+    mapping_list->data_index = NULL;
+    mapping_list->num_data_symbols = 0;
+    mapping_list->jit = NULL;
+    mapping_list->from_self = 0;
+
+    // Parse and classify all entries
+    PROBE(libmaps, maps__parse__start, maps_file);
+    maps_entry_t *head_all = read_entries(maps_file);
+    void *magic = open_magic();
+    for (maps_entry_t *entry = head_all; entry != NULL; entry = entry->next_all) {
+        classify_entry(magic, entry);
+    }
+    close_magic(magic);
+
+    link_entries(mapping_list, head_all);
+    if (options & OPTION_READ_JIT) load_process_jit(mapping_list);
+    load_symtabs(mapping_list, options);
+
+    PROBE(libmaps, maps__parse__end, maps_file, mapping_list->num_all_entries);
+    return mapping_list;
+}
+
+/**
+ * Objects reported by the dynamic loader while building the entries of maps_from_self.
+ */
+typedef struct self_scan {
+    maps_entry_t **entries;       // Entries of the loadable segments of all objects, unsorted
+    int num_entries;
+    int max_entries;
+    int num_objects;              // Number of objects visited (the first one is the executable)
+    long page_size;
+    unsigned long long dl_adds;   // Counters of objects loaded and unloaded by the loader (0 if not reported)
+    unsigned long long dl_subs;
+} self_scan_t;
+
+/**
+ * compare_entries_by_address
+ * 
+ * Order entries by start address, as in the maps files.
+ */
+static int compare_entries_by_address(const void *a, const void *b)
+{
+    const maps_entry_t *entry_a = *(maps_entry_t * const *)a;
+    const maps_entry_t *entry_b = *(maps_entry_t * const *)b;
+    return (entry_a->start < entry_b->start ? -1 : (entry_a->start > entry_b->start ? 1 : 0));
+}
+
+/**
+ * collect_self_entries
+ * 
+ * dl_iterate_phdr callback that adds an entry per loadable segment of the object. The entries are
+ * set up so that the maps_t arithmetic is exact: the offset of each entry is the virtual address of
+ * the object at the start of the mapping (rather than the file offset), so start - offset is the
+ * load bias of the object, and absolute_to_relative() yields the object's own addresses, even for
+ * segments whose virtual addresses and file offsets differ.
+ */
+static int collect_self_entries(struct dl_phdr_info *info, size_t size, void *data)
+{
+    self_scan_t *scan = (self_scan_t *)data;
+    char path[4096];
+    int is_executable = (scan->num_objects ++ == 0);
+
+    if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+        scan->dl_adds = info->dlpi_adds;
+        scan->dl_subs = info->dlpi_subs;
+    }
+
+    // The executable has no name, and objects without a file (the vDSO) are named as in the maps files
+    if (is_executable) {
+        ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (len <= 0) return 0;
+        path[len] = '\0';
+    }
+    else if ((info->dlpi_name == NULL) || (info->dlpi_name[0] == '\0')) return 0;
+    else if (realpath(info->dlpi_name, path) == NULL) snprintf(path, sizeof(path), "[%s]", (strstr(info->dlpi_name, "vdso") != NULL ? "vdso" : info->dlpi_name));
+
+    struct stat object_stat;
+    int has_file = (path[0] != '[') && (stat(path, &object_stat) == 0);
+
+    for (int i = 0; i < info->dlpi_phnum; ++i)
+    {
+        const ElfW(Phdr) *segment = &info->dlpi_phdr[i];
+        if ((segment->p_type != PT_LOAD) || (segment->p_memsz == 0)) continue;
+
+        if (scan->num_entries == scan->max_entries)
+        {
+            int max_entries = (scan->max_entries == 0 ? 64 : scan->max_entries * 2);
+            maps_entry_t **entries = (maps_entry_t **)realloc(scan->entries, max_entries * sizeof(maps_entry_t *));
+            if (entries == NULL) break;
+            scan->entries = entries;
+            scan->max_entries = max_entries;
+        }
+        maps_entry_t *entry = (maps_entry_t *)malloc(sizeof(maps_entry_t));
+        if (entry == NULL) break;
+        if ((entry->pathname = intern_string(path)) == NULL) {
+            free(entry);
+            break;
+        }
+
+        unsigned long start = info->dlpi_addr + segment->p_vaddr;
+        unsigned long end = start + segment->p_memsz;
+        entry->start = start & ~(scan->page_size - 1);
+        entry->end = (end + scan->page_size - 1) & ~(scan->page_size - 1);
+        entry->offset = entry->start - info->dlpi_addr;
+        entry->perms[0] = ((segment->p_flags & PF_R) ? 'r' : '-');
+        entry->perms[1] = ((segment->p_flags & PF_W) ? 'w' : '-');
+        entry->perms[2] = ((segment->p_flags & PF_X) ? 'x' : '-');
+        entry->perms[3] = 'p';
+        entry->perms[4] = '\0';
+        entry->dev_major = (has_file ? (int)major(object_stat.st_dev) : 0);
+        entry->dev_minor = (has_file ? (int)minor(object_stat.st_dev) : 0);
+        entry->inode = (has_file ? (int)object_stat.st_ino : 0);
+        entry->mapping_type = (!has_file ? OTHER_MAPPING : (!is_executable ? SHARED_LIBRARY : (info->dlpi_addr == 0 ? BINARY_NONPIE : BINARY_PIE)));
+        entry->symtab = NULL;
+        entry->index_pinned = 0;
+        entry->jit = NULL;
+        entry->refcount = 1;
+        entry->next_all = entry->next_exec = NULL;
+        scan->entries[scan->num_entries ++] = entry;
+    }
+    return 0;
+}
+
+/**
+ * read_self_entries
+ * 
+ * Build the entries of the running process from the loadable segments of the objects reported by the
+ * dynamic loader, sorted by address and chained through next_all. The loader counters are saved in the
+ * maps_t structure, to detect later whether any object was loaded or unloaded.
+ * 
+ * @param mapping_list Pointer to the maps_t structure
+ * @return The head of the list, or NULL if out of memory
+ */
+static maps_entry_t * read_self_entries(maps_t *mapping_list)
+{
+    self_scan_t scan;
+    scan.entries = NULL;
+    scan.num_entries = scan.max_entries = scan.num_objects = 0;
+    scan.page_size = sysconf(_SC_PAGESIZE);
+    scan.dl_adds = scan.dl_subs = 0;
+    dl_iterate_phdr(collect_self_entries, &scan);
+
+    qsort(scan.entries, scan.num_entries, sizeof(maps_entry_t *), compare_entries_by_address);
+    for (int i = 0; i < scan.num_entries; ++i) {
+        scan.entries[i]->next_all = (i + 1 < scan.num_entries ? scan.entries[i + 1] : NULL);
+    }
+    maps_entry_t *head_all = (scan.num_entries > 0 ? scan.entries[0] : NULL);
+    free(scan.entries);
+
+    mapping_list->dl_adds = scan.dl_adds;
+    mapping_list->dl_subs = scan.dl_subs;
+    return head_all;
+}
+
+/**
+ * read_self_counters
+ * 
+ * dl_iterate_phdr callback that only reads the loader counters, stopping at the first object.
+ */
+static int read_self_counters(struct dl_phdr_info *info, size_t size, void *data)
+{
+    unsigned long long *counters = (unsigned long long *)data;
+    if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+        counters[0] = info->dlpi_adds;
+        counters[1] = info->dlpi_subs;
+    }
+    return 1;
+}
+
+/**
+ * self_changed
+ * 
+ * Check if the dynamic loader loaded or unloaded any object since the entries were built. 
+ * Loaders that do not report the counters are always assumed to have changed.
+ */
+static int self_changed(maps_t *mapping_list)
+{
+    unsigned long long counters[2] = { 0, 0 };
+    dl_iterate_phdr(read_self_counters, counters);
+    return ((counters[0] == 0) || (counters[0] != mapping_list->dl_adds) || (counters[1] != mapping_list->dl_subs));
+}
+
+/**
+ * maps_from_self
+ * 
+ * Build the maps_t structure of the running process from the objects reported by the dynamic loader
+ * (dl_iterate_phdr), instead of parsing /proc/self/maps. There is no text to parse and no need for 
+ * libmagic, as the loader gives the exact load bias and loadable segments of each object. There is one
+ * entry per loadable segment, whose offset is the virtual address of the object at the start of the
+ * entry (see collect_self_entries), so that addresses are adjusted exactly. maps_refresh() first checks
+ * the loader counters of loaded and unloaded objects, so it only costs a full scan after a dlopen or dlclose.
+ * 
+ * Anonymous mappings are not listed, as the loader does not know about them. The .bss of each object is
+ * part of its last loadable segment, so the data index still covers it, but there are no anonymous 
+ * executable mappings to attach the JIT code index to, and OPTION_READ_JIT is ignored with a warning 
+ * (use maps_parse_file on /proc/self/maps for processes with JIT-compiled code).
+ * 
+ * @param options Configuration options (OPTION_READ_SYMTAB, OPTION_READ_FUNCTIONS, OPTION_DATA_INDEX)
+ * @return Pointer to the maps_t structure with the mappings, or NULL if out of memory
+ */
+maps_t * maps_from_self(int options)
+{
+    if (options & OPTION_READ_JIT) {
+        fprintf(stderr, "WARNING: maps_from_self: OPTION_READ_JIT is not supported without anonymous mappings, use maps_parse_file to resolve JIT-compiled code\n");
+        options &= ~OPTION_READ_JIT;
+    }
+    maps_t *mapping_list = (maps_t *)malloc(sizeof(maps_t));
+    if (mapping_list == NULL) {
+        return NULL;
+    }
+    // The backends that read the maps file themselves run in a child process, where /proc/self is not this process
+    char maps_file[64];
+    snprintf(maps_file, sizeof(maps_file), "/proc/%d/maps", (int)getpid());
+    mapping_list->path = strdup(maps_file);
+    mapping_list->options = options;
+    mapping_list->refcount = 1;
+    mapping_list->generation = 0;
+    mapping_list->retired_entries = NULL;
+    mapping_list->data_index = NULL;
+    mapping_list->num_data_symbols = 0;
+    mapping_list->jit = NULL;
+    mapping_list->from_self = 1;
+
+    PROBE(libmaps, maps__parse__start, mapping_list->path);
+    link_entries(mapping_list, read_self_entries(mapping_list));
+    load_symtabs(mapping_list, options);
+
+    PROBE(libmaps, maps__parse__end, mapping_list->path, mapping_list->num_all_entries);
+    return mapping_list;
+}
+
+/**
+ * Shared state of the threads of maps_parse_many. Each pass hands out items (files, objects or
+ * maps) to the threads through the atomic counter next_item.
+ */
+typedef struct parse_object {
+    char *pathname;               // Interned path (compared by pointer)
+    int inode;
+    int dev_major;
+    int dev_minor;
+    mapping_type_t mapping_type;  // Classification shared by all the entries of the object
+    symtab_t *symtab;             // Symbol table shared by all the entries of the object
+    int next;                     // Next object in the same bucket (-1 if last)
+} parse_object_t;
+
+typedef struct parse_pool {
+    char **maps_files;            // Files to parse
+    maps_t **maps;                // Parsed files
+    int count;                    // Number of files
+    int options;                  // Options of maps_parse_many
+    parse_object_t *objects;      // Distinct objects across all the files
+    int num_objects;
+    int buckets[OBJECT_BUCKETS];  // Hash table of the distinct objects by pathname and inode (-1 if empty)
+    int num_items;                // Number of items of the current pass
+    int next_item;                // Next item to hand out (atomic)
+} parse_pool_t;
+
+/**
+ * pool_next_item
+ * 
+ * Take the next item of the current pass.
+ * 
+ * @return The index of the item, or -1 when all of them have been taken
+ */
+static int pool_next_item(parse_pool_t *pool)
+{
+    int item = __atomic_fetch_add(&pool->next_item, 1, __ATOMIC_RELAXED);
+    return (item < pool->num_items ? item : -1);
+}
+
+/**
+ * pool_run
+ * 
+ * Run a pass over num_items items on the given number of threads, and wait for it to finish.
+ * The calling thread takes part in the pass.
+ */
+static void pool_run(parse_pool_t *pool, int num_items, int num_threads, void *(*body)(void *))
+{
+    pthread_t threads[num_threads > 1 ? num_threads - 1 : 1];
+    int started = 0;
+
+    pool->num_items = num_items;
+    pool->next_item = 0;
+    for (int t = 0; t < num_threads - 1; ++t) {
+        if (pthread_create(&threads[started], NULL, body, pool) == 0) started ++;
+    }
+    body(pool);
+    for (int t = 0; t < started; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+/**
+ * parse_files_body
+ * 
+ * First pass of maps_parse_many: read the entries of each file.
+ */
+static void * parse_files_body(void *arg)
+{
+    parse_pool_t *pool = (parse_pool_t *)arg;
+    int i;
+    while ((i = pool_next_item(pool)) >= 0)
+    {
+        maps_t *mapping_list = (maps_t *)malloc(sizeof(maps_t));
+        if (mapping_list != NULL)
+        {
+            mapping_list->path = strdup(pool->maps_files[i]);
+            mapping_list->options = pool->options;
+            mapping_list->refcount = 1;
+            mapping_list->generation = 0;
+            mapping_list->retired_entries = NULL;
+            mapping_list->data_index = NULL;
+            mapping_list->num_data_symbols = 0;
+            mapping_list->jit = NULL;
+            mapping_list->from_self = 0;
+            link_entries(mapping_list, read_entries(pool->maps_files[i]));
+            if (pool->options & OPTION_READ_JIT) load_process_jit(mapping_list);
+        }
+        pool->maps[i] = mapping_list;
+    }
+    return NULL;
+}
+
+/**
+ * load_objects_body
+ * 
+ * Second pass of maps_parse_many: classify each distinct object and read its symbol table.
+ */
+static void * load_objects_body(void *arg)
+{
+    parse_pool_t *pool = (parse_pool_t *)arg;
+    void *magic = NULL;
+    int i;
+    while ((i = pool_next_item(pool)) >= 0)
+    {
+        parse_object_t *object = &pool->objects[i];
+        if (magic == NULL) magic = open_magic(); // One libmagic cookie per thread, as they can not be shared
+        object->mapping_type = classify_object(magic, object->pathname);
+        object->symtab = read_object_symtab(object->pathname, pool->options);
+    }
+    close_magic(magic);
+    return NULL;
+}
+
+/**
+ * build_indexes_body
+ * 
+ * Last pass of maps_parse_many: merge the symbol tables of each file into its data index.
+ */
+static void * build_indexes_body(void *arg)
+{
+    parse_pool_t *pool = (parse_pool_t *)arg;
+    int i;
+    while ((i = pool_next_item(pool)) >= 0) {
+        if (pool->maps[i] != NULL) maps_build_data_index(pool->maps[i]);
+    }
+    return NULL;
+}
+
+/**
+ * find_object
+ * 
+ * Get the distinct object of an entry, adding it to the pool the first time it is seen.
+ * 
+ * @return Index of the object, or -1 if out of memory
+ */
+static int find_object(parse_pool_t *pool, maps_entry_t *entry, int *max_objects)
+{
+    // Interned pathnames are hashed and compared by pointer
+    int bucket = (((uintptr_t)entry->pathname >> 4) ^ (unsigned int)entry->inode) % OBJECT_BUCKETS;
+    for (int i = pool->buckets[bucket]; i >= 0; i = pool->objects[i].next)
+    {
+        parse_object_t *object = &pool->objects[i];
+        if ((object->pathname == entry->pathname) && (object->inode == entry->inode) && 
+            (object->dev_major == entry->dev_major) && (object->dev_minor == entry->dev_minor)) return i;
+    }
+    if (pool->num_objects == *max_objects)
+    {
+        int capacity = (*max_objects > 0 ? *max_objects * 2 : 64);
+        parse_object_t *objects = (parse_object_t *)realloc(pool->objects, capacity * sizeof(parse_object_t));
+        if (objects == NULL) return -1;
+        pool->objects = objects;
+        *max_objects = capacity;
+    }
+    parse_object_t *object = &pool->objects[pool->num_objects];
+    object->pathname = entry->pathname;
+    object->inode = entry->inode;
+    object->dev_major = entry->dev_major;
+    object->dev_minor = entry->dev_minor;
+    object->next = pool->buckets[bucket];
+    pool->buckets[bucket] = pool->num_objects;
+    return pool->num_objects ++;
+}
+
+/**
+ * maps_parse_many
+ * 
+ * Parse many maps files at once (e.g. one per rank of a parallel job) on a pool of threads.
+ * The files are read in parallel, then each distinct object (same pathname, inode and device) is
+ * classified and gets its symbol table read only once, in parallel, and shared by all the entries 
+ * of all the files that map it. The pathnames are interned across all the files. The cost thus 
+ * grows with the number of distinct objects rather than with the number of files times objects.
+ * One thread per online processor is used.
+ * 
+ * @param maps_files Paths to the maps files
+ * @param count Number of files
+ * @param options Configuration options (OPTION_READ_SYMTAB, OPTION_READ_FUNCTIONS, OPTION_DATA_INDEX)
+ * @return Array of count maps_t structures in the order of the files (NULL for those out of memory), 
+ *         to be freed with maps_free and free(), or NULL if out of memory
+ */
+maps_t ** maps_parse_many(char **maps_files, int count, int options)
+{
+    if (count <= 0) return NULL;
+
+    parse_pool_t pool;
+    pool.maps_files = maps_files;
+    pool.count = count;
+    pool.options = options;
+    pool.objects = NULL;
+    pool.num_objects = 0;
+    for (int i = 0; i < OBJECT_BUCKETS; ++i) pool.buckets[i] = -1;
+    pool.maps = (maps_t **)calloc(count, sizeof(maps_t *));
+    if (pool.maps == NULL) return NULL;
+
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > count) num_threads = count;
+    if (num_threads < 1) num_threads = 1;
+
+    // Read all the files
+    pool_run(&pool, count, num_threads, parse_files_body);
+
+    // Collect the distinct objects, remembering the object of each file-backed entry
+    int max_objects = 0, num_entries = 0;
+    for (int i = 0; i < count; ++i) {
+        if (pool.maps[i] != NULL) num_entries += pool.maps[i]->num_all_entries;
+    }
+    int *object_of = (int *)malloc((num_entries > 0 ? num_entries : 1) * sizeof(int));
+    if (object_of == NULL) num_entries = 0;
+
+    int k = 0;
+    for (int i = 0; (i < count) && (object_of != NULL); ++i)
+    {
+        if (pool.maps[i] == NULL) continue;
+        for (maps_entry_t *entry = pool.maps[i]->all_entries; entry != NULL; entry = entry->next_all) {
+            object_of[k++] = (((entry->pathname[0] == '\0') || (entry->pathname[0] == '[')) ? -1 : find_object(&pool, entry, &max_objects));
+        }
+    }
+
+    // Load each distinct object once
+    pool_run(&pool, pool.num_objects, (num_threads < pool.num_objects ? num_threads : (pool.num_objects > 0 ? pool.num_objects : 1)), load_objects_body);
+
+    // Share the results with all the entries
+    k = 0;
+    for (int i = 0; (i < count) && (object_of != NULL); ++i)
+    {
+        if (pool.maps[i] == NULL) continue;
+        for (maps_entry_t *entry = pool.maps[i]->all_entries; entry != NULL; entry = entry->next_all, ++k) 
+        {
+            if (object_of[k] < 0) continue;
+            entry->mapping_type = pool.objects[object_of[k]].mapping_type;
+#if defined(HAVE_LIBSYMTAB)
+            entry->symtab = symtab_retain(pool.objects[object_of[k]].symtab);
+#endif
+        }
+    }
+#if defined(HAVE_LIBSYMTAB)
+    for (int i = 0; i < pool.num_objects; ++i) symtab_free(pool.objects[i].symtab);
+#endif
+    free(object_of);
+    free(pool.objects);
+
+    // Merge the symbol tables into a single index per file if requested
+    if (options & OPTION_DATA_INDEX) {
+        pool_run(&pool, count, num_threads, build_indexes_body);
+    }
+    return pool.maps;
+}
+
+/**
+ * same_entry
+ * 
+ * Check if two entries describe the same mapping of the same object.
+ */
+static int same_entry(maps_entry_t *a, maps_entry_t *b)
+{
+    return ((a->start == b->start) && (a->end == b->end) && (a->offset == b->offset) && 
+            (a->inode == b->inode) && (a->dev_major == b->dev_major) && (a->dev_minor == b->dev_minor) &&
+            (!strcmp(a->perms, b->perms)) && (!strcmp(a->pathname, b->pathname)));
+}
+
+/**
+ * retire_entry
+ * 
+ * Move an entry to the list of retired entries, releasing its symbol table.
+ */
+static void retire_entry(maps_t *mapping_list, maps_entry_t *entry)
+{
+#if defined(HAVE_LIBSYMTAB)
+    if (entry->index_pinned) symtab_unpin(entry->symtab);
+    symtab_free(entry->symtab);
+#endif
+    entry->index_pinned = 0;
+    entry->symtab = NULL;
+    entry->next_exec = NULL;
+    entry->next_all = mapping_list->retired_entries;
+    mapping_list->retired_entries = entry;
+}
+
+/**
+ * maps_refresh
+ * 
+ * Re-read the maps file and update the maps_t structure in place, e.g. after dlopen/dlclose.
+ * Both lists are sorted by address, so a single merge pass finds the unchanged entries, which 
+ * are kept together with their symbol tables. Only the new entries are classified with libmagic
+ * and get their symbol table read. Entries that are gone are moved to the list of retired entries,
+ * which stay valid until maps_release_retired() or maps_free(), so that handles holding pointers to them 
+ * can detect the change by comparing the generation counter and release them at their own pace.
+ * 
+ * @param mapping_list Pointer to the maps_t structure to refresh
+ * @return Number of entries added plus retired (0 if nothing changed), or -1 if the file could not be read
+ */
+int maps_refresh(maps_t *mapping_list)
+{
+    int changes = 0;
+
+    if (mapping_list == NULL) return -1;
+
+    // Maps built from the loader only need to be scanned again if an object was loaded or unloaded
+    maps_entry_t *fresh = NULL;
+    if (mapping_list->from_self) {
+        if (!self_changed(mapping_list)) return 0;
+        fresh = read_self_entries(mapping_list);
+    }
+    else fresh = read_entries(mapping_list->path);
+    if (fresh == NULL) return -1;
+
+    maps_entry_t *current = mapping_list->all_entries;
+    maps_entry_t *head_all = NULL, *tail_all = NULL;
+    void *magic = NULL;
+
+    while (fresh != NULL)
+    {
+        // Retire the current entries that lie before the next fresh one, or that conflict with it
+        while ((current != NULL) && ((current->start < fresh->start) || ((current->start == fresh->start) && (!same_entry(current, fresh)))))
+        {
+            maps_entry_t *next = current->next_all;
+            retire_entry(mapping_list, current);
+            changes ++;
+            current = next;
+        }
+
+        maps_entry_t *entry = NULL;
+        maps_entry_t *next_fresh = fresh->next_all;
+        if ((current != NULL) && (same_entry(current, fresh)))
+        {
+            // Unchanged mapping, keep the existing entry
+            entry = current;
+            current = current->next_all;
+            free_entry(fresh);
+        }
+        else
+        {
+            // New mapping (those from the loader are already classified)
+            if (!mapping_list->from_self) {
+                if (magic == NULL) magic = open_magic();
+                classify_entry(magic, fresh);
+            }
+            load_entry_symtab(fresh, mapping_list->options);
+            entry = fresh;
+            changes ++;
+        }
+        fresh = next_fresh;
+
+        entry->next_all = NULL;
+        if (head_all == NULL) head_all = entry;
+        else tail_all->next_all = entry;
+        tail_all = entry;
+    }
+    close_magic(magic);
+
+    // Retire the remaining entries past the last fresh one
+    while (current != NULL)
+    {
+        maps_entry_t *next = current->next_all;
+        retire_entry(mapping_list, current);
+        changes ++;
+        current = next;
+    }
+
+    if (changes > 0)
+    {
+        link_entries(mapping_list, head_all);
+        mapping_list->generation ++;
+
+        // New anonymous code mappings share the JIT index, which may only appear once the compilers start
+        if ((mapping_list->jit == NULL) && (mapping_list->options & OPTION_READ_JIT)) load_process_jit(mapping_list);
+        attach_jit(mapping_list);
+        if (mapping_list->options & OPTION_DATA_INDEX) {
+            maps_build_data_index(mapping_list);
+        }
+    }
+    return changes;
+}
+
+/**
+ * maps_release_retired
+ * 
+ * Free the entries retired by maps_refresh(). Call it once every user of the maps_t structure has 
+ * followed the last refresh and dropped its pointers to the entries that are gone, so that processes
+ * refreshing after every dlopen/dlclose run in bounded memory. Handles created with addr2line_init_maps
+ * own their maps and call it themselves after following a refresh.
+ * 
+ * @param mapping_list Pointer to the maps_t structure
+ */
+void maps_release_retired(maps_t *mapping_list)
+{
+    if (mapping_list == NULL) return;
+
+    maps_entry_t *entry = mapping_list->retired_entries;
+    while (entry != NULL)
+    {
+        maps_entry_t *next = entry->next_all;
+        free_entry(entry);
+        entry = next;
+    }
+    mapping_list->retired_entries = NULL;
+}
+
+/**
+ * maps_retain
+ * 
+ * Take an additional reference on a maps_t structure shared by several owners (e.g. one addr2line 
+ * handle per thread translating against the same maps). Each reference is released with maps_free.
+ * The owners may use the maps concurrently, but not while one of them refreshes them.
+ * 
+ * @param mapping_list Pointer to the maps_t structure to share
+ * @return The same maps_t structure
+ */
+maps_t * maps_retain(maps_t *mapping_list)
+{
+    if (mapping_list != NULL) __atomic_add_fetch(&mapping_list->refcount, 1, __ATOMIC_RELAXED);
+    return mapping_list;
+}
+
+/**
+ * maps_free
+ * 
+ * Release a reference on the maps_t structure, and free it when it was the last one.
+ * 
+ * @param mapping_list Pointer to the maps_t structure to free
+ */
+void maps_free(maps_t *mapping_list) 
+{
+    if ((mapping_list != NULL) && (__atomic_sub_fetch(&mapping_list->refcount, 1, __ATOMIC_ACQ_REL) == 0)) 
+    {
+        maps_entry_t *entry = mapping_list->all_entries;
+        while (entry != NULL)
+        {
+            maps_entry_t *next = entry->next_all;
+            free_entry(entry);
+            entry = next;
+        }
+        maps_release_retired(mapping_list);
+        free(mapping_list->path);
+        free(mapping_list->data_index);
+        free_jit(mapping_list->jit);
+        free(mapping_list);
+    }
+}
+
+/**
+ * maps_find_by_address
+ * 
+ * Find the entry in the list of mappings that contains the specified address.
+ * 
+ * @param mapping_list Pointer to the list of mappings
+ * @param address Address to search for
+ * @return Pointer to the entry that contains the address, or NULL if not found
+ */
+maps_entry_t * maps_find_by_address(maps_entry_t *mapping_list, unsigned long address, int search_filter)
+{
+    maps_entry_t *entry = mapping_list;
+    while (entry != NULL)
+    {
+        if ((address >= entry->start) && (address < entry->end))
+        {
+            return entry;
+        }
+        entry = (search_filter == SEARCH_EXEC) ? entry->next_exec : entry->next_all;
+    }
+    return NULL;
+}
+
+/**
+ * maps_normalize
+ * 
+ * Map an absolute code address to a key that does not depend on the address space layout: the identity 
+ * of the object and the address relative to it. The relative address is the virtual address in the object
+ * (the absolute address minus the load bias, see maps_load_bias), which the addr2line backends expect when
+ * given the object itself, also for linkers whose segments' virtual addresses differ from their file offsets.
+ * Objects at a fixed base address are not relocated, and keep the absolute address.
+ * 
+ * @param mapping_list Pointer to the maps_t structure
+ * @param address Absolute address to normalize
+ * @param key Output for the key
+ * @return 0 on success, or -1 if the address is not in a file-backed executable mapping
+ */
+int maps_normalize(maps_t *mapping_list, unsigned long address, maps_key_t *key)
+{
+    maps_entry_t *entry = (mapping_list != NULL ? search_in_exec_mappings(mapping_list, address) : NULL);
+    if ((entry == NULL) || (entry->pathname[0] == '\0') || (entry->pathname[0] == '[')) return -1;
+
+    key->object = entry->pathname;
+    key->inode = entry->inode;
+    key->offset = address - maps_load_bias(mapping_list, entry);
+    key->entry = entry;
+    return 0;
+}
+
+/**
+ * compare_symbols
+ * 
+ * Comparison function to sort the data index by absolute start address.
+ */
+static int compare_symbols(const void *a, const void *b)
+{
+    const maps_symbol_t *sym_a = (const maps_symbol_t *)a;
+    const maps_symbol_t *sym_b = (const maps_symbol_t *)b;
+
+    if (sym_a->start != sym_b->start) return (sym_a->start < sym_b->start ? -1 : 1);
+    if (sym_a->end != sym_b->end) return (sym_a->end < sym_b->end ? -1 : 1);
+    return 0;
+}
+
+/**
+ * maps_load_bias
+ * 
+ * Compute the load bias of the object behind the given mapping, i.e. the value to add to the symbol
+ * addresses of the object to obtain runtime addresses. The first mapping of an object is at offset zero
+ * and its address is the bias itself, except for -no-pie executables whose symbols are already absolute.
+ * Note that the bias does not match (start - offset) for the data segments, so absolute_to_relative() 
+ * is only reliable for the code segment.
+ * 
+ * @param mapping_list Pointer to the maps_t structure
+ * @param entry Any of the mappings of the object
+ * @return The load bias of the object
+ */
+unsigned long maps_load_bias(maps_t *mapping_list, maps_entry_t *entry)
+{
+    maps_entry_t *base = mapping_list->all_entries;
+    while ((base != NULL) && ((base->inode != entry->inode) || (strcmp(base->pathname, entry->pathname) != 0))) {
+        base = base->next_all;
+    }
+    if ((base == NULL) || (mapping_is_at_fixed_base_address(base))) return 0;
+    return base->start - base->offset;
+}
+
+/**
+ * maps_build_data_index
+ * 
+ * Merge the symbol tables of all mappings into a single array sorted by absolute address.
+ * Symbols are relocated with the load bias of their object and attributed to the mapping that
+ * covers them. Every mapping of an object holds the same symbol table, so each symbol is only
+ * kept by the mapping it falls into. Uninitialized data (.bss) extends past the file-backed 
+ * mappings into the anonymous mapping that follows them, which then owns those symbols.
+ * 
+ * @param mapping_list Pointer to the maps_t structure (symbol tables must have been read)
+ * @return Number of symbols in the index
+ */
+int maps_build_data_index(maps_t *mapping_list)
+{
+    int num_symbols = 0, i = 0;
+    maps_entry_t *entry = NULL;
+
+    if (mapping_list == NULL) return 0;
+
+    free(mapping_list->data_index);
+    mapping_list->data_index = NULL;
+    mapping_list->num_data_symbols = 0;
+
+    // Upper bound of the index size. The index points to the symbol names, so the symbol tables are 
+    // pinned against eviction (see symtab_set_budget) for as long as they are part of the index
+    for (entry = mapping_list->all_entries; entry != NULL; entry = entry->next_all) {
+#if defined(HAVE_LIBSYMTAB)
+        if (entry->index_pinned) symtab_unpin(entry->symtab);
+        entry->index_pinned = (entry->symtab != NULL);
+        symtab_pin(entry->symtab);
+#endif
+        num_symbols += symtab_count(entry->symtab);
+    }
+    if (num_symbols == 0) return 0;
+
+    maps_symbol_t *index = (maps_symbol_t *)malloc(num_symbols * sizeof(maps_symbol_t));
+    if (index == NULL) return 0;
+
+    num_symbols = 0;
+    for (entry = mapping_list->all_entries; entry != NULL; entry = entry->next_all) 
+    {
+        if (symtab_count(entry->symtab) == 0) continue;
+
+        unsigned long bias = maps_load_bias(mapping_list, entry);
+        maps_entry_t *bss = entry->next_all;
+        if ((bss != NULL) && ((strlen(bss->pathname) > 0) || (bss->start != entry->end))) bss = NULL;
+
+        for (i = 0; i < symtab_count(entry->symtab); ++i)
+        {
+            symtab_entry_t *symbol = symtab_get_entry(entry->symtab, i);
+            unsigned long start = symbol->start + bias;
+            maps_entry_t *owner = NULL;
+
+            if (address_in_mapping(entry, start)) owner = entry;
+            else if ((bss != NULL) && (address_in_mapping(bss, start))) owner = bss;
+
+            if (owner != NULL)
+            {
+                index[num_symbols].start = start;
+                index[num_symbols].end = start + (symbol->end - symbol->start);
+                index[num_symbols].name = symbol->name;
+                index[num_symbols].entry = owner;
+                num_symbols ++;
+            }
+        }
+    }
+
+    if (num_symbols > 0)
+    {
+        qsort(index, num_symbols, sizeof(maps_symbol_t), compare_symbols);
+
+        // Track the running maximum end address so that lookups know when to stop walking back over nested symbols
+        unsigned long max_end = 0;
+        for (i = 0; i < num_symbols; ++i) {
+            if (index[i].end > max_end) max_end = index[i].end;
+            index[i].max_end = max_end;
+        }
+        mapping_list->data_index = index;
+        mapping_list->num_data_symbols = num_symbols;
+    }
+    else free(index);
+
+    return num_symbols;
+}
+
+/**
+ * maps_resolve_data
+ * 
+ * Find the data symbol that contains the given absolute address using the merged index.
+ * This replaces search_in_all_mappings() + absolute_to_relative() + symtab_translate() with
+ * a single binary search, and does not allocate memory.
+ * 
+ * @param mapping_list Pointer to the maps_t structure (built with OPTION_DATA_INDEX)
+ * @param address Absolute address to resolve
+ * @param offset Optional output for the offset of the address within the symbol
+ * @return Pointer to the symbol in the index (do not free), or NULL if not found
+ */
+maps_symbol_t * maps_resolve_data(maps_t *mapping_list, unsigned long address, unsigned long *offset)
+{
+    if ((mapping_list == NULL) || (mapping_list->num_data_symbols == 0)) return NULL;
+
+    maps_symbol_t *index = mapping_list->data_index;
+
+    // Find the last symbol that starts at or before the address
+    int low = 0, high = mapping_list->num_data_symbols - 1, found = -1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        if (index[mid].start <= address) {
+            found = mid;
+            low = mid + 1;
+        }
+        else high = mid - 1;
+    }
+
+    // Walk back in case the address falls in an enclosing symbol that starts earlier
+    for (int i = found; (i >= 0) && (index[i].max_end > address); --i)
+    {
+        if (address < index[i].end)
+        {
+            if (offset != NULL) *offset = address - index[i].start;
+            return &index[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * maps_lookup_symbol
+ * 
+ * Find the symbols of all mappings whose name matches the given name, prefix or wildcard pattern, and
+ * relocate them to their absolute runtime address ranges. Each object is looked up once, through the 
+ * name index of its symbol table (see symtab_lookup_name), and each symbol is attributed to the mapping
+ * that contains its start address (symbols out of every mapping are skipped). Filters by symbol can then
+ * check event addresses against the returned ranges instead of translating them.
+ * 
+ * @param mapping_list Pointer to the maps_t structure (symbol tables must have been read, with OPTION_READ_FUNCTIONS to find functions)
+ * @param name The name, prefix or wildcard pattern to look up
+ * @param match SYMTAB_MATCH_EXACT, SYMTAB_MATCH_PREFIX or SYMTAB_MATCH_GLOB
+ * @param[out] count Number of symbols found
+ * @return Array of symbols sorted by absolute address, followed in the same block by copies of their names 
+ *         (release it with free()), or NULL if none was found or out of memory
+ */
+maps_symbol_t * maps_lookup_symbol(maps_t *mapping_list, const char *name, int match, int *count)
+{
+    *count = 0;
+#if defined(HAVE_LIBSYMTAB)
+    maps_symbol_t *symbols = NULL, *result = NULL;
+    size_t *name_offsets = NULL;
+    char *names = NULL;
+    int num_symbols = 0, max_symbols = 0, failed = 0;
+    size_t names_size = 0, max_names_size = 0;
+
+    if ((mapping_list == NULL) || (name == NULL)) return NULL;
+
+    for (maps_entry_t *entry = mapping_list->all_entries; (entry != NULL) && (!failed); entry = entry->next_all)
+    {
+        if (entry->symtab == NULL) continue;
+
+        // Look up each object only through its first mapping
+        maps_entry_t *first = mapping_list->all_entries;
+        while ((first != entry) && (first->symtab != entry->symtab) && ((first->pathname != entry->pathname) || (first->inode != entry->inode))) {
+            first = first->next_all;
+        }
+        if (first != entry) continue;
+
+        // The names are copied while the symbol table is pinned against eviction
+        int *matches = NULL;
+        symtab_pin(entry->symtab);
+        int num_matches = symtab_lookup_name(entry->symtab, name, match, &matches);
+        unsigned long bias = maps_load_bias(mapping_list, entry);
+        failed = (num_matches < 0);
+
+        for (int i = 0; (i < num_matches) && (!failed); ++i)
+        {
+            symtab_entry_t *symbol = symtab_get_entry(entry->symtab, matches[i]);
+            unsigned long start = symbol->start + bias;
+            maps_entry_t *owner = search_in_all_mappings(mapping_list, start);
+            if (owner == NULL) continue;
+
+            const char *symbol_name = symtab_entry_name(entry->symtab, symbol);
+            size_t len = strlen(symbol_name) + 1;
+            if (num_symbols == max_symbols)
+            {
+                max_symbols = (max_symbols == 0 ? 64 : max_symbols * 2);
+                maps_symbol_t *grown_symbols = realloc(symbols, max_symbols * sizeof(maps_symbol_t));
+                if (grown_symbols != NULL) symbols = grown_symbols;
+                size_t *grown_offsets = realloc(name_offsets, max_symbols * sizeof(size_t));
+                if (grown_offsets != NULL) name_offsets = grown_offsets;
+                failed = ((grown_symbols == NULL) || (grown_offsets == NULL));
+            }
+            if (names_size + len > max_names_size)
+            {
+                max_names_size = (names_size + len) * 2;
+                char *grown_names = realloc(names, max_names_size);
+                if (grown_names != NULL) names = grown_names;
+                failed = failed || (grown_names == NULL);
+            }
+            if (failed) break;
+
+            symbols[num_symbols].start = start;
+            symbols[num_symbols].end = symbols[num_symbols].max_end = start + (symbol->end - symbol->start);
+            symbols[num_symbols].entry = owner;
+            name_offsets[num_symbols] = names_size;
+            memcpy(names + names_size, symbol_name, len);
+            names_size += len;
+            num_symbols ++;
+        }
+        free(matches);
+        symtab_unpin(entry->symtab);
+    }
+
+    // Pack the symbols and their names in a single block
+    if ((!failed) && (num_symbols > 0) && ((result = malloc(num_symbols * sizeof(maps_symbol_t) + names_size)) != NULL))
+    {
+        char *packed_names = (char *)&result[num_symbols];
+        memcpy(result, symbols, num_symbols * sizeof(maps_symbol_t));
+        memcpy(packed_names, names, names_size);
+        for (int i = 0; i < num_symbols; ++i) {
+            result[i].name = packed_names + name_offsets[i];
+        }
+        qsort(result, num_symbols, sizeof(maps_symbol_t), compare_symbols);
+        *count = num_symbols;
+    }
+    free(symbols);
+    free(name_offsets);
+    free(names);
+    return result;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Growable buffer used to lay out the sections of a maps image before writing it.
+ */
+typedef struct image_buffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+} image_buffer_t;
+
+/**
+ * image_buffer_append
+ * 
+ * Append data to the buffer, padding it to 8 bytes so that the next section stays aligned.
+ * 
+ * @return Offset of the data within the buffer, or -1 if out of memory
+ */
+static int64_t image_buffer_append(image_buffer_t *buffer, const void *data, size_t len)
+{
+    size_t padded = (len + 7) & ~(size_t)7;
+    if (buffer->size + padded > buffer->capacity)
+    {
+        size_t capacity = (buffer->capacity > 0 ? buffer->capacity : 4096);
+        while (buffer->size + padded > capacity) capacity *= 2;
+        char *grown = (char *)realloc(buffer->data, capacity);
+        if (grown == NULL) return -1;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    int64_t offset = buffer->size;
+    memcpy(buffer->data + offset, data, len);
+    memset(buffer->data + offset + len, 0, padded - len);
+    buffer->size += padded;
+    return offset;
+}
+
+/**
+ * compare_image_symbols
+ * 
+ * Comparison function to sort the symbols of an object by address.
+ */
+static int compare_image_symbols(const void *a, const void *b)
+{
+    const maps_image_symbol_t *sym_a = (const maps_image_symbol_t *)a;
+    const maps_image_symbol_t *sym_b = (const maps_image_symbol_t *)b;
+
+    if (sym_a->start != sym_b->start) return (sym_a->start < sym_b->start ? -1 : 1);
+    if (sym_a->end != sym_b->end) return (sym_a->end < sym_b->end ? -1 : 1);
+    return 0;
+}
+
+/**
+ * maps_save
+ * 
+ * Write a versioned binary image of the maps_t structure and its symbol tables, which can be
+ * reloaded with maps_load_mapped() instead of parsing the maps file and reading the objects again.
+ * The image is laid out as: header, entries, symbols (sorted per object) and string pool. Objects 
+ * mapped several times store their pathname and symbols once. The inode, modification time and size 
+ * of each object are recorded to detect stale images. The file is written under a temporary name
+ * and renamed, so readers never see a partial image.
+ * 
+ * @param mapping_list Pointer to the maps_t structure to save
+ * @param path Path to the image file
+ * @return 0 on success, -1 on error
+ */
+int maps_save(maps_t *mapping_list, char *path)
+{
+    image_buffer_t symbols = { NULL, 0, 0 }, strings = { NULL, 0, 0 };
+    maps_image_entry_t *entries = NULL;
+    maps_entry_t **saved = NULL;
+    int status = -1, i = 0;
+
+    if ((mapping_list == NULL) || (path == NULL)) return -1;
+
+    int num_entries = mapping_list->num_all_entries;
+    entries = (maps_image_entry_t *)calloc((num_entries > 0 ? num_entries : 1), sizeof(maps_image_entry_t));
+    saved = (maps_entry_t **)calloc((num_entries > 0 ? num_entries : 1), sizeof(maps_entry_t *));
+    if ((entries == NULL) || (saved == NULL)) goto out;
+
+    // Offset 0 of the string pool is the empty string
+    int64_t path_offset = -1;
+    if ((image_buffer_append(&strings, "", 1) < 0) || ((path_offset = image_buffer_append(&strings, mapping_list->path, strlen(mapping_list->path) + 1)) < 0)) goto out;
+
+    uint64_t num_symbols = 0;
+    maps_entry_t *entry = mapping_list->all_entries;
+    for (i = 0; (entry != NULL) && (i < num_entries); entry = entry->next_all, ++i)
+    {
+        maps_image_entry_t *image_entry = &entries[i];
+        image_entry->start = entry->start;
+        image_entry->end = entry->end;
+        image_entry->offset = entry->offset;
+        image_entry->load_bias = maps_load_bias(mapping_list, entry);
+        image_entry->inode = entry->inode;
+        image_entry->dev_major = entry->dev_major;
+        image_entry->dev_minor = entry->dev_minor;
+        image_entry->mapping_type = entry->mapping_type;
+        memcpy(image_entry->perms, entry->perms, sizeof(entry->perms));
+        saved[i] = entry;
+#if defined(HAVE_LIBSYMTAB)
+        symtab_pin(entry->symtab); // Keep the symbols resident while they are copied
+#endif
+
+        // Reuse the pathname and symbols of a previous mapping of the same object
+        int previous = -1;
+        for (int j = 0; (j < i) && (previous < 0); ++j) {
+            if (!strcmp(saved[j]->pathname, entry->pathname)) previous = j;
+        }
+        if (previous >= 0)
+        {
+            image_entry->pathname = entries[previous].pathname;
+            image_entry->object_inode = entries[previous].object_inode;
+            image_entry->object_mtime = entries[previous].object_mtime;
+            image_entry->object_size = entries[previous].object_size;
+            // Every mapping of the object reads the same symbol table
+            if (symtab_count(saved[previous]->symtab) == symtab_count(entry->symtab)) {
+                image_entry->first_symbol = entries[previous].first_symbol;
+                image_entry->num_symbols = entries[previous].num_symbols;
+                continue;
+            }
+        }
+        else if (strlen(entry->pathname) > 0)
+        {
+            int64_t offset = image_buffer_append(&strings, entry->pathname, strlen(entry->pathname) + 1);
+            if (offset < 0) goto out;
+            image_entry->pathname = offset;
+
+            struct stat object_stat;
+            if ((entry->pathname[0] == '/') && (stat(entry->pathname, &object_stat) == 0))
+            {
+                image_entry->object_inode = object_stat.st_ino;
+                image_entry->object_mtime = (int64_t)object_stat.st_mtim.tv_sec * 1000000000 + object_stat.st_mtim.tv_nsec;
+                image_entry->object_size = object_stat.st_size;
+            }
+        }
+
+        int count = symtab_count(entry->symtab);
+        image_entry->first_symbol = num_symbols;
+        image_entry->num_symbols = count;
+        if (count > 0)
+        {
+            maps_image_symbol_t *object_symbols = (maps_image_symbol_t *)malloc(count * sizeof(maps_image_symbol_t));
+            if (object_symbols == NULL) goto out;
+            for (int k = 0; k < count; ++k)
+            {
+                symtab_entry_t *symbol = symtab_get_entry(entry->symtab, k);
+                int64_t name = image_buffer_append(&strings, symbol->name, strlen(symbol->name) + 1);
+                if (name < 0) {
+                    free(object_symbols);
+                    goto out;
+                }
+                object_symbols[k].start = symbol->start;
+                object_symbols[k].end = symbol->end;
+                object_symbols[k].name = name;
+            }
+            qsort(object_symbols, count, sizeof(maps_image_symbol_t), compare_image_symbols);
+            uint64_t max_end = 0;
+            for (int k = 0; k < count; ++k) {
+                if (object_symbols[k].end > max_end) max_end = object_symbols[k].end;
+                object_symbols[k].max_end = max_end;
+            }
+            int64_t appended = image_buffer_append(&symbols, object_symbols, count * sizeof(maps_image_symbol_t));
+            free(object_symbols);
+            if (appended < 0) goto out;
+            num_symbols += count;
+        }
+    }
+
+    // Lay out the sections one after the other
+    maps_image_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAPS_IMAGE_MAGIC, sizeof(MAPS_IMAGE_MAGIC));
+    header.version = MAPS_IMAGE_VERSION;
+    header.num_entries = num_entries;
+    header.num_symbols = num_symbols;
+    header.entries_offset = sizeof(header);
+    header.symbols_offset = header.entries_offset + num_entries * sizeof(maps_image_entry_t);
+    header.strings_offset = header.symbols_offset + symbols.size;
+    header.strings_size = strings.size;
+    header.path = path_offset;
+    header.total_size = header.strings_offset + strings.size;
+
+    char tmp_path[BUFSIZ];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+    FILE *fd = fopen(tmp_path, "wb");
+    if (fd == NULL) goto out;
+    int written = ((fwrite(&header, sizeof(header), 1, fd) == 1) &&
+                   ((num_entries == 0) || (fwrite(entries, sizeof(maps_image_entry_t), num_entries, fd) == (size_t)num_entries)) &&
+                   ((symbols.size == 0) || (fwrite(symbols.data, symbols.size, 1, fd) == 1)) &&
+                   (fwrite(strings.data, strings.size, 1, fd) == 1));
+    if ((fclose(fd) != 0) || (!written) || (rename(tmp_path, path) != 0)) {
+        unlink(tmp_path);
+        goto out;
+    }
+    status = 0;
+
+out:
+#if defined(HAVE_LIBSYMTAB)
+    for (i = 0; (saved != NULL) && (i < num_entries) && (saved[i] != NULL); ++i) {
+        symtab_unpin(saved[i]->symtab);
+    }
+#endif
+    free(entries);
+    free(saved);
+    free(symbols.data);
+    free(strings.data);
+    return status;
+}
+
+/**
+ * image_is_valid
+ * 
+ * Check that the mapped image is well-formed and that the objects it describes have not changed since it was saved.
+ */
+static int image_is_valid(maps_image_t *image)
+{
+    maps_image_header_t *header = image->header;
+
+    if ((image->size < sizeof(maps_image_header_t)) || (memcmp(header->magic, MAPS_IMAGE_MAGIC, sizeof(MAPS_IMAGE_MAGIC)) != 0)) return 0;
+    if ((header->version != MAPS_IMAGE_VERSION) || (header->total_size != image->size)) return 0;
+
+    // The sections are consecutive and 8-byte aligned. Counts are checked against the room of their section 
+    // by division, so that huge values in a corrupt image can not wrap the bounds around.
+    if ((header->entries_offset < sizeof(maps_image_header_t)) || (header->symbols_offset < header->entries_offset) ||
+        (header->strings_offset < header->symbols_offset) || (header->strings_offset > header->total_size) ||
+        (header->entries_offset % sizeof(uint64_t) != 0) || (header->symbols_offset % sizeof(uint64_t) != 0)) return 0;
+    if ((header->num_entries > (header->symbols_offset - header->entries_offset) / sizeof(maps_image_entry_t)) ||
+        (header->num_symbols > (header->strings_offset - header->symbols_offset) / sizeof(maps_image_symbol_t)) ||
+        (header->strings_size > header->total_size - header->strings_offset) || (header->strings_size == 0) ||
+        (header->path >= header->strings_size) || (image->strings[header->strings_size - 1] != '\0')) return 0;
+
+    for (uint32_t i = 0; i < header->num_entries; ++i)
+    {
+        maps_image_entry_t *entry = &image->entries[i];
+        if ((entry->pathname >= header->strings_size) || (entry->first_symbol > header->num_symbols) || 
+            (entry->num_symbols > header->num_symbols - entry->first_symbol)) return 0;
+
+        // Objects mapped several times are stored consecutively with the same pathname, only check them once
+        if ((entry->object_inode == 0) || ((i > 0) && (image->entries[i-1].pathname == entry->pathname))) continue;
+
+        struct stat object_stat;
+        if ((stat(image->strings + entry->pathname, &object_stat) != 0) || (object_stat.st_ino != entry->object_inode) || 
+            ((uint64_t)object_stat.st_size != entry->object_size) ||
+            ((int64_t)object_stat.st_mtim.tv_sec * 1000000000 + object_stat.st_mtim.tv_nsec != entry->object_mtime)) return 0;
+    }
+    for (uint64_t i = 0; i < header->num_symbols; ++i) {
+        if (image->symbols[i].name >= header->strings_size) return 0;
+    }
+    return 1;
+}
+
+/**
+ * maps_load_mapped
+ * 
+ * Map an image written by maps_save() and use it in place, without parsing the maps file,
+ * opening the objects or copying the symbol tables. The image is rejected if it is malformed, 
+ * was written by another version, or any of the objects changed on disk since it was saved, 
+ * in which case the caller should fall back to maps_parse_file().
+ * 
+ * @param path Path to the image file
+ * @return Pointer to the mapped image, or NULL if it is missing or not valid
+ */
+maps_image_t * maps_load_mapped(char *path)
+{
+    struct stat image_stat;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    if ((fstat(fd, &image_stat) != 0) || ((size_t)image_stat.st_size < sizeof(maps_image_header_t))) {
+        close(fd);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, image_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    maps_image_t *image = (maps_image_t *)malloc(sizeof(maps_image_t));
+    if (image == NULL) {
+        munmap(base, image_stat.st_size);
+        return NULL;
+    }
+    image->base = base;
+    image->size = image_stat.st_size;
+    image->header = (maps_image_header_t *)base;
+    image->entries = (maps_image_entry_t *)((char *)base + image->header->entries_offset);
+    image->symbols = (maps_image_symbol_t *)((char *)base + image->header->symbols_offset);
+    image->strings = (const char *)base + image->header->strings_offset;
+
+    if (!image_is_valid(image)) {
+        maps_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * maps_image_find
+ * 
+ * Find the entry of the mapped image that contains the given address.
+ * 
+ * @param image Pointer to the mapped image
+ * @param address Address to search for
+ * @return Pointer to the entry (inside the mapped image), or NULL if not found
+ */
+maps_image_entry_t * maps_image_find(maps_image_t *image, unsigned long address)
+{
+    if (image == NULL) return NULL;
+
+    int low = 0, high = (int)image->header->num_entries - 1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        maps_image_entry_t *entry = &image->entries[mid];
+        if (address < entry->start) high = mid - 1;
+        else if (address >= entry->end) low = mid + 1;
+        else return entry;
+    }
+    return NULL;
+}
+
+/**
+ * maps_image_translate
+ * 
+ * Translate an absolute address to the name of the symbol that contains it, directly from the mapped image.
+ * 
+ * @param image Pointer to the mapped image
+ * @param address Absolute address to translate
+ * @param entry Optional output for the entry that contains the address
+ * @return The symbol name (inside the mapped image, do not free), or UNKNOWN_SYMBOL if not found
+ */
+const char * maps_image_translate(maps_image_t *image, unsigned long address, maps_image_entry_t **entry)
+{
+    maps_image_entry_t *found_entry = maps_image_find(image, address);
+    if (entry != NULL) *entry = found_entry;
+    if ((found_entry == NULL) || (found_entry->num_symbols == 0)) return UNKNOWN_SYMBOL;
+
+    maps_image_symbol_t *symbols = &image->symbols[found_entry->first_symbol];
+    uint64_t relative = address - found_entry->load_bias;
+
+    // Find the last symbol that starts at or before the address, then walk back over enclosing symbols
+    int64_t low = 0, high = (int64_t)found_entry->num_symbols - 1, found = -1;
+    while (low <= high)
+    {
+        int64_t mid = low + (high - low) / 2;
+        if (symbols[mid].start <= relative) {
+            found = mid;
+            low = mid + 1;
+        }
+        else high = mid - 1;
+    }
+    for (int64_t i = found; (i >= 0) && (symbols[i].max_end > relative); --i) {
+        if (relative < symbols[i].end) return image->strings + symbols[i].name;
+    }
+    return UNKNOWN_SYMBOL;
+}
+
+/**
+ * maps_image_close
+ * 
+ * Unmap the image and free the handler.
+ * 
+ * @param image Pointer to the mapped image
+ */
+void maps_image_close(maps_image_t *image)
+{
+    if (image != NULL)
+    {
+        munmap(image->base, image->size);
+        free(image);
+    }
+}
+
+/**
+ * maps_series_create
+ * 
+ * Create an empty series of maps snapshots.
+ * 
+ * @param options Options applied to every snapshot (OPTION_READ_SYMTAB, OPTION_READ_FUNCTIONS)
+ * @return Pointer to the maps_series_t structure, or NULL if out of memory
+ */
+maps_series_t * maps_series_create(int options)
+{
+    maps_series_t *series = (maps_series_t *)malloc(sizeof(maps_series_t));
+    if (series != NULL)
+    {
+        series->options = options;
+        series->versions = NULL;
+        series->num_versions = 0;
+        series->max_versions = 0;
+    }
+    return series;
+}
+
+#if defined(HAVE_LIBSYMTAB)
+/**
+ * find_shared_symtab
+ * 
+ * Look in an array of entries for a mapping of the same object that already loaded its symbol table.
+ * 
+ * @param entries The entries to search (may be NULL)
+ * @param num_entries Number of entries
+ * @param entry The entry that needs the symbol table
+ * @return The symbol table to share, or NULL if none was found
+ */
+static symtab_t * find_shared_symtab(maps_entry_t **entries, int num_entries, maps_entry_t *entry)
+{
+    if ((entries == NULL) || (strlen(entry->pathname) == 0)) return NULL;
+
+    // Search backwards, as the mappings of an object are consecutive
+    for (int i = num_entries - 1; i >= 0; --i)
+    {
+        maps_entry_t *other = entries[i];
+        if ((other->symtab != NULL) && (other->inode == entry->inode) && (other->dev_major == entry->dev_major) && 
+            (other->dev_minor == entry->dev_minor) && (!strcmp(other->pathname, entry->pathname))) {
+            return other->symtab;
+        }
+    }
+    return NULL;
+}
+#endif
+
+/**
+ * maps_series_append
+ * 
+ * Parse a maps file as the snapshot valid from the given epoch onwards. Entries identical to the ones
+ * in the previous snapshot are shared instead of being duplicated, so they are neither classified nor 
+ * get their symbol table read again. New mappings of objects already loaded, in this snapshot or in the
+ * previous one (e.g. at a different address), share their symbol table, so an object costs a single read.
+ * Snapshots must be appended in increasing epoch order.
+ * 
+ * @param series Pointer to the maps_series_t structure
+ * @param maps_file Path to the dump of the /proc/self/maps file
+ * @param epoch Timestamp or epoch from which the snapshot is valid
+ * @return Pointer to the new snapshot, or NULL if the epoch is out of order or out of memory
+ */
+maps_version_t * maps_series_append(maps_series_t *series, char *maps_file, unsigned long epoch)
+{
+    if (series == NULL) return NULL;
+
+    maps_version_t *previous = (series->num_versions > 0 ? &series->versions[series->num_versions - 1] : NULL);
+    if ((previous != NULL) && (epoch < previous->epoch)) return NULL;
+
+    if (series->num_versions == series->max_versions)
+    {
+        int max_versions = (series->max_versions > 0 ? series->max_versions * 2 : 16);
+        maps_version_t *versions = (maps_version_t *)realloc(series->versions, max_versions * sizeof(maps_version_t));
+        if (versions == NULL) return NULL;
+        series->versions = versions;
+        series->max_versions = max_versions;
+        previous = (series->num_versions > 0 ? &series->versions[series->num_versions - 1] : NULL);
+    }
+
+    maps_entry_t *fresh = read_entries(maps_file);
+    int num_entries = 0;
+    for (maps_entry_t *entry = fresh; entry != NULL; entry = entry->next_all) num_entries ++;
+
+    maps_entry_t **entries = (maps_entry_t **)malloc((num_entries > 0 ? num_entries : 1) * sizeof(maps_entry_t *));
+    if (entries == NULL) 
+    {
+        while (fresh != NULL) {
+            maps_entry_t *next = fresh->next_all;
+            free_entry(fresh);
+            fresh = next;
+        }
+        return NULL;
+    }
+
+    // Both snapshots are sorted by address, so a single merge pass finds the unchanged entries
+    void *magic = NULL;
+    int i = 0, j = 0;
+    while (fresh != NULL)
+    {
+        maps_entry_t *next = fresh->next_all;
+        while ((previous != NULL) && (j < previous->num_entries) && (previous->entries[j]->start < fresh->start)) j ++;
+
+        if ((previous != NULL) && (j < previous->num_entries) && (same_entry(previous->entries[j], fresh)))
+        {
+            entries[i] = previous->entries[j++];
+            entries[i]->refcount ++;
+            free_entry(fresh);
+        }
+        else
+        {
+            if (magic == NULL) magic = open_magic();
+            classify_entry(magic, fresh);
+#if defined(HAVE_LIBSYMTAB)
+            if (series->options & (OPTION_READ_SYMTAB | OPTION_READ_FUNCTIONS)) 
+            {
+                // Share with the mappings of the same object in this snapshot, or else in the previous one
+                symtab_t *shared = find_shared_symtab(entries, i, fresh);
+                if ((shared == NULL) && (previous != NULL)) shared = find_shared_symtab(previous->entries, previous->num_entries, fresh);
+                fresh->symtab = (shared != NULL ? symtab_retain(shared) : read_object_symtab(fresh->pathname, series->options));
+            }
+#endif
+            fresh->next_all = NULL;
+            fresh->index = i;
+            entries[i] = fresh;
+        }
+        i ++;
+        fresh = next;
+    }
+    close_magic(magic);
+
+    maps_version_t *version = &series->versions[series->num_versions++];
+    version->epoch = epoch;
+    version->entries = entries;
+    version->num_entries = num_entries;
+    return version;
+}
+
+/**
+ * maps_series_version
+ * 
+ * Find the snapshot valid at the given epoch, i.e. the last one appended with an epoch not greater than it.
+ * 
+ * @param series Pointer to the maps_series_t structure
+ * @param epoch Timestamp or epoch to look up
+ * @return Pointer to the snapshot, or NULL if the epoch precedes all snapshots
+ */
+maps_version_t * maps_series_version(maps_series_t *series, unsigned long epoch)
+{
+    if (series == NULL) return NULL;
+
+    int low = 0, high = series->num_versions - 1, found = -1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        if (series->versions[mid].epoch <= epoch) {
+            found = mid;
+            low = mid + 1;
+        }
+        else high = mid - 1;
+    }
+    return (found >= 0 ? &series->versions[found] : NULL);
+}
+
+/**
+ * maps_series_find
+ * 
+ * Find the entry that contains the given address in the snapshot valid at the given epoch.
+ * Note that the index field of shared entries refers to their position in the snapshot that created them.
+ * 
+ * @param series Pointer to the maps_series_t structure
+ * @param address Address to search for
+ * @param epoch Timestamp or epoch of the event the address belongs to
+ * @return Pointer to the entry that contains the address, or NULL if not found
+ */
+maps_entry_t * maps_series_find(maps_series_t *series, unsigned long address, unsigned long epoch)
+{
+    maps_version_t *version = maps_series_version(series, epoch);
+    if (version == NULL) return NULL;
+
+    int low = 0, high = version->num_entries - 1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        maps_entry_t *entry = version->entries[mid];
+        if (address < entry->start) high = mid - 1;
+        else if (address >= entry->end) low = mid + 1;
+        else return entry;
+    }
+    return NULL;
+}
+
+/**
+ * maps_series_free
+ * 
+ * Free the series and all its snapshots, releasing each shared entry once its last snapshot is gone.
+ * 
+ * @param series Pointer to the maps_series_t structure to free
+ */
+void maps_series_free(maps_series_t *series)
+{
+    if (series != NULL)
+    {
+        for (int v = 0; v < series->num_versions; ++v)
+        {
+            maps_version_t *version = &series->versions[v];
+            for (int i = 0; i < version->num_entries; ++i) {
+                if (-- version->entries[i]->refcount == 0) free_entry(version->entries[i]);
+            }
+            free(version->entries);
+        }
+        free(series->versions);
+        free(series);
+    }
+}
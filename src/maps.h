@@ -1,12 +1,28 @@
 #pragma once
 
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include "symtab.h"
 
 #define UNKNOWN_MAPPING "??"
 
 // Available configuration options
 #define OPTION_READ_SYMTAB             (1 << 0) // Read the symbol table for each mapping 
+#define OPTION_DATA_INDEX              (1 << 1) // Build a merged index of the data symbols of all mappings (implies OPTION_READ_SYMTAB)
+#define OPTION_READ_FUNCTIONS          (1 << 2) // Read the function symbols instead of the data objects (implies OPTION_READ_SYMTAB)
+#define OPTION_READ_JIT                (1 << 3) // Load the perf map of the process (/tmp/perf-<pid>.map) to resolve JIT-compiled code (see maps_load_jit, ignored with a warning by maps_from_self)
+#define OPTION_DEMANGLE                (1 << 4) // Demangle the names of the symbols read, on their first lookup (as the addr2line backends do with -C)
+
+// Formats of the files describing JIT-compiled code (see maps_load_jit)
+#define JIT_FORMAT_PERF_MAP 0 // Text lines "START SIZE name" in hexadecimal, as written for perf to /tmp/perf-<pid>.map
+#define JIT_FORMAT_JITDUMP  1 // Binary jitdump records (jit-<pid>.dump), of which only the code load records are used
+
+#define JITDUMP_MAGIC       0x4A695444 // "JiTD" in the byte order of the writer
+#define JITDUMP_CODE_LOAD   0          // Record describing newly generated code
+#define JITDUMP_CODE_CLOSE  3          // Record marking the end of the file
+
+#define JIT_CHECK_INTERVAL_NS 10000000L // Minimum time between two checks of the JIT file on lookup misses (see maps_resolve_jit)
 
 typedef enum {
     BINARY_PIE,
@@ -15,6 +31,34 @@ typedef enum {
     OTHER_MAPPING
 } mapping_type_t;
 
+/**
+ * Symbol of JIT-compiled code.
+ */
+typedef struct maps_jit_symbol {
+    unsigned long start;          // Absolute start address of the code
+    unsigned long end;            // Absolute end address of the code
+    unsigned long max_end;        // Highest end address among this and all preceding symbols in the index
+    unsigned long serial;         // Order in which the symbol was read (later code replaces earlier code at the same address)
+    char *name;                   // Symbol name (owned by the index, valid until maps_free)
+} maps_jit_symbol_t;
+
+/**
+ * Range index of the code generated by the JIT compilers of a process, read from a perf map or jitdump file.
+ * The compilers keep appending to these files, so the index reads them incrementally (see maps_jit_refresh).
+ */
+typedef struct maps_jit {
+    char *path;                   // Path to the perf map or jitdump file
+    int format;                   // JIT_FORMAT_PERF_MAP or JIT_FORMAT_JITDUMP
+    long consumed;                // Bytes of the file already read (complete lines or records only)
+    long size;                    // Size of the file when it was last read
+    struct timespec mtime;        // Modification time of the file when it was last read
+    struct timespec last_check;   // Last time a lookup miss checked the file (CLOCK_MONOTONIC)
+    maps_jit_symbol_t *symbols;   // Symbols sorted by start address
+    int num_symbols;              // Number of symbols
+    int max_symbols;              // Allocated capacity of the symbols array
+    pthread_mutex_t lock;         // Serializes the lookups with the incremental reads
+} maps_jit_t;
+
 /**
  * Structure to hold a single entry from the /proc/self/maps file.
  */
@@ -27,27 +71,169 @@ typedef struct maps_entry {
     int dev_major;
     int dev_minor;
     int inode;
-    char pathname[4096];          // Anonymous mappings have no pathname (empty string "", strlen() == 0)
+    char *pathname;               // Interned path, shared by all the entries of the object (anonymous mappings have an empty string "")
     struct maps_entry *next_all;  // Next in the list of all entries
     struct maps_entry *next_exec; // Next in the list of executable entries
     symtab_t *symtab;             // Symbol table for the mapping
+    int index_pinned;             // Flag to indicate if the symbol table is pinned by the data index (see maps_build_data_index)
     mapping_type_t mapping_type;  // Type of the mapping
+    maps_jit_t *jit;              // JIT code index of the process if this is an anonymous executable mapping, NULL otherwise
+    int refcount;                 // Number of snapshots sharing the entry (only for entries owned by a maps_series_t)
 } maps_entry_t;
 
+/**
+ * Structure to hold a symbol relocated to its absolute runtime address.
+ */
+typedef struct maps_symbol {
+    unsigned long start;          // Absolute start address of the symbol
+    unsigned long end;            // Absolute end address of the symbol
+    unsigned long max_end;        // Highest end address among this and all preceding symbols in the index
+    const char *name;             // Symbol name (owned by the symtab of the entry)
+    maps_entry_t *entry;          // Mapping that contains the symbol
+} maps_symbol_t;
+
+/**
+ * Canonical key of a code location, independent of the address space layout of the process.
+ * Two processes running the same object produce the same key for the same code location.
+ * Device numbers are not part of the identity, as they differ across the nodes sharing a file system.
+ */
+typedef struct maps_key {
+    const char *object;           // Path to the object (owned by the entry)
+    int inode;                    // Inode of the object
+    unsigned long offset;         // Virtual address in the object (absolute address minus its load bias), as given to the addr2line backends
+    maps_entry_t *entry;          // Executable mapping that contains the address
+} maps_key_t;
+
+/**
+ * Structure to hold one snapshot of a maps_series_t. The entries are shared with the 
+ * neighbouring snapshots when unchanged, and their next_all/next_exec chainings are not used.
+ */
+typedef struct maps_version {
+    unsigned long epoch;          // Timestamp or epoch from which the snapshot is valid
+    maps_entry_t **entries;       // Entries of the snapshot sorted by address
+    int num_entries;              // Number of entries
+} maps_version_t;
+
+/**
+ * Structure to hold a series of snapshots of the /proc/self/maps file taken over time.
+ */
+typedef struct maps_series {
+    int options;                  // Options applied to every snapshot (OPTION_READ_SYMTAB, OPTION_READ_FUNCTIONS)
+    maps_version_t *versions;     // Snapshots sorted by epoch
+    int num_versions;             // Number of snapshots
+    int max_versions;             // Allocated capacity of the versions array
+} maps_series_t;
+
+/**
+ * On-disk image of a maps_t structure and its symbol tables (see maps_save).
+ * The image is position-independent: all references are offsets from the start of the
+ * file (strings) or indices (symbols), so it can be mmapped and used in place.
+ */
+#define MAPS_IMAGE_MAGIC   "A2LMAPS"
+#define MAPS_IMAGE_VERSION 1
+
+typedef struct maps_image_header {
+    char magic[8];                // MAPS_IMAGE_MAGIC
+    uint32_t version;             // MAPS_IMAGE_VERSION
+    uint32_t num_entries;         // Number of entries
+    uint64_t num_symbols;         // Number of symbols of all objects
+    uint64_t entries_offset;      // Offset of the entries array
+    uint64_t symbols_offset;      // Offset of the symbols array
+    uint64_t strings_offset;      // Offset of the string pool
+    uint64_t strings_size;        // Size of the string pool
+    uint64_t path;                // Path to the maps file (string pool offset)
+    uint64_t total_size;          // Size of the whole image
+} maps_image_header_t;
+
+typedef struct maps_image_entry {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    uint64_t load_bias;           // Value added to the symbol addresses of the object to get runtime addresses
+    uint64_t pathname;            // String pool offset
+    uint64_t first_symbol;        // Index of the first symbol of the object (shared by all its entries)
+    uint64_t num_symbols;         // Number of symbols of the object, sorted by address
+    uint64_t object_inode;        // Inode of the object when saved, used to validate the image (0 if not a file)
+    int64_t object_mtime;         // Modification time of the object in nanoseconds when saved
+    uint64_t object_size;         // Size of the object when saved
+    int32_t inode;
+    int32_t dev_major;
+    int32_t dev_minor;
+    int32_t mapping_type;
+    char perms[8];
+} maps_image_entry_t;
+
+typedef struct maps_image_symbol {
+    uint64_t start;               // Start address of the symbol as in the object
+    uint64_t end;                 // End address of the symbol as in the object
+    uint64_t max_end;             // Highest end address among this and the preceding symbols of the same object
+    uint64_t name;                // String pool offset
+} maps_image_symbol_t;
+
+/**
+ * Structure to hold a maps image mapped in memory.
+ */
+typedef struct maps_image {
+    void *base;                   // Start of the mapped file
+    size_t size;                  // Size of the mapped file
+    maps_image_header_t *header;
+    maps_image_entry_t *entries;
+    maps_image_symbol_t *symbols;
+    const char *strings;
+} maps_image_t;
+
 /**
  * Structure to hold the parsed /proc/self/maps file.
  */
 typedef struct maps_t {
     char *path;                   // Path to the maps file
-    maps_entry_t *all_entries;    // List of all entries
+    maps_entry_t *all_entries;    // List of all entries (sorted by address)
     int num_all_entries;          // Number of all entries
-    maps_entry_t *exec_entries;   // List of executable entries
+    maps_entry_t *exec_entries;   // List of executable entries (sorted by address)
     int num_exec_entries;         // Number of executable entries
+    maps_symbol_t *data_index;    // Data symbols of all mappings sorted by absolute address (only with OPTION_DATA_INDEX)
+    int num_data_symbols;         // Number of symbols in the data index
+    int options;                  // Options given to maps_parse_file (reapplied to new entries on refresh)
+    int refcount;                 // Number of owners sharing the structure (see maps_retain)
+    unsigned long generation;     // Incremented every time maps_refresh changes the entries
+    maps_entry_t *retired_entries; // Entries removed by maps_refresh, kept valid until maps_release_retired or maps_free (chained through next_all)
+    maps_jit_t *jit;              // JIT code index of the process (see maps_load_jit), NULL if none was loaded
+    int from_self;                // Flag to indicate if the entries come from the dynamic loader (see maps_from_self)
+    unsigned long long dl_adds;   // Loader counters of objects loaded and unloaded when the entries were built (only if from_self)
+    unsigned long long dl_subs;
 } maps_t;
 
 maps_t * maps_parse_file(char *maps_file, int options);
+maps_t * maps_from_self(int options);
+maps_t ** maps_parse_many(char **maps_files, int count, int options);
+int maps_refresh(maps_t *mapping_list);
+void maps_release_retired(maps_t *mapping_list);
+maps_t * maps_retain(maps_t *mapping_list);
+
+int maps_save(maps_t *mapping_list, char *path);
+maps_image_t * maps_load_mapped(char *path);
+maps_image_entry_t * maps_image_find(maps_image_t *image, unsigned long address);
+const char * maps_image_translate(maps_image_t *image, unsigned long address, maps_image_entry_t **entry);
+void maps_image_close(maps_image_t *image);
+
+// Macro to get the path to a given mapping of a maps image
+#define maps_image_path(image, entry) (entry != NULL ? (image->strings[entry->pathname] == '\0' ? UNKNOWN_MAPPING : image->strings + entry->pathname) : UNKNOWN_MAPPING)
+
+maps_series_t * maps_series_create(int options);
+maps_version_t * maps_series_append(maps_series_t *series, char *maps_file, unsigned long epoch);
+maps_version_t * maps_series_version(maps_series_t *series, unsigned long epoch);
+maps_entry_t * maps_series_find(maps_series_t *series, unsigned long address, unsigned long epoch);
+void maps_series_free(maps_series_t *series);
 void maps_free(maps_t *mapping_list);
 maps_entry_t * maps_find_by_address(maps_entry_t *mapping_list, unsigned long address, int search_filter);
+unsigned long maps_load_bias(maps_t *mapping_list, maps_entry_t *entry);
+int maps_build_data_index(maps_t *mapping_list);
+maps_symbol_t * maps_resolve_data(maps_t *mapping_list, unsigned long address, unsigned long *offset);
+int maps_normalize(maps_t *mapping_list, unsigned long address, maps_key_t *key);
+maps_symbol_t * maps_lookup_symbol(maps_t *mapping_list, const char *name, int match, int *count);
+int maps_load_jit(maps_t *mapping_list, char *path);
+int maps_jit_refresh(maps_t *mapping_list);
+const char * maps_resolve_jit(maps_t *mapping_list, unsigned long address, unsigned long *offset);
 
 enum {
     SEARCH_ALL = 0,
@@ -65,6 +251,12 @@ enum {
 #define search_in_exec_mappings(maps, address) maps_find_by_address(maps->exec_entries, address, SEARCH_EXEC)
 #define address_in_mapping(entry, address) (address >= entry->start && address < entry->end)
 
+// Check if the mapping holds code that is not backed by an object file, as generated by JIT compilers
+#define mapping_is_anonymous_code(entry) ((entry)->perms[2] == 'x' && ((entry)->pathname[0] == '\0' || !strncmp((entry)->pathname, "[anon", 5) || !strncmp((entry)->pathname, "/memfd:", 7)))
+
+// Compare the object identity of two keys (see maps_normalize)
+#define maps_key_same_object(a, b) ((a)->inode == (b)->inode && !strcmp((a)->object, (b)->object))
+
 /*
  * Macros to iterate over the `maps_t` structure.
  *
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE // F_SETPIPE_SZ
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pipe_io.h"
+
+/**
+ * reader_open
+ * 
+ * Create a buffered line reader over the given file descriptor, which is owned by the reader from then on.
+ * 
+ * @param fd File descriptor to read from (read end of the pipe from the addr2line command)
+ * @return Pointer to the reader
+ */
+line_reader_t * reader_open(int fd)
+{
+	line_reader_t *reader = (line_reader_t *)malloc(sizeof(line_reader_t));
+	if (reader != NULL) {
+		reader->buffer = (char *)malloc(READER_CAPACITY);
+	}
+	if ((reader == NULL) || (reader->buffer == NULL)) {
+		fprintf(stderr, "ERROR: reader_open: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	reader->fd = fd;
+	reader->capacity = READER_CAPACITY;
+	reader->head = reader->tail = 0;
+	return reader;
+}
+
+/**
+ * reader_getline
+ * 
+ * Return the next line without the trailing newline. The line is NUL-terminated in place and
+ * stays valid until the next call. Lines of any length are supported.
+ * 
+ * @param reader Pointer to the reader
+ * @param[out] len Length of the line
+ * @return Pointer to the line, or NULL at the end of the output (or on error) 
+ */
+char * reader_getline(line_reader_t *reader, size_t *len)
+{
+	size_t scanned = reader->head;
+
+	while (1)
+	{
+		char *newline = memchr(reader->buffer + scanned, '\n', reader->tail - scanned);
+		if (newline != NULL)
+		{
+			char *line = reader->buffer + reader->head;
+			*newline = '\0';
+			*len = newline - line;
+			reader->head = (newline - reader->buffer) + 1;
+			return line;
+		}
+		scanned = reader->tail;
+
+		// Reclaim the consumed space, or grow the buffer if the pending line already fills it
+		if (reader->head > 0)
+		{
+			memmove(reader->buffer, reader->buffer + reader->head, reader->tail - reader->head);
+			reader->tail -= reader->head;
+			scanned -= reader->head;
+			reader->head = 0;
+		}
+		if (reader->tail == reader->capacity)
+		{
+			char *grown = (char *)realloc(reader->buffer, reader->capacity * 2);
+			if (grown == NULL) {
+				fprintf(stderr, "ERROR: reader_getline: Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			reader->buffer = grown;
+			reader->capacity *= 2;
+		}
+
+		ssize_t result = read(reader->fd, reader->buffer + reader->tail, reader->capacity - reader->tail);
+		if (result < 0) 
+		{
+			if (errno == EINTR) continue;
+			return NULL;
+		}
+		if (result == 0)
+		{
+			// End of output, return the last line even if it has no newline
+			if (reader->tail == reader->head) return NULL;
+			if (reader->tail == reader->capacity) continue; // Make room for the terminator
+			char *line = reader->buffer + reader->head;
+			reader->buffer[reader->tail] = '\0';
+			*len = reader->tail - reader->head;
+			reader->head = reader->tail = 0;
+			return line;
+		}
+		reader->tail += result;
+	}
+}
+
+/**
+ * reader_close
+ * 
+ * Close the file descriptor and free the reader.
+ */
+void reader_close(line_reader_t *reader)
+{
+	if (reader != NULL)
+	{
+		close(reader->fd);
+		free(reader->buffer);
+		free(reader);
+	}
+}
+
+/**
+ * write_with_retry
+ * 
+ * Safe write wrapper that retries the write operation until all data is written. 
+ */
+ssize_t write_with_retry(int fd, const void *buf, size_t count) {
+	ssize_t written = 0, result = 0;
+
+	while (count > 0) {
+		result = write(fd, buf, count);
+		
+		if (result < 0) {
+			if (errno != EINTR) {
+				// Retry the full write if EINTR, other errors are fatal
+				perror("write failed");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else {
+			// Successfully wrote some data, continue writing the rest if the write was partial
+			written += result;
+			buf = (const char *)buf + result;
+			count -= result;
+		}
+	}
+	return written;
+}
+
+/**
+ * writer_init
+ * 
+ * Prepare an empty write-coalescing buffer for the given file descriptor.
+ */
+void writer_init(line_writer_t *writer, int fd)
+{
+	writer->fd = fd;
+	writer->size = 0;
+}
+
+/**
+ * writer_append_address
+ * 
+ * Queue an address followed by a newline, flushing the buffer first if it is full.
+ */
+void writer_append_address(line_writer_t *writer, void *address)
+{
+	if (writer->size + 32 > WRITER_CAPACITY) writer_flush(writer);
+	writer->size += format_address(writer->buffer + writer->size, address);
+	writer->buffer[writer->size++] = '\n';
+}
+
+/**
+ * writer_flush
+ * 
+ * Write all queued addresses at once.
+ */
+void writer_flush(line_writer_t *writer)
+{
+	if (writer->size > 0)
+	{
+		write_with_retry(writer->fd, writer->buffer, writer->size);
+		writer->size = 0;
+	}
+}
+
+/**
+ * format_address
+ * 
+ * Format an address as a 0x-prefixed hexadecimal string, without going through printf.
+ * 
+ * @param buf Output buffer (at least 19 bytes)
+ * @param address Address to format
+ * @return Length of the string, not counting the NUL terminator
+ */
+int format_address(char *buf, void *address)
+{
+	static const char digits[] = "0123456789abcdef";
+	unsigned long value = (unsigned long)address;
+	char reversed[16];
+	int n = 0, len = 0;
+
+	do {
+		reversed[n++] = digits[value & 0xf];
+		value >>= 4;
+	} while (value != 0);
+
+	buf[len++] = '0';
+	buf[len++] = 'x';
+	while (n > 0) buf[len++] = reversed[--n];
+	buf[len] = '\0';
+	return len;
+}
+
+/**
+ * set_pipe_capacity
+ * 
+ * Enlarge the capacity of a pipe so that batches of requests and responses do not block on it.
+ * This is best-effort, the system limit (/proc/sys/fs/pipe-max-size) may prevent it.
+ */
+void set_pipe_capacity(int fd)
+{
+#if defined(F_SETPIPE_SZ)
+	fcntl(fd, F_SETPIPE_SZ, PIPE_CAPACITY);
+#endif
+}
+
+/**
+ * parse_number_backwards
+ * 
+ * Parse the decimal number that ends at buf[*end - 1] if it is preceded by a colon.
+ * Unknown numbers printed as "?" (binutils) are parsed as 0. On success, *end is moved to the colon.
+ * 
+ * @return The number, or -1 if there is no ":<digits>" or ":?" suffix
+ */
+static int parse_number_backwards(char *buf, size_t *end)
+{
+	size_t pos = *end;
+	if ((pos > 1) && (buf[pos-1] == '?') && (buf[pos-2] == ':')) {
+		*end = pos - 2;
+		return 0;
+	}
+	while ((pos > 0) && (buf[pos-1] >= '0') && (buf[pos-1] <= '9')) pos--;
+	if ((pos == *end) || (pos == 0) || (buf[pos-1] != ':')) return -1;
+
+	int value = 0;
+	for (size_t i = pos; i < *end; ++i) value = value * 10 + (buf[i] - '0');
+	*end = pos - 1;
+	return value;
+}
+
+/**
+ * parse_source_location
+ * 
+ * Parse the second line of an addr2line record in a single backwards pass. The accepted forms are 
+ * "file:line:column" (elfutils), "file:line" and "file:line (discriminator N)" (binutils). 
+ * The buffer is truncated in place so that it only holds the file name.
+ * 
+ * @param buf The line (modified in place)
+ * @param len Length of the line
+ * @param has_column Flag to indicate if the backend prints column numbers
+ * @param[out] line Line number (0 if unknown)
+ * @param[out] column Column number (0 if unknown)
+ */
+void parse_source_location(char *buf, size_t len, int has_column, int *line, int *column)
+{
+	*line = *column = 0;
+
+	// Drop the " (discriminator N)" suffix
+	if ((len > 0) && (buf[len-1] == ')'))
+	{
+		char *suffix = memchr(buf, '(', len);
+		if ((suffix != NULL) && (suffix > buf) && (suffix[-1] == ' ')) len = (suffix - 1) - buf;
+	}
+
+	int last = parse_number_backwards(buf, &len);
+	if (last >= 0)
+	{
+		int previous = (has_column ? parse_number_backwards(buf, &len) : -1);
+		if (previous >= 0) {
+			*line = previous;
+			*column = last;
+		}
+		else *line = last;
+	}
+	buf[len] = '\0';
+}
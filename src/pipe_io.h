@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define PIPE_CAPACITY     (1024 * 1024) // Requested capacity of the pipes to the addr2line commands (F_SETPIPE_SZ)
+#define READER_CAPACITY   (64 * 1024)   // Initial size of the read buffer, grown on demand for longer lines
+#define WRITER_CAPACITY   (64 * 1024)   // Size of the write-coalescing buffer
+
+/**
+ * Buffered reader that returns the output of an addr2line command line by line.
+ * The buffer is used as a ring: consumed bytes are reclaimed by moving the pending
+ * bytes to the front, and it grows when a single line does not fit.
+ */
+typedef struct line_reader {
+	int fd;
+	char *buffer;
+	size_t capacity;
+	size_t head;         // Start of the unread data
+	size_t tail;         // End of the unread data
+} line_reader_t;
+
+/**
+ * Buffer that coalesces the addresses written to an addr2line command into a single write.
+ */
+typedef struct line_writer {
+	int fd;
+	char buffer[WRITER_CAPACITY];
+	size_t size;
+} line_writer_t;
+
+// Internal to libaddr2line: hidden so that they do not clash with the symbols of the traced application
+#pragma GCC visibility push(hidden)
+
+line_reader_t * reader_open(int fd);
+char * reader_getline(line_reader_t *reader, size_t *len);
+void reader_close(line_reader_t *reader);
+
+ssize_t write_with_retry(int fd, const void *buf, size_t count);
+void writer_init(line_writer_t *writer, int fd);
+void writer_append_address(line_writer_t *writer, void *address);
+void writer_flush(line_writer_t *writer);
+
+int format_address(char *buf, void *address);
+void set_pipe_capacity(int fd);
+void parse_source_location(char *buf, size_t len, int has_column, int *line, int *column);
+
+#pragma GCC visibility pop
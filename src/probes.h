@@ -0,0 +1,37 @@
+#pragma once
+
+#include "config.h"
+
+/**
+ * USDT static probes, to profile the translation path of a running job with perf or bpftrace without
+ * rebuilding, e.g.:
+ *
+ *   bpftrace -e 'usdt:/path/to/libaddr2line.so:libaddr2line:spawn__start { @t[tid] = nsecs; }
+ *                usdt:/path/to/libaddr2line.so:libaddr2line:spawn__end   { @spawn = hist(nsecs - @t[tid]); }'
+ *
+ * An enabled probe is a single nop plus a note in the .note.stapsdt section describing where its arguments
+ * live, so it costs nothing until a tracer attaches. When sys/sdt.h is not available at configure time (or
+ * --disable-probes is given) the probes expand to nothing and their arguments are not even evaluated.
+ *
+ * Provider libaddr2line (backend is the index of the addr2line command, pid the one of the child process):
+ *   spawn__start(backend, object)                     Before forking an addr2line command for the object or maps file
+ *   spawn__end(backend, object, pid)                  The command is running and its pipes are set up
+ *   request__write(backend, pid, object, address, n)  n addresses were written to the command, starting with address
+ *   response__received(backend, pid, address, translated, function)  The record of an address was read and parsed
+ *   cache__hit(cache, address) / cache__miss(cache, address)         Lookup in the "stack", "multi" or "range" translation caches
+ *
+ * Provider libmaps:
+ *   maps__parse__start(maps_file)                     Before reading a maps file
+ *   maps__parse__end(maps_file, num_entries)          The mappings are classified and their symbol tables loaded
+ *
+ * Provider libsymtab:
+ *   symtab__load__start(path, kind)                   Before reading a symbol table (first read or reload after eviction)
+ *   symtab__load__end(path, num_entries, bytes)       The symbols are sorted and accounted
+ *   symtab__evict(path, bytes)                        The symbols were freed to honour the memory budget
+ */
+#if defined(HAVE_USDT_PROBES)
+# include <sys/sdt.h>
+# define PROBE(provider, name, ...) STAP_PROBEV(provider, name, __VA_ARGS__)
+#else
+# define PROBE(provider, name, ...) do { } while (0)
+#endif
@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #if defined(HAVE_ELFUTILS)
 # include <libelf.h>
 # include <gelf.h>
@@ -11,10 +12,101 @@
 #include <stdlib.h>
 #include <string.h>
 #include "symtab.h"
+#include "probes.h"
 
 #define FILTER_DATA_OBJECTS     // Define this to exclude non-data objects from the symtab dump
 #define SKIP_ZERO_SIZED_SYMBOLS // Define this to exclude zero-sized objects from the symtab dump
 
+#define POOL_BLOCK_SIZE (64 * 1024) // Size of the blocks of the string pool (longer names get a block of their own)
+
+/*
+ * Memory budget of the symbol tables. All resident symbol tables are kept in a list ordered by
+ * last use. When the budget is exceeded, the least recently used ones that are not pinned are 
+ * evicted: their symbols are freed, while the symtab_t structure stays valid for its owners and
+ * is transparently read again on its next lookup. Lookups pin the symbol table while they search
+ * it, so the lock is only held to load the symbols and update the list (see acquire_symbols).
+ */
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static symtab_stats_t budget_stats;
+static symtab_t *lru_head = NULL;
+static symtab_t *lru_tail = NULL;
+
+#if defined(HAVE_CXA_DEMANGLE)
+// Provided by the C++ runtime (libstdc++), with C linkage as mandated by the Itanium C++ ABI
+extern char *__cxa_demangle(const char *mangled_name, char *output_buffer, size_t *length, int *status);
+#endif
+
+/**
+ * account_memory
+ * 
+ * Add the given bytes to the memory used by a symbol table and to the process-wide accounting.
+ */
+static void account_memory(symtab_t *symtab, size_t bytes)
+{
+    symtab->memory += bytes;
+    size_t resident = __atomic_add_fetch(&budget_stats.resident_bytes, bytes, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&budget_stats.peak_bytes, __ATOMIC_RELAXED);
+    while ((resident > peak) && (!__atomic_compare_exchange_n(&budget_stats.peak_bytes, &peak, resident, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)));
+}
+
+/**
+ * pool_strndup
+ * 
+ * Copy a string into the string pool of the symbol table. Blocks are never moved, so the copies 
+ * remain valid until the symbol table is freed.
+ * 
+ * @param symtab The symbol table that owns the pool
+ * @param str The string to copy
+ * @param len Length of the string
+ * @return The pooled copy, or NULL if out of memory
+ */
+static char * pool_strndup(symtab_t *symtab, const char *str, size_t len)
+{
+    symtab_pool_block_t *block = symtab->pool;
+
+    if ((block == NULL) || (block->capacity - block->used < len + 1))
+    {
+        size_t capacity = (len + 1 > POOL_BLOCK_SIZE ? len + 1 : POOL_BLOCK_SIZE);
+        block = malloc(sizeof(symtab_pool_block_t) + capacity);
+        if (block == NULL) return NULL;
+        block->used = 0;
+        block->capacity = capacity;
+        block->next = symtab->pool;
+        symtab->pool = block;
+        account_memory(symtab, sizeof(symtab_pool_block_t) + capacity);
+    }
+    char *copy = block->data + block->used;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+    return copy;
+}
+
+/**
+ * demangle_entry
+ * 
+ * Demangle the name of a symbol and cache the result in the entry. Names that are not mangled 
+ * C++ symbols, or that can not be demangled, are cached as themselves so that they are not retried.
+ * 
+ * @param symtab The symbol table that owns the entry
+ * @param entry The symbol to demangle
+ * @return The demangled name
+ */
+static char * demangle_entry(symtab_t *symtab, symtab_entry_t *entry)
+{
+    char *demangled = NULL;
+#if defined(HAVE_CXA_DEMANGLE)
+    if ((entry->name[0] == '_') && (entry->name[1] == 'Z'))
+    {
+        int status = 0;
+        char *buffer = __cxa_demangle(entry->name, NULL, NULL, &status);
+        if ((status == 0) && (buffer != NULL)) demangled = pool_strndup(symtab, buffer, strlen(buffer));
+        free(buffer);
+    }
+#endif
+    return (demangled != NULL ? demangled : entry->name);
+}
+
 /**
  * read_symtab_with_libelf
  * 
@@ -22,10 +114,11 @@
  * The defines FILTER_DATA_OBJECTS and SKIP_ZERO_SIZED_SYMBOLS can be used to exclude certain types of symbols.
  * 
  * @param binary_path The path to the binary file
+ * @param filter_kind Kind of symbols to keep (SYMTAB_DATA_OBJECTS or SYMTAB_FUNCTIONS)
  * @param symtab_out Pointer to an empty symtab_t structure to store the symbol table
  */
 #if defined(HAVE_ELFUTILS)
-static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
+static void read_symtab_with_libelf(char *binary_path, int filter_kind, symtab_t **symtab_out)
 {
     Elf             *elf = NULL;
     Elf_Scn         *scn = NULL;
@@ -46,8 +139,10 @@ static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
     elf = elf_begin(fd, ELF_C_READ, NULL);
     if (elf != NULL) 
     {
-        // Find the .symtab section
+        // Find the .symtab section, or the .dynsym section for stripped objects
         int found_symtab = 0;
+        Elf_Scn *dynsym = NULL;
+        GElf_Shdr dynsym_shdr;
         while (((scn = elf_nextscn(elf, scn)) != NULL) && (!found_symtab)) {
             gelf_getshdr(scn, &shdr);
             if (shdr.sh_type == SHT_SYMTAB) {
@@ -55,6 +150,15 @@ static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
                 found_symtab = 1;
                 break;
             }
+            else if ((shdr.sh_type == SHT_DYNSYM) && (dynsym == NULL)) {
+                dynsym = scn;
+                dynsym_shdr = shdr;
+            }
+        }
+        if ((!found_symtab) && (dynsym != NULL)) {
+            scn = dynsym;
+            shdr = dynsym_shdr;
+            found_symtab = 1;
         }
 
         if (found_symtab) 
@@ -73,7 +177,7 @@ static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
                         GElf_Sym sym;
                         gelf_getsym(data, i, &sym);
 
-                        // Exclude non-data objects and zero-sized symbols
+                        // Exclude symbols of other kinds and zero-sized symbols
                         int filter = 0;
 #if defined(FILTER_DATA_OBJECTS)
 #if 0
@@ -94,7 +198,10 @@ static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
                         #define STT_HIPROC      15              /* End of processor-specific */
 #endif
                         int sym_type = GELF_ST_TYPE(sym.st_info);
-                        if ((sym_type != STT_OBJECT) && (sym_type != STT_COMMON) && (sym_type != STT_TLS)) filter = 1;
+                        if (filter_kind == SYMTAB_FUNCTIONS) {
+                            if ((sym_type != STT_FUNC) && (sym_type != STT_GNU_IFUNC)) filter = 1;
+                        }
+                        else if ((sym_type != STT_OBJECT) && (sym_type != STT_COMMON) && (sym_type != STT_TLS)) filter = 1;
 #endif
 #if defined(SKIP_ZERO_SIZED_SYMBOLS)
                         if ((!sym.st_value) || (!sym.st_size)) filter = 1;
@@ -102,7 +209,11 @@ static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
                         if (!filter)
                         {
                             // Copy the symbol name and address range
-                            symtab_entries[unfiltered].name = strdup(elf_strptr(elf, shdr.sh_link, sym.st_name));
+                            char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+                            if (name == NULL) continue;
+                            symtab_entries[unfiltered].name = pool_strndup(*symtab_out, name, strlen(name));
+                            if (symtab_entries[unfiltered].name == NULL) continue;
+                            symtab_entries[unfiltered].demangled = NULL;
                             symtab_entries[unfiltered].start = sym.st_value;
                             symtab_entries[unfiltered].size = sym.st_size;
                             symtab_entries[unfiltered].end = sym.st_value + sym.st_size;
@@ -137,16 +248,249 @@ static void read_symtab_with_libelf(char *binary_path, symtab_t **symtab_out)
 }
 #endif
 
+/**
+ * compare_entries
+ * 
+ * Order symbols by start address, then by end address (so that aliases are adjacent).
+ */
+static int compare_entries(const void *a, const void *b)
+{
+    const symtab_entry_t *sa = (const symtab_entry_t *)a;
+    const symtab_entry_t *sb = (const symtab_entry_t *)b;
+    if (sa->start != sb->start) return (sa->start < sb->start ? -1 : 1);
+    if (sa->end != sb->end) return (sa->end < sb->end ? -1 : 1);
+    return 0;
+}
+
+/**
+ * sort_entries
+ * 
+ * Sort the symbols by address and compute the running maximum end, so that lookups can
+ * binary search the last symbol that starts before the address and walk back only over
+ * the symbols that may still contain it.
+ * 
+ * @param symtab The symtab_t structure to sort
+ */
+static void sort_entries(symtab_t *symtab)
+{
+    if (symtab->num_entries <= 0) return;
+
+    qsort(symtab->entries, symtab->num_entries, sizeof(symtab_entry_t), compare_entries);
+
+    unsigned long max_end = 0;
+    for (int i = 0; i < symtab->num_entries; ++i) {
+        if (symtab->entries[i].end > max_end) max_end = symtab->entries[i].end;
+        symtab->entries[i].max_end = max_end;
+    }
+}
+
+/**
+ * lru_unlink
+ * 
+ * Remove a symbol table from the list of resident symbol tables (budget_lock must be held).
+ */
+static void lru_unlink(symtab_t *symtab)
+{
+    if (symtab->lru_prev != NULL) symtab->lru_prev->lru_next = symtab->lru_next;
+    else if (lru_head == symtab) lru_head = symtab->lru_next;
+    if (symtab->lru_next != NULL) symtab->lru_next->lru_prev = symtab->lru_prev;
+    else if (lru_tail == symtab) lru_tail = symtab->lru_prev;
+    symtab->lru_prev = symtab->lru_next = NULL;
+}
+
+/**
+ * lru_touch
+ * 
+ * Move a resident symbol table to the front of the list, as the most recently used (budget_lock must be held).
+ */
+static void lru_touch(symtab_t *symtab)
+{
+    if (lru_head == symtab) return;
+    lru_unlink(symtab);
+    symtab->lru_next = lru_head;
+    if (lru_head != NULL) lru_head->lru_prev = symtab;
+    lru_head = symtab;
+    if (lru_tail == NULL) lru_tail = symtab;
+}
+
+/**
+ * read_symbols
+ * 
+ * Read the symbols of a symbol table that is not resident, either for the first time or after an eviction.
+ */
+static void read_symbols(symtab_t *symtab)
+{
+    PROBE(libsymtab, symtab__load__start, symtab->path, symtab->kind);
+#if defined(HAVE_ELFUTILS)
+    read_symtab_with_libelf(symtab->path, symtab->kind, &symtab);
+#else
+# error "Symbol table dumping is only implemented using libelf. Enable elfutils support at configure time using --with-elfutils-addr2line"
+#endif
+    sort_entries(symtab);
+
+    // Demangle all names upfront, so that lookups never have to
+    if (symtab->options & SYMTAB_DEMANGLE)
+    {
+        for (int i = 0; i < symtab->num_entries; ++i) {
+            symtab->entries[i].demangled = demangle_entry(symtab, &symtab->entries[i]);
+        }
+    }
+    account_memory(symtab, symtab->num_entries * sizeof(symtab_entry_t));
+    PROBE(libsymtab, symtab__load__end, symtab->path, symtab->num_entries, symtab->memory);
+}
+
+/**
+ * register_symbols
+ * 
+ * Mark the symbols just read as resident (budget_lock must be held).
+ */
+static void register_symbols(symtab_t *symtab)
+{
+    __atomic_store_n(&symtab->is_loaded, 1, __ATOMIC_RELEASE);
+    budget_stats.num_resident ++;
+    lru_touch(symtab);
+}
+
+/**
+ * load_symbols
+ * 
+ * Read again the symbols of an evicted symbol table (budget_lock must be held).
+ */
+static void load_symbols(symtab_t *symtab)
+{
+    if (symtab->is_loaded) return;
+    read_symbols(symtab);
+    register_symbols(symtab);
+    budget_stats.num_reloads ++;
+}
+
+/**
+ * unload_symbols
+ * 
+ * Free the symbols of a resident symbol table and remove them from the accounting (budget_lock must be held).
+ */
+static void unload_symbols(symtab_t *symtab)
+{
+    if (!symtab->is_loaded) return;
+
+    lru_unlink(symtab);
+    free(symtab->entries);
+    symtab->entries = NULL;
+    symtab->num_entries = 0;
+    while (symtab->pool != NULL) {
+        symtab_pool_block_t *next = symtab->pool->next;
+        free(symtab->pool);
+        symtab->pool = next;
+    }
+    free(symtab->names);
+    free(symtab->name_buckets);
+    free(symtab->name_next);
+    symtab->names = NULL;
+    symtab->name_buckets = symtab->name_next = NULL;
+    symtab->num_name_buckets = 0;
+    __atomic_sub_fetch(&budget_stats.resident_bytes, symtab->memory, __ATOMIC_RELAXED);
+    PROBE(libsymtab, symtab__evict, symtab->path, symtab->memory);
+    symtab->memory = 0;
+    __atomic_store_n(&symtab->is_loaded, 0, __ATOMIC_RELEASE);
+    budget_stats.num_resident --;
+}
+
+/**
+ * enforce_budget
+ * 
+ * Evict the least recently used symbol tables that are not pinned until the resident ones fit 
+ * in the budget (budget_lock must be held). The symbol table in use is never evicted, so a single
+ * symbol table larger than the budget stays resident while it is used.
+ * 
+ * @param in_use The symbol table being used by the caller (may be NULL)
+ */
+static void enforce_budget(symtab_t *in_use)
+{
+    if (budget_stats.budget == 0) return;
+
+    symtab_t *victim = lru_tail;
+    while ((victim != NULL) && (budget_stats.resident_bytes > budget_stats.budget))
+    {
+        symtab_t *previous = victim->lru_prev;
+        if ((victim != in_use) && (victim->pins == 0)) {
+            unload_symbols(victim);
+            budget_stats.num_evictions ++;
+        }
+        victim = previous;
+    }
+}
+
+/**
+ * acquire_symbols
+ * 
+ * Make the symbols of a symbol table resident for a lookup. With a budget (or after an eviction), the
+ * budget lock is only held to load the symbols and move them to the front of the list, and the symbol
+ * table is pinned so that the lookup itself runs without the lock. Without a budget nothing is ever
+ * evicted, so lookups do not need to serialize at all.
+ * 
+ * @param symtab The symbol table to look up
+ * @return 1 if the symbol table was pinned, 0 otherwise (to be given to release_symbols)
+ */
+static int acquire_symbols(symtab_t *symtab)
+{
+    int has_budget = (__atomic_load_n(&budget_stats.budget, __ATOMIC_ACQUIRE) > 0) || (!__atomic_load_n(&symtab->is_loaded, __ATOMIC_ACQUIRE));
+    if (!has_budget) return 0;
+
+    pthread_mutex_lock(&budget_lock);
+    if (!symtab->is_loaded) {
+        load_symbols(symtab);
+        enforce_budget(symtab);
+    }
+    symtab->pins ++;
+    lru_touch(symtab);
+    pthread_mutex_unlock(&budget_lock);
+    return 1;
+}
+
+/**
+ * release_symbols
+ * 
+ * Undo the pin taken by acquire_symbols once the lookup is over. The budget is not enforced here, so
+ * that a symbol table larger than the budget stays resident until another one is loaded.
+ * 
+ * @param symtab The symbol table looked up
+ * @param pinned Value returned by acquire_symbols
+ */
+static void release_symbols(symtab_t *symtab, int pinned)
+{
+    if (!pinned) return;
+
+    pthread_mutex_lock(&budget_lock);
+    symtab->pins --;
+    pthread_mutex_unlock(&budget_lock);
+}
+
 /**
  * symtab_read
  *
- * Read the symbol table from a binary file.
- * Currently this operation is only supported through libelf.
+ * Read the data objects from the symbol table of a binary file.
  *
  * @param binary_path The path to the binary file
  * @return A symtab_t structure containing the symbol table, or NULL if an error occurred
  */
 symtab_t *symtab_read(char *binary_path)
+{
+    return symtab_read_filtered(binary_path, SYMTAB_DATA_OBJECTS);
+}
+
+/**
+ * symtab_read_filtered
+ *
+ * Read the symbol table from a binary file, keeping only the given kind of symbols.
+ * Stripped objects fall back to their dynamic symbols (.dynsym). The symbols are sorted by address.
+ * Currently this operation is only supported through libelf.
+ *
+ * @param binary_path The path to the binary file
+ * @param filter SYMTAB_DATA_OBJECTS to keep data objects, or SYMTAB_FUNCTIONS to keep code objects, 
+ *               optionally combined with SYMTAB_DEMANGLE or SYMTAB_DEMANGLE_LAZY to demangle the names
+ * @return A symtab_t structure containing the symbol table, or NULL if an error occurred
+ */
+symtab_t *symtab_read_filtered(char *binary_path, int filter)
 {
     symtab_t *symtab = malloc(sizeof(symtab_t));
 
@@ -154,40 +498,218 @@ symtab_t *symtab_read(char *binary_path)
     {
         symtab->entries = NULL;
         symtab->num_entries = 0;
+        symtab->refcount = 1;
+        symtab->options = filter & ~SYMTAB_KIND_MASK;
+        symtab->pool = NULL;
+        pthread_mutex_init(&symtab->lock, NULL);
+        symtab->path = (binary_path != NULL ? strdup(binary_path) : NULL);
+        symtab->kind = filter & SYMTAB_KIND_MASK;
+        symtab->is_loaded = 0;
+        symtab->pins = 0;
+        symtab->memory = 0;
+        symtab->lru_prev = symtab->lru_next = NULL;
+        symtab->names = NULL;
+        symtab->name_buckets = symtab->name_next = NULL;
+        symtab->num_name_buckets = 0;
+
+        // The symbols are read out of the lock, as the symbol table is not shared yet
+        read_symbols(symtab);
+        pthread_mutex_lock(&budget_lock);
+        register_symbols(symtab);
+        enforce_budget(symtab);
+        pthread_mutex_unlock(&budget_lock);
+    }
+    return symtab;
+}
+
+/**
+ * build_id_debug_file_exists
+ *
+ * Check if the separate debug file referenced by the NT_GNU_BUILD_ID note is installed
+ * under /usr/lib/debug/.build-id, where the addr2line backends look it up.
+ *
+ * @param elf The ELF descriptor of the binary
+ * @param scn The SHT_NOTE section to inspect
+ * @return 1 if the debug file exists, 0 otherwise
+ */
 #if defined(HAVE_ELFUTILS)
-        read_symtab_with_libelf(binary_path, &symtab);
-#else
-# error "Symbol table dumping is only implemented using libelf. Enable elfutils support at configure time using --with-elfutils-addr2line"
+static int build_id_debug_file_exists(Elf *elf, Elf_Scn *scn)
+{
+    Elf_Data *data = elf_getdata(scn, NULL);
+    size_t offset = 0, name_offset = 0, desc_offset = 0;
+    GElf_Nhdr nhdr;
+
+    if (data == NULL) return 0;
+
+    while ((offset = gelf_getnote(data, offset, &nhdr, &name_offset, &desc_offset)) > 0)
+    {
+        if ((nhdr.n_type == NT_GNU_BUILD_ID) && (nhdr.n_namesz == 4) && (!memcmp((char *)data->d_buf + name_offset, "GNU", 4)) && (nhdr.n_descsz > 1))
+        {
+            // The debug file is named after the hex build-id, with the first byte as the subdirectory
+            unsigned char *build_id = (unsigned char *)data->d_buf + desc_offset;
+            char debug_path[BUFSIZ];
+            int len = snprintf(debug_path, sizeof(debug_path), "/usr/lib/debug/.build-id/%02x/", build_id[0]);
+            for (unsigned int i = 1; i < nhdr.n_descsz; ++i) {
+                len += snprintf(debug_path + len, sizeof(debug_path) - len, "%02x", build_id[i]);
+            }
+            snprintf(debug_path + len, sizeof(debug_path) - len, ".debug");
+            return (access(debug_path, R_OK) == 0);
+        }
+    }
+    return 0;
+}
+
+/**
+ * debuglink_file_exists
+ *
+ * Check if the separate debug file named by the .gnu_debuglink section is installed in one of the
+ * places where the addr2line backends look it up: next to the binary, in its .debug subdirectory, 
+ * or under /usr/lib/debug followed by the directory of the binary.
+ *
+ * @param binary_path The path to the binary file
+ * @param scn The .gnu_debuglink section
+ */
+static int debuglink_file_exists(char *binary_path, Elf_Scn *scn)
+{
+    Elf_Data *data = elf_getdata(scn, NULL);
+    if ((data == NULL) || (data->d_size == 0) || (memchr(data->d_buf, '\0', data->d_size) == NULL)) return 0;
+
+    // The section holds the file name, padded and followed by its CRC (not checked, as by the backends)
+    const char *debug_name = (const char *)data->d_buf;
+    const char *slash = strrchr(binary_path, '/');
+    char dir[BUFSIZ] = ".";
+    if (slash != NULL) snprintf(dir, sizeof(dir), "%.*s", (int)(slash - binary_path), binary_path);
+
+    char debug_path[2 * BUFSIZ];
+    snprintf(debug_path, sizeof(debug_path), "%s/%s", dir, debug_name);
+    if ((strcmp(debug_path, binary_path) != 0) && (access(debug_path, R_OK) == 0)) return 1;
+    snprintf(debug_path, sizeof(debug_path), "%s/.debug/%s", dir, debug_name);
+    if (access(debug_path, R_OK) == 0) return 1;
+    snprintf(debug_path, sizeof(debug_path), "/usr/lib/debug%s/%s", dir, debug_name);
+    return ((binary_path[0] == '/') && (access(debug_path, R_OK) == 0));
+}
 #endif
+
+/**
+ * symtab_debug_info
+ *
+ * Check which kind of debugging information is available for the given binary,
+ * either embedded in its own DWARF sections or installed as a separate debug file
+ * (found through its build-id note or its .gnu_debuglink section).
+ *
+ * @param binary_path The path to the binary file
+ * @return Bitmask of SYMTAB_HAS_DEBUG_INFO and SYMTAB_HAS_DEBUG_NAMES, 0 if none is available
+ */
+int symtab_debug_info(char *binary_path)
+{
+    int debug_info = 0;
+#if defined(HAVE_ELFUTILS)
+    Elf       *elf = NULL;
+    Elf_Scn   *scn = NULL;
+    GElf_Shdr  shdr;
+    size_t     shstrndx = 0;
+    int        fd = -1;
+
+    if (binary_path == NULL) return 0;
+
+    elf_version(EV_CURRENT);
+
+    fd = open(binary_path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    elf = elf_begin(fd, ELF_C_READ, NULL);
+    if ((elf != NULL) && (elf_getshdrstrndx(elf, &shstrndx) == 0))
+    {
+        while ((scn = elf_nextscn(elf, scn)) != NULL)
+        {
+            if (gelf_getshdr(scn, &shdr) == NULL) continue;
+
+            char *name = elf_strptr(elf, shstrndx, shdr.sh_name);
+            if (name == NULL) continue;
+
+            if ((!strcmp(name, ".debug_info")) || (!strcmp(name, ".zdebug_info"))) {
+                debug_info |= SYMTAB_HAS_DEBUG_INFO;
+            }
+            else if (!strcmp(name, ".debug_names")) {
+                debug_info |= SYMTAB_HAS_DEBUG_NAMES;
+            }
+            else if ((shdr.sh_type == SHT_NOTE) && (!(debug_info & SYMTAB_HAS_DEBUG_INFO))) {
+                if (build_id_debug_file_exists(elf, scn)) debug_info |= SYMTAB_HAS_DEBUG_INFO;
+            }
+            else if ((!strcmp(name, ".gnu_debuglink")) && (!(debug_info & SYMTAB_HAS_DEBUG_INFO))) {
+                if (debuglink_file_exists(binary_path, scn)) debug_info |= SYMTAB_HAS_DEBUG_INFO;
+            }
+        }
     }
-    return symtab;
+    if (elf != NULL) elf_end(elf);
+    close(fd);
+#endif
+    return debug_info;
 }
 
 /**
  * symtab_find_symbol
  * 
  * Find the symbol that contains the given address in the provided symtab_t structure.
+ * Binary search of the last symbol starting at or before the address, then walk back while
+ * the preceding symbols may still contain it (see sort_entries). When symbols are nested,
+ * the innermost one (the closest start) wins.
  * 
  * @param symtab The symtab_t structure containing the symbol table
  * @param addr The address to look up
  * @return The name of the symbol containing the address, or NULL if not found
  */
-static char * symtab_find_symbol(symtab_t *symtab, unsigned long addr)
+static symtab_entry_t * symtab_find_symbol(symtab_t *symtab, unsigned long addr)
 {
-    int i;
-    for (i = 0; i < symtab->num_entries; ++i) {
-        if ((addr >= symtab->entries[i].start) && (addr < symtab->entries[i].end)) {
-            return symtab->entries[i].name;
+    int low = 0, high = symtab->num_entries - 1, last = -1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (symtab->entries[mid].start <= addr) {
+            last = mid;
+            low = mid + 1;
         }
+        else high = mid - 1;
+    }
+
+    for (int i = last; (i >= 0) && (symtab->entries[i].max_end > addr); --i) {
+        if (addr < symtab->entries[i].end) return &symtab->entries[i];
     }
     return NULL;
 }
 
+/**
+ * symtab_entry_name
+ * 
+ * Get the name of a symbol, demangled if the symbol table was read with SYMTAB_DEMANGLE or SYMTAB_DEMANGLE_LAZY.
+ * Lazily demangled names are computed on the first lookup and cached, so that later lookups cost nothing.
+ * The returned string belongs to the symbol table.
+ * 
+ * @param symtab The symtab_t structure containing the entry
+ * @param entry The symbol
+ * @return The name of the symbol
+ */
+char * symtab_entry_name(symtab_t *symtab, symtab_entry_t *entry)
+{
+    if (!(symtab->options & (SYMTAB_DEMANGLE | SYMTAB_DEMANGLE_LAZY))) return entry->name;
+
+    char *demangled = __atomic_load_n(&entry->demangled, __ATOMIC_ACQUIRE);
+    if (demangled == NULL)
+    {
+        pthread_mutex_lock(&symtab->lock);
+        if ((demangled = entry->demangled) == NULL) {
+            demangled = demangle_entry(symtab, entry);
+            __atomic_store_n(&entry->demangled, demangled, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&symtab->lock);
+    }
+    return demangled;
+}
+
 /**
  * symtab_translate
  *
  * Translate an address to a symbol name using the provided symtab_t structure.
- * TODO: Possibly exted to demangle C++ symbols or prettify them in some other way.
+ * The name is demangled if the symbol table was read with SYMTAB_DEMANGLE or SYMTAB_DEMANGLE_LAZY.
  *
  * @param symtab The symtab_t structure containing the symbol table
  * @param addr The address to look up
@@ -196,29 +718,326 @@ static char * symtab_find_symbol(symtab_t *symtab, unsigned long addr)
 char * symtab_translate(symtab_t *symtab, unsigned long addr)
 {
     char *symbol = NULL;
-    if (symtab != NULL) {
-        symbol = symtab_find_symbol(symtab, addr);
+    if (symtab == NULL) return strdup(UNKNOWN_SYMBOL);
+
+    int pinned = acquire_symbols(symtab);
+
+    symtab_entry_t *entry = symtab_find_symbol(symtab, addr);
+    if (entry != NULL) symbol = symtab_entry_name(symtab, entry);
+    symbol = strdup((symbol == NULL ? UNKNOWN_SYMBOL : symbol));
+
+    release_symbols(symtab, pinned);
+    return symbol;
+}
+
+/**
+ * symtab_lookup_range
+ *
+ * Find the extent of the symbol containing an address, i.e. the [start, start + size) range
+ * given by its ELF symbol, so that callers can tell which other addresses share the symbol.
+ *
+ * @param symtab The symtab_t structure containing the symbol table
+ * @param addr The address to look up
+ * @param[out] start Start address of the symbol
+ * @param[out] end End address of the symbol (exclusive)
+ * @return 1 if a symbol contains the address, 0 otherwise
+ */
+int symtab_lookup_range(symtab_t *symtab, unsigned long addr, unsigned long *start, unsigned long *end)
+{
+    if (symtab == NULL) return 0;
+
+    int pinned = acquire_symbols(symtab);
+
+    symtab_entry_t *entry = symtab_find_symbol(symtab, addr);
+    if (entry != NULL) {
+        *start = entry->start;
+        *end = entry->end;
     }
-    return strdup((symbol == NULL ? UNKNOWN_SYMBOL : symbol));
+
+    release_symbols(symtab, pinned);
+    return (entry != NULL);
+}
+
+/**
+ * name_hash
+ *
+ * FNV-1a hash of the first len characters of a string.
+ */
+static unsigned int name_hash(const char *str, size_t len)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * compare_names
+ *
+ * Order names alphabetically, then by address (the index of the entry).
+ */
+static int compare_names(const void *a, const void *b)
+{
+    const symtab_name_t *na = (const symtab_name_t *)a;
+    const symtab_name_t *nb = (const symtab_name_t *)b;
+    int cmp = strcmp(na->name, nb->name);
+    if (cmp != 0) return cmp;
+    return (na->entry < nb->entry ? -1 : (na->entry > nb->entry ? 1 : 0));
+}
+
+/**
+ * build_name_index
+ *
+ * Build the index of the symbols by name: the names sorted alphabetically for prefix and wildcard
+ * lookups, and a hash table over them for exact lookups (symtab->lock must be held). If the symbol
+ * table demangles names, all of them are demangled now and the demangled names are indexed. The
+ * index is part of the resident symbols, so it is accounted and freed with them on eviction.
+ *
+ * @param symtab The symbol table to index
+ * @return 0 on success, -1 if out of memory
+ */
+static int build_name_index(symtab_t *symtab)
+{
+    int num_entries = symtab->num_entries;
+    int num_buckets = 1;
+    while (num_buckets < num_entries) num_buckets <<= 1;
+
+    symtab_name_t *names = malloc(num_entries * sizeof(symtab_name_t));
+    int *buckets = malloc(num_buckets * sizeof(int));
+    int *next = malloc(num_entries * sizeof(int));
+    if ((names == NULL) || (buckets == NULL) || (next == NULL)) {
+        free(names);
+        free(buckets);
+        free(next);
+        return -1;
+    }
+
+    for (int i = 0; i < num_entries; ++i)
+    {
+        symtab_entry_t *entry = &symtab->entries[i];
+        if ((symtab->options & (SYMTAB_DEMANGLE | SYMTAB_DEMANGLE_LAZY)) && (entry->demangled == NULL)) {
+            __atomic_store_n(&entry->demangled, demangle_entry(symtab, entry), __ATOMIC_RELEASE);
+        }
+        names[i].name = ((symtab->options & (SYMTAB_DEMANGLE | SYMTAB_DEMANGLE_LAZY)) ? entry->demangled : entry->name);
+        names[i].entry = i;
+    }
+    qsort(names, num_entries, sizeof(symtab_name_t), compare_names);
+
+    memset(buckets, -1, num_buckets * sizeof(int));
+    for (int i = num_entries - 1; i >= 0; --i)
+    {
+        // Chained in reverse so that each chain lists equal names in address order
+        int bucket = name_hash(names[i].name, strlen(names[i].name)) & (num_buckets - 1);
+        next[i] = buckets[bucket];
+        buckets[bucket] = i;
+    }
+
+    symtab->name_buckets = buckets;
+    symtab->name_next = next;
+    symtab->num_name_buckets = num_buckets;
+    account_memory(symtab, num_entries * (sizeof(symtab_name_t) + sizeof(int)) + num_buckets * sizeof(int));
+    __atomic_store_n(&symtab->names, names, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * find_first_name
+ *
+ * Binary search of the first name in alphabetical order that is not less than the given prefix.
+ */
+static int find_first_name(symtab_t *symtab, const char *prefix, size_t len)
+{
+    int low = 0, high = symtab->num_entries;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (strncmp(symtab->names[mid].name, prefix, len) < 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+/**
+ * symtab_lookup_name
+ *
+ * Find the symbols whose name matches the given pattern. The first lookup builds an index of the
+ * names (see build_name_index), so that exact matches are hash lookups and prefix and wildcard
+ * matches only visit the names sharing the literal prefix of the pattern. Names are matched in their
+ * demangled form if the symbol table was read with SYMTAB_DEMANGLE or SYMTAB_DEMANGLE_LAZY.
+ *
+ * @param symtab The symtab_t structure containing the symbol table
+ * @param pattern The name, prefix or wildcard pattern to look up
+ * @param match SYMTAB_MATCH_EXACT, SYMTAB_MATCH_PREFIX or SYMTAB_MATCH_GLOB
+ * @param[out] matches Array with the indices of the matching entries, in name order (to be freed by the caller,
+ *                     and only valid while the symbol table is resident, see symtab_pin)
+ * @return Number of matching entries, or -1 if out of memory
+ */
+int symtab_lookup_name(symtab_t *symtab, const char *pattern, int match, int **matches)
+{
+    int count = 0, capacity = 0;
+    *matches = NULL;
+    if ((symtab == NULL) || (pattern == NULL)) return 0;
+
+    int pinned = acquire_symbols(symtab);
+
+    if ((symtab->num_entries > 0) && (__atomic_load_n(&symtab->names, __ATOMIC_ACQUIRE) == NULL))
+    {
+        pthread_mutex_lock(&symtab->lock);
+        if (symtab->names == NULL) count = build_name_index(symtab);
+        pthread_mutex_unlock(&symtab->lock);
+    }
+    if ((count < 0) || (symtab->names == NULL)) {
+        release_symbols(symtab, pinned);
+        return count;
+    }
+
+    // Wildcard patterns are looked up through their literal prefix, and exactly if they have no wildcards
+    size_t len = strlen(pattern);
+    if (match == SYMTAB_MATCH_GLOB) {
+        len = strcspn(pattern, "*?[\\");
+        if (pattern[len] == '\0') match = SYMTAB_MATCH_EXACT;
+    }
+
+    int first = -1;
+    if (match == SYMTAB_MATCH_EXACT) first = symtab->name_buckets[name_hash(pattern, len) & (symtab->num_name_buckets - 1)];
+    else first = find_first_name(symtab, pattern, len);
+
+    for (int i = first; (i >= 0) && (i < symtab->num_entries); i = (match == SYMTAB_MATCH_EXACT ? symtab->name_next[i] : i + 1))
+    {
+        const char *name = symtab->names[i].name;
+        if (match == SYMTAB_MATCH_EXACT) {
+            if (strcmp(name, pattern) != 0) continue;
+        }
+        else {
+            if (strncmp(name, pattern, len) != 0) break; // Past the names sharing the prefix
+            if ((match == SYMTAB_MATCH_GLOB) && (fnmatch(pattern, name, 0) != 0)) continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = (capacity == 0 ? 16 : capacity * 2);
+            int *grown = realloc(*matches, capacity * sizeof(int));
+            if (grown == NULL) {
+                free(*matches);
+                *matches = NULL;
+                count = -1;
+                break;
+            }
+            *matches = grown;
+        }
+        (*matches)[count++] = symtab->names[i].entry;
+    }
+
+    release_symbols(symtab, pinned);
+    return count;
+}
+
+/**
+ * symtab_retain
+ * 
+ * Take an additional reference on a symtab_t structure shared by several owners.
+ * Each reference is released with symtab_free.
+ * 
+ * @param symtab The symtab_t structure to share
+ * @return The same symtab_t structure
+ */
+symtab_t * symtab_retain(symtab_t *symtab)
+{
+    if (symtab != NULL) __atomic_add_fetch(&symtab->refcount, 1, __ATOMIC_RELAXED);
+    return symtab;
 }
 
 /**
  * symtab_free
  * 
- * Free the symtab_t structure and its contents.
+ * Release a reference on the symtab_t structure, and free it and its contents when it was the last one.
  * 
  * @param symtab The symtab_t structure to free
  */
 void symtab_free(symtab_t *symtab)
 {
-    if (symtab != NULL) {
-        if (symtab->entries != NULL) {
-            int i = 0;
-            for (i = 0; i < symtab->num_entries; ++i) {
-                free(symtab->entries[i].name);
-            }
-            free(symtab->entries);
-        }
+    if ((symtab != NULL) && (__atomic_sub_fetch(&symtab->refcount, 1, __ATOMIC_ACQ_REL) == 0)) {
+        pthread_mutex_lock(&budget_lock);
+        unload_symbols(symtab);
+        pthread_mutex_unlock(&budget_lock);
+        pthread_mutex_destroy(&symtab->lock);
+        free(symtab->path);
         free(symtab);
     }
 }
+
+/**
+ * symtab_set_budget
+ * 
+ * Set the process-wide memory budget of the symbol tables. When the resident ones exceed it, 
+ * the least recently used are evicted and read again on their next lookup. Without a budget, 
+ * lookups do not take the budget lock, so a budget can only be set while no symbol table is
+ * resident (typically before reading any); once set, it can be changed or removed at any time.
+ * 
+ * @param bytes Maximum bytes of symbol data to keep resident (0 for unlimited, the default)
+ * @return 0 on success, -1 if there was no budget and some symbol tables are already resident
+ */
+int symtab_set_budget(size_t bytes)
+{
+    pthread_mutex_lock(&budget_lock);
+    if ((budget_stats.budget == 0) && (bytes > 0) && (budget_stats.num_resident > 0)) {
+        pthread_mutex_unlock(&budget_lock);
+        return -1;
+    }
+    __atomic_store_n(&budget_stats.budget, bytes, __ATOMIC_RELEASE);
+    enforce_budget(NULL);
+    pthread_mutex_unlock(&budget_lock);
+    return 0;
+}
+
+/**
+ * symtab_get_stats
+ * 
+ * Get the process-wide accounting of the memory used by the symbol tables.
+ * 
+ * @param stats Structure to store the accounting
+ */
+void symtab_get_stats(symtab_stats_t *stats)
+{
+    pthread_mutex_lock(&budget_lock);
+    *stats = budget_stats;
+    pthread_mutex_unlock(&budget_lock);
+}
+
+/**
+ * symtab_pin
+ * 
+ * Make a symbol table resident and keep it from being evicted until symtab_unpin, so that 
+ * its entries can be accessed directly (e.g. through symtab_get_entry or kept pointers to 
+ * their names). Pins nest.
+ * 
+ * @param symtab The symbol table to pin
+ */
+void symtab_pin(symtab_t *symtab)
+{
+    if (symtab == NULL) return;
+
+    pthread_mutex_lock(&budget_lock);
+    load_symbols(symtab);
+    symtab->pins ++;
+    enforce_budget(symtab);
+    pthread_mutex_unlock(&budget_lock);
+}
+
+/**
+ * symtab_unpin
+ * 
+ * Undo a symtab_pin, allowing the symbol table to be evicted again once all pins are undone.
+ * 
+ * @param symtab The symbol table to unpin
+ */
+void symtab_unpin(symtab_t *symtab)
+{
+    if (symtab == NULL) return;
+
+    pthread_mutex_lock(&budget_lock);
+    if (symtab->pins > 0) symtab->pins --;
+    enforce_budget(NULL);
+    pthread_mutex_unlock(&budget_lock);
+}
@@ -1,24 +1,98 @@
 #pragma once
 
+#include <pthread.h>
+#include <stddef.h>
+
 #define UNKNOWN_SYMBOL "??"
 
+// Kind of symbols to read from the symbol table
+#define SYMTAB_DATA_OBJECTS 0 // STT_OBJECT, STT_COMMON and STT_TLS symbols
+#define SYMTAB_FUNCTIONS    1 // STT_FUNC and STT_GNU_IFUNC symbols
+#define SYMTAB_KIND_MASK    0xff
+
+// Demangling of C++ symbol names, combined with the kind of symbols in symtab_read_filtered
+#define SYMTAB_DEMANGLE      (1 << 8) // Demangle all names when the symbol table is read
+#define SYMTAB_DEMANGLE_LAZY (1 << 9) // Demangle each name the first time it is looked up
+
+// Matching of the names in symtab_lookup_name
+#define SYMTAB_MATCH_EXACT  0 // Names equal to the pattern
+#define SYMTAB_MATCH_PREFIX 1 // Names starting with the pattern
+#define SYMTAB_MATCH_GLOB   2 // Names matching the pattern as a shell wildcard (see fnmatch)
+
+// Debugging information available for a binary (see symtab_debug_info)
+#define SYMTAB_HAS_DEBUG_INFO  (1 << 0) // DWARF .debug_info, either embedded or as a separate build-id debug file
+#define SYMTAB_HAS_DEBUG_NAMES (1 << 1) // DWARF 5 .debug_names accelerator table
+
 typedef struct symtab_entry {
     char *name;
+    char *demangled; // Demangled name cached in the string pool (the name itself if not mangled), NULL until demangled
     unsigned long start;
     unsigned int size;
     unsigned long end;
+    unsigned long max_end; // Maximum end among this and the preceding symbols in address order (bounds the lookups)
 } symtab_entry_t;
 
+typedef struct symtab_name {
+    const char *name;  // Name matched by the lookups by name (demangled if the symbol table demangles names)
+    int entry;         // Index of the symbol in the entries array
+} symtab_name_t;
+
+typedef struct symtab_pool_block {
+    struct symtab_pool_block *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} symtab_pool_block_t;
+
 typedef struct symtab {
     symtab_entry_t *entries;
     int num_entries;
+    int refcount;               // Number of owners sharing the symbol table (see symtab_retain)
+    int options;                // SYMTAB_DEMANGLE or SYMTAB_DEMANGLE_LAZY
+    symtab_pool_block_t *pool;  // String pool holding the names and their demangled forms
+    pthread_mutex_t lock;       // Serializes lazy demangling
+
+    char *path;                 // Binary the symbols were read from (to reload them after an eviction)
+    int kind;                   // Kind of symbols read (SYMTAB_DATA_OBJECTS or SYMTAB_FUNCTIONS)
+    int is_loaded;              // Flag to indicate if the symbols are resident (0 after an eviction)
+    int pins;                   // Number of symtab_pin calls not yet undone (pinned symbol tables are never evicted)
+    size_t memory;              // Bytes used by the entries and the string pool while resident
+    struct symtab *lru_prev;    // Neighbours in the list of resident symbol tables, most recently used first
+    struct symtab *lru_next;
+
+    symtab_name_t *names;       // Names sorted alphabetically, built on the first lookup by name (see symtab_lookup_name)
+    int *name_buckets;          // Hash table of the names (index of the first name of each chain, -1 if empty)
+    int *name_next;             // Next name in the same chain
+    int num_name_buckets;       // Number of buckets (power of 2)
 } symtab_t;
 
+/**
+ * Process-wide accounting of the memory used by the symbol tables (see symtab_set_budget).
+ */
+typedef struct symtab_stats {
+    size_t budget;              // Memory budget in bytes (0 if unlimited)
+    size_t resident_bytes;      // Bytes used by the resident symbol tables
+    size_t peak_bytes;          // Highest value of resident_bytes
+    int num_resident;           // Number of resident symbol tables
+    unsigned long num_evictions; // Number of symbol tables evicted to honour the budget
+    unsigned long num_reloads;  // Number of evicted symbol tables read again on use
+} symtab_stats_t;
+
 symtab_t * symtab_read(char *binary_path);
+symtab_t * symtab_read_filtered(char *binary_path, int filter);
+int symtab_debug_info(char *binary_path);
 char * symtab_translate(symtab_t *symtab, unsigned long addr);
+int symtab_lookup_range(symtab_t *symtab, unsigned long addr, unsigned long *start, unsigned long *end);
+char * symtab_entry_name(symtab_t *symtab, symtab_entry_t *entry);
+int symtab_lookup_name(symtab_t *symtab, const char *pattern, int match, int **matches);
+symtab_t * symtab_retain(symtab_t *symtab);
 void symtab_free(symtab_t *symtab);
+int symtab_set_budget(size_t bytes);
+void symtab_get_stats(symtab_stats_t *stats);
+void symtab_pin(symtab_t *symtab);
+void symtab_unpin(symtab_t *symtab);
 
-// Macros to iterate over the symtab_t structure
+// Macros to iterate over the symtab_t structure (the symbol table must be pinned if a budget is set, see symtab_pin)
 #define symtab_count(symtab) (symtab != NULL ? symtab->num_entries : 0)
 #define symtab_get_entry(symtab, i) (symtab != NULL && i >= 0 && i < symtab->num_entries ? &symtab->entries[i] : NULL)  
 
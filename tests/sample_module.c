@@ -0,0 +1,7 @@
+/**
+ * Object loaded with dlopen by the tests, to change the mappings of the test process.
+ */
+__attribute__((noinline)) int sample_module_function(int x)
+{
+    return x * 7 + 1;
+}
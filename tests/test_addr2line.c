@@ -0,0 +1,501 @@
+#define _GNU_SOURCE // dlinfo
+
+#include <dlfcn.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "addr2line.h"
+#include "tests.h"
+
+#define SCHEDULED_ADDRESSES 64
+#define ASYNC_REQUESTS 256
+#define STACK_DEPTH 3
+
+__attribute__((noinline)) int sample_function(int x) { return x * 3 + 1; }
+
+/**
+ * translate_function
+ *
+ * Translate an address with the given handle and return the function name (to be freed).
+ */
+static char * translate_function(addr2line_t *backend, void *address)
+{
+    code_loc_t code_loc;
+    addr2line_translate(backend, address, &code_loc);
+    free(code_loc.file);
+    free(code_loc.mapping_name);
+    return code_loc.function;
+}
+
+/**
+ * test_shared_children
+ *
+ * Two handles on the maps of the process, the second one created after a dlopen, must both
+ * translate the code of the new object: the first one after maps_refresh(), the second one 
+ * right away, even though the first one started its addr2line command before the dlopen.
+ */
+static void test_shared_children(void)
+{
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+
+    addr2line_t *first = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+    char *function = translate_function(first, (void *)sample_function);
+    CHECK_STR(function, "sample_function");
+    free(function);
+
+    void *module = dlopen(SAMPLE_MODULE, RTLD_NOW);
+    CHECK(module != NULL);
+    if (module == NULL) {
+        fprintf(stderr, "%s\n", dlerror());
+        addr2line_close(first);
+        return;
+    }
+    void *module_function = dlsym(module, "sample_module_function");
+
+    addr2line_t *second = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+    function = translate_function(second, module_function);
+    CHECK_STR(function, "sample_module_function");
+    free(function);
+
+    CHECK(maps_refresh(first->procMaps) > 0);
+    function = translate_function(first, module_function);
+    CHECK_STR(function, "sample_module_function");
+    free(function);
+
+    addr2line_close(second);
+    addr2line_close(first);
+    dlclose(module);
+}
+
+/**
+ * test_refresh_cycles
+ *
+ * Load and unload an object several times, refreshing the maps of a handle each time, and check
+ * that the handle translates the new code and frees the retired mappings once it followed the refresh.
+ */
+static void test_refresh_cycles(void)
+{
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+
+    for (int cycle = 0; cycle < 3; ++cycle)
+    {
+        void *module = dlopen(SAMPLE_MODULE, RTLD_NOW);
+        CHECK(module != NULL);
+        if (module == NULL) break;
+
+        CHECK(maps_refresh(backend->procMaps) > 0);
+        char *function = translate_function(backend, dlsym(module, "sample_module_function"));
+        CHECK_STR(function, "sample_module_function");
+        free(function);
+        CHECK(backend->procMaps->retired_entries == NULL);
+
+        dlclose(module);
+        CHECK(maps_refresh(backend->procMaps) > 0);
+        CHECK(backend->procMaps->retired_entries != NULL);
+        function = translate_function(backend, (void *)sample_function);
+        CHECK_STR(function, "sample_function");
+        free(function);
+        CHECK(backend->procMaps->retired_entries == NULL);
+    }
+    addr2line_close(backend);
+}
+
+/**
+ * find_state
+ *
+ * Find the adaptive selection state of the mapping of an address.
+ */
+static addr2line_adaptive_t * find_state(addr2line_t *backend, void *address)
+{
+    maps_entry_t *entry = search_in_exec_mappings(backend->procMaps, (unsigned long)address);
+    for (int i = 0; i < backend->numAdaptive; ++i) {
+        if (backend->adaptiveList[i].execMapping == entry) return &backend->adaptiveList[i];
+    }
+    return NULL;
+}
+
+/**
+ * test_adaptive
+ *
+ * In adaptive mode, a small object with debugging information settles on a backend on its first
+ * translation, without probing the others, and the same object without debugging information is
+ * resolved through its symbol table, without starting any addr2line process for it.
+ */
+static void test_adaptive(void)
+{
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+    void *module = dlopen(SAMPLE_MODULE, RTLD_NOW);
+    void *stripped = dlopen(SAMPLE_NODEBUG_MODULE, RTLD_NOW);
+    CHECK((module != NULL) && (stripped != NULL));
+    if ((module == NULL) || (stripped == NULL)) return;
+    void *module_function = dlsym(module, "sample_module_function");
+    void *stripped_function = dlsym(stripped, "sample_module_function");
+    CHECK(module_function != stripped_function);
+
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file(maps_path, 0), OPTION_ADAPTIVE_BACKEND);
+    char *function = translate_function(backend, module_function);
+    CHECK_STR(function, "sample_module_function");
+    free(function);
+    addr2line_adaptive_t *state = find_state(backend, module_function);
+    CHECK((state != NULL) && (state->isClassified) && (state->selectedBackend >= 0));
+
+#if defined(HAVE_LIBSYMTAB)
+    function = translate_function(backend, stripped_function);
+    CHECK_STR(function, "sample_module_function");
+    free(function);
+    state = find_state(backend, stripped_function);
+    CHECK((state != NULL) && (state->symtab != NULL));
+    for (int i = 0; i < backend->numProcesses; ++i) {
+        if ((state != NULL) && (backend->processList[i].execMapping == state->execMapping)) CHECK(backend->processList[i].child == NULL);
+    }
+#endif
+    addr2line_close(backend);
+    dlclose(stripped);
+    dlclose(module);
+}
+
+/**
+ * translate_stack
+ *
+ * Translate a call stack with the given handle, check the function of each frame and free the frames.
+ */
+static int translate_stack(addr2line_t *backend, void **pcs, const char **functions)
+{
+    code_loc_t frames[STACK_DEPTH];
+    int id = addr2line_translate_stack(backend, pcs, STACK_DEPTH, frames);
+    for (int i = 0; i < STACK_DEPTH; ++i)
+    {
+        CHECK_STR(frames[i].function, functions[i]);
+        free(frames[i].function);
+        free(frames[i].file);
+        free(frames[i].mapping_name);
+    }
+    return id;
+}
+
+/**
+ * test_stacks
+ *
+ * Translate two stacks that only differ in their innermost frame, the outer entries being return
+ * addresses (translated one byte before). Each distinct frame is translated once, the stacks share
+ * the nodes of their outer frames, and the same stack gets the same identifier again.
+ */
+static void test_stacks(void)
+{
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+
+    void *first[STACK_DEPTH] = { (void *)sample_function, (char *)find_state + 1, (char *)translate_function + 1 };
+    void *second[STACK_DEPTH] = { (void *)translate_stack, (char *)find_state + 1, (char *)translate_function + 1 };
+    const char *first_functions[STACK_DEPTH] = { "sample_function", "find_state", "translate_function" };
+    const char *second_functions[STACK_DEPTH] = { "translate_stack", "find_state", "translate_function" };
+
+    int first_id = translate_stack(backend, first, first_functions);
+    int second_id = translate_stack(backend, second, second_functions);
+    CHECK((first_id >= 0) && (second_id >= 0) && (first_id != second_id));
+    CHECK(translate_stack(backend, first, first_functions) == first_id);
+
+    addr2line_stack_cache_t *cache = backend->stackCache;
+    CHECK((cache != NULL) && (cache->numFrames == STACK_DEPTH + 1) && (cache->numNodes == STACK_DEPTH + 1));
+    if (cache != NULL) CHECK(cache->nodes[first_id].parent == cache->nodes[second_id].parent);
+    addr2line_close(backend);
+}
+
+/**
+ * test_aggregate
+ *
+ * Sample different PCs of the same functions, and check that they fold into one count per function
+ * (or per folded stack) with the summed weights, by decreasing weight.
+ */
+static void test_aggregate(void)
+{
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+    addr2line_folded_t *folded = NULL;
+
+    addr2line_aggregate_t *aggregate = addr2line_aggregate_init(backend, AGGREGATE_FUNCTIONS);
+    addr2line_aggregate_add(aggregate, (void *)sample_function, 2);
+    addr2line_aggregate_add(aggregate, (void *)translate_function, 4);
+    addr2line_aggregate_add(aggregate, (char *)sample_function + 1, 3);
+    CHECK(addr2line_aggregate_finish(aggregate, &folded) == 2);
+    CHECK_STR(folded[0].key, "sample_function");
+    CHECK(folded[0].weight == 5);
+    CHECK_STR(folded[1].key, "translate_function");
+    CHECK(folded[1].weight == 4);
+
+    // Samples added after folding are folded with the previous ones
+    addr2line_aggregate_add(aggregate, (void *)translate_function, 2);
+    CHECK(addr2line_aggregate_finish(aggregate, &folded) == 2);
+    CHECK_STR(folded[0].key, "translate_function");
+    CHECK(folded[0].weight == 6);
+    addr2line_aggregate_free(aggregate);
+
+    void *first[STACK_DEPTH] = { (void *)sample_function, (char *)find_state + 1, (char *)translate_function + 1 };
+    void *shifted[STACK_DEPTH] = { (char *)sample_function + 1, (char *)find_state + 1, (char *)translate_function + 1 };
+    void *second[STACK_DEPTH] = { (void *)translate_stack, (char *)find_state + 1, (char *)translate_function + 1 };
+    aggregate = addr2line_aggregate_init(backend, AGGREGATE_STACKS);
+    addr2line_aggregate_add_stack(aggregate, first, STACK_DEPTH, 1);
+    addr2line_aggregate_add_stack(aggregate, second, STACK_DEPTH, 1);
+    addr2line_aggregate_add_stack(aggregate, shifted, STACK_DEPTH, 2);
+    CHECK(addr2line_aggregate_finish(aggregate, &folded) == 2);
+    CHECK_STR(folded[0].key, "translate_function;find_state;sample_function");
+    CHECK(folded[0].weight == 3);
+    CHECK_STR(folded[1].key, "translate_function;find_state;translate_stack");
+    CHECK(folded[1].weight == 1);
+    addr2line_aggregate_free(aggregate);
+
+    addr2line_close(backend);
+}
+
+/**
+ * test_multi
+ *
+ * Normalize the address of a function of a loaded object for two processes (here the same one parsed
+ * twice), and check that the key is the virtual address of the function in the object, and that both
+ * processes get it translated against the object.
+ */
+static void test_multi(void)
+{
+    void *module = dlopen(SAMPLE_MODULE, RTLD_NOW);
+    CHECK(module != NULL);
+    if (module == NULL) return;
+    void *module_function = dlsym(module, "sample_module_function");
+    struct link_map *link_map = NULL;
+    CHECK(dlinfo(module, RTLD_DI_LINKMAP, &link_map) == 0);
+
+    maps_t *maps = maps_parse_file("/proc/self/maps", 0);
+    maps_key_t key;
+    CHECK(maps_normalize(maps, (unsigned long)module_function, &key) == 0);
+    if (link_map != NULL) CHECK(key.offset == (unsigned long)module_function - link_map->l_addr);
+    maps_free(maps);
+
+    addr2line_multi_t *multi = addr2line_multi_init(0);
+    int first = addr2line_multi_add_rank(multi, maps_parse_file("/proc/self/maps", 0));
+    int second = addr2line_multi_add_rank(multi, maps_parse_file("/proc/self/maps", 0));
+    int ranks[2] = { first, second };
+    for (int i = 0; i < 2; ++i)
+    {
+        code_loc_t code_loc;
+        addr2line_multi_translate(multi, ranks[i], module_function, &code_loc);
+        CHECK_STR(code_loc.function, "sample_module_function");
+        CHECK(code_loc.adjusted_address == module_function);
+        free(code_loc.function);
+        free(code_loc.file);
+        free(code_loc.mapping_name);
+    }
+    addr2line_multi_close(multi);
+    dlclose(module);
+}
+
+/**
+ * test_scheduled
+ *
+ * Translate weighted addresses within a time budget: without a limit all of them are translated, and the
+ * functions learned are answered from the function ranges on the next call; with a budget too short for
+ * any request, the addresses are all returned as not translated.
+ */
+static void test_scheduled(void)
+{
+    void *addresses[SCHEDULED_ADDRESSES];
+    unsigned long weights[SCHEDULED_ADDRESSES];
+    code_loc_t code_locs[SCHEDULED_ADDRESSES];
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+    for (int i = 0; i < SCHEDULED_ADDRESSES; ++i) {
+        addresses[i] = (char *)sample_function + (i & 1);
+        weights[i] = i % 5;
+    }
+
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file(maps_path, 0), OPTION_LEARN_FUNCTIONS);
+    for (int round = 0; round < 2; ++round)
+    {
+        CHECK(addr2line_translate_scheduled(backend, addresses, weights, SCHEDULED_ADDRESSES, 0, code_locs) == SCHEDULED_ADDRESSES);
+        for (int i = 0; i < SCHEDULED_ADDRESSES; ++i)
+        {
+            CHECK(code_locs[i].translated);
+            CHECK_STR(code_locs[i].function, "sample_function");
+            free(code_locs[i].function);
+            free(code_locs[i].file);
+            free(code_locs[i].mapping_name);
+        }
+    }
+#if defined(HAVE_LIBSYMTAB)
+    CHECK((backend->rangeCache != NULL) && (backend->rangeCache->numHits == SCHEDULED_ADDRESSES));
+#endif
+    addr2line_close(backend);
+
+    backend = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+    int translated = addr2line_translate_scheduled(backend, addresses, weights, SCHEDULED_ADDRESSES, 1e-9, code_locs);
+    CHECK(translated < SCHEDULED_ADDRESSES);
+    int num_untranslated = 0;
+    for (int i = 0; i < SCHEDULED_ADDRESSES; ++i)
+    {
+        if (!code_locs[i].translated) {
+            CHECK_STR(code_locs[i].function, UNKNOWN_ADDRESS);
+            num_untranslated ++;
+        }
+        free(code_locs[i].function);
+        free(code_locs[i].file);
+        free(code_locs[i].mapping_name);
+    }
+    CHECK(num_untranslated == SCHEDULED_ADDRESSES - translated);
+    addr2line_close(backend);
+}
+
+typedef struct async_results {
+    int num_delivered;
+    int num_mismatches;
+    int in_order;
+} async_results_t;
+
+static async_results_t async_results;
+
+/**
+ * async_callback
+ *
+ * Check a translation delivered by addr2line_poll or addr2line_drain, and that they come in request order.
+ */
+static void async_callback(void *address, code_loc_t *code_loc, void *userdata)
+{
+    if ((int)(intptr_t)userdata != async_results.num_delivered) async_results.in_order = 0;
+    if (strcmp(code_loc->function, "sample_function") != 0) async_results.num_mismatches ++;
+    async_results.num_delivered ++;
+    free(code_loc->function);
+    free(code_loc->file);
+    free(code_loc->mapping_name);
+}
+
+/**
+ * test_async
+ *
+ * Queue asynchronous translations interleaved with synchronous ones on the same handle, which are
+ * serialized with the I/O thread, then drain them and check that every request was delivered in order.
+ */
+static void test_async(void)
+{
+    char maps_path[64];
+    snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)getpid());
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file(maps_path, 0), 0);
+
+    async_results.num_delivered = async_results.num_mismatches = 0;
+    async_results.in_order = 1;
+    int num_sync_mismatches = 0;
+    for (int i = 0; i < ASYNC_REQUESTS; ++i)
+    {
+        addr2line_translate_async(backend, (char *)sample_function + (i & 1), async_callback, (void *)(intptr_t)i);
+        if (i % 16 == 0)
+        {
+            char *function = translate_function(backend, (void *)sample_function);
+            if (strcmp(function, "sample_function") != 0) num_sync_mismatches ++;
+            free(function);
+            addr2line_poll(backend);
+        }
+    }
+    addr2line_drain(backend);
+    CHECK(num_sync_mismatches == 0);
+    CHECK(async_results.num_delivered == ASYNC_REQUESTS);
+    CHECK(async_results.num_mismatches == 0);
+    CHECK(async_results.in_order);
+    CHECK(addr2line_poll(backend) == 0);
+    addr2line_close(backend);
+}
+
+#if defined(HAVE_LIBSYMTAB)
+/**
+ * test_functions_only
+ *
+ * Translate addresses of the test binary and of a loaded object, interleaved so that consecutive
+ * addresses change mapping, plus one outside of any mapping, with the batch and scheduled calls of a
+ * functions-only handle, and check that no addr2line process was started.
+ */
+static void test_functions_only(void)
+{
+    void *module = dlopen(SAMPLE_MODULE, RTLD_NOW);
+    CHECK(module != NULL);
+    if (module == NULL) return;
+    void *module_function = dlsym(module, "sample_module_function");
+
+    void *addresses[SCHEDULED_ADDRESSES];
+    unsigned long weights[SCHEDULED_ADDRESSES];
+    code_loc_t code_locs[SCHEDULED_ADDRESSES];
+    for (int i = 0; i < SCHEDULED_ADDRESSES; ++i) {
+        addresses[i] = (i % 3 == 0 ? (void *)sample_function : (i % 3 == 1 ? module_function : (void *)16));
+        weights[i] = i;
+    }
+
+    addr2line_t *backend = addr2line_init_maps(maps_parse_file("/proc/self/maps", 0), OPTION_FUNCTIONS_ONLY);
+    for (int round = 0; round < 2; ++round)
+    {
+        if (round == 0) addr2line_translate_batch(backend, addresses, SCHEDULED_ADDRESSES, code_locs);
+        else CHECK(addr2line_translate_scheduled(backend, addresses, weights, SCHEDULED_ADDRESSES, 0, code_locs) == SCHEDULED_ADDRESSES);
+        for (int i = 0; i < SCHEDULED_ADDRESSES; ++i)
+        {
+            CHECK(code_locs[i].translated == (i % 3 != 2));
+            CHECK_STR(code_locs[i].function, (i % 3 == 0 ? "sample_function" : (i % 3 == 1 ? "sample_module_function" : UNKNOWN_ADDRESS)));
+            free(code_locs[i].function);
+            free(code_locs[i].file);
+            free(code_locs[i].mapping_name);
+        }
+    }
+    for (int i = 0; i < backend->numProcesses; ++i) CHECK(backend->processList[i].child == NULL);
+    addr2line_close(backend);
+    dlclose(module);
+}
+
+/**
+ * test_shared_maps
+ *
+ * Two functions-only handles created on the same parsed maps share them, and share the symbol
+ * tables read with the maps instead of reading their own. The maps outlive the first handle closed.
+ */
+static void test_shared_maps(void)
+{
+    maps_t *maps = maps_parse_file("/proc/self/maps", OPTION_READ_FUNCTIONS | OPTION_DEMANGLE);
+    CHECK(maps != NULL);
+    if (maps == NULL) return;
+    addr2line_t *first = addr2line_init_maps(maps_retain(maps), OPTION_FUNCTIONS_ONLY);
+    addr2line_t *second = addr2line_init_maps(maps, OPTION_FUNCTIONS_ONLY);
+    CHECK((first->procMaps == maps) && (second->procMaps == maps) && (maps->refcount == 2));
+
+    char *function = translate_function(first, (void *)sample_function);
+    CHECK_STR(function, "sample_function");
+    free(function);
+    addr2line_close(first);
+    CHECK(maps->refcount == 1);
+
+    function = translate_function(second, (void *)sample_function);
+    CHECK_STR(function, "sample_function");
+    free(function);
+    maps_entry_t *text = search_in_exec_mappings(maps, (unsigned long)sample_function);
+    for (int i = 0; i < second->numAdaptive; ++i) {
+        if (second->adaptiveList[i].execMapping == text) CHECK((text->symtab != NULL) && (second->adaptiveList[i].symtab == text->symtab));
+    }
+    addr2line_close(second);
+}
+#endif
+
+int main(void)
+{
+    test_shared_children();
+    test_refresh_cycles();
+    test_adaptive();
+    test_stacks();
+    test_aggregate();
+    test_multi();
+    test_scheduled();
+    test_async();
+#if defined(HAVE_LIBSYMTAB)
+    test_functions_only();
+    test_shared_maps();
+#endif
+    return TEST_EXIT();
+}
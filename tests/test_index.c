@@ -0,0 +1,249 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "maps.h"
+#include "tests.h"
+
+int sample_data[64] = { 1 };         // Initialized data of the sample binary
+long sample_bss[128];                // Uninitialized data, which may extend past the file-backed mappings
+
+__attribute__((noinline)) int sample_alpha(int x) { return x + sample_data[x & 63]; }
+__attribute__((noinline)) int sample_beta(int x) { return x * 3 + (int)sample_bss[x & 127]; }
+
+// Function with the mangled name of sample::mangled(int), as a C++ compiler would emit it
+#define SAMPLE_MANGLED "_ZN6sample7mangledEi"
+__attribute__((noinline)) int sample_mangled(int x) __asm__(SAMPLE_MANGLED);
+__attribute__((noinline)) int sample_mangled(int x) { return x * 5 + sample_data[x & 63]; }
+
+/**
+ * check_data
+ *
+ * Resolve an address with the merged data index and check the symbol and offset.
+ */
+static void check_data(maps_t *maps, void *address, const char *name, unsigned long offset)
+{
+    unsigned long found_offset = 0;
+    maps_symbol_t *symbol = maps_resolve_data(maps, (unsigned long)address, &found_offset);
+    CHECK(symbol != NULL);
+    if (symbol == NULL) return;
+    CHECK_STR(symbol->name, name);
+    CHECK(found_offset == offset);
+    CHECK((symbol->entry != NULL) && ((unsigned long)address >= symbol->entry->start));
+}
+
+/**
+ * test_data_index
+ *
+ * Check the merged data index built from /proc/self/maps and from the dynamic loader.
+ */
+static void test_data_index(void)
+{
+    maps_t *maps = maps_parse_file("/proc/self/maps", OPTION_DATA_INDEX);
+    CHECK((maps != NULL) && (maps->num_data_symbols > 0));
+    if (maps == NULL) return;
+    check_data(maps, &sample_data[5], "sample_data", 5 * sizeof(int));
+    check_data(maps, &sample_bss[7], "sample_bss", 7 * sizeof(long));
+    CHECK(maps_resolve_data(maps, 1, NULL) == NULL);
+    maps_free(maps);
+
+    maps = maps_from_self(OPTION_DATA_INDEX);
+    CHECK(maps != NULL);
+    if (maps == NULL) return;
+    check_data(maps, &sample_data[0], "sample_data", 0);
+    check_data(maps, &sample_bss[127], "sample_bss", 127 * sizeof(long));
+    maps_free(maps);
+}
+
+/**
+ * test_lookup_symbol
+ *
+ * Check the reverse lookup of function names with the three match modes.
+ */
+static void test_lookup_symbol(void)
+{
+    maps_t *maps = maps_parse_file("/proc/self/maps", OPTION_READ_FUNCTIONS);
+    CHECK(maps != NULL);
+    if (maps == NULL) return;
+
+    int count = 0;
+    maps_symbol_t *symbols = maps_lookup_symbol(maps, "sample_alpha", SYMTAB_MATCH_EXACT, &count);
+    CHECK((symbols != NULL) && (count == 1));
+    if (symbols != NULL)
+    {
+        CHECK_STR(symbols[0].name, "sample_alpha");
+        CHECK((symbols[0].start == (unsigned long)sample_alpha) && (symbols[0].end > symbols[0].start));
+        free(symbols);
+    }
+
+    symbols = maps_lookup_symbol(maps, "sample_", SYMTAB_MATCH_PREFIX, &count);
+    CHECK((symbols != NULL) && (count == 2));
+    if (symbols != NULL)
+    {
+        // Sorted by address
+        CHECK(symbols[0].start < symbols[1].start);
+        CHECK((symbols[0].start == (unsigned long)sample_alpha) || (symbols[0].start == (unsigned long)sample_beta));
+        free(symbols);
+    }
+
+    symbols = maps_lookup_symbol(maps, "*_beta", SYMTAB_MATCH_GLOB, &count);
+    CHECK((symbols != NULL) && (count == 1));
+    if (symbols != NULL)
+    {
+        CHECK(symbols[0].start == (unsigned long)sample_beta);
+        free(symbols);
+    }
+
+    symbols = maps_lookup_symbol(maps, "sample_none", SYMTAB_MATCH_EXACT, &count);
+    CHECK((symbols == NULL) && (count == 0));
+    maps_free(maps);
+}
+
+/**
+ * symbol_start
+ *
+ * Find the start address of a symbol by name, with the symbol table pinned while its entries are read.
+ */
+static unsigned long symbol_start(symtab_t *symtab, const char *name)
+{
+    int *matches = NULL;
+    unsigned long start = 0;
+    symtab_pin(symtab);
+    if (symtab_lookup_name(symtab, name, SYMTAB_MATCH_EXACT, &matches) == 1) start = symtab->entries[matches[0]].start;
+    symtab_unpin(symtab);
+    free(matches);
+    return start;
+}
+
+typedef struct budget_lookup {
+    symtab_t *symtab;
+    unsigned long address;
+    const char *name;
+    int mismatches;
+} budget_lookup_t;
+
+/**
+ * lookup_thread
+ *
+ * Translate the same address repeatedly while the other thread makes the symbol table evicted.
+ */
+static void * lookup_thread(void *arg)
+{
+    budget_lookup_t *lookup = (budget_lookup_t *)arg;
+    for (int i = 0; i < 200; ++i)
+    {
+        char *name = symtab_translate(lookup->symtab, lookup->address);
+        if (strcmp(name, lookup->name) != 0) lookup->mismatches ++;
+        free(name);
+    }
+    return NULL;
+}
+
+/**
+ * test_budget
+ *
+ * With a budget smaller than any symbol table, reading or using one symbol table evicts the other,
+ * which is read again on its next lookup, also while both are looked up from two threads.
+ */
+static void test_budget(void)
+{
+    symtab_stats_t stats;
+    CHECK(symtab_set_budget(1) == 0);
+
+    symtab_t *functions = symtab_read_filtered("/proc/self/exe", SYMTAB_FUNCTIONS);
+    symtab_t *data = symtab_read_filtered("/proc/self/exe", SYMTAB_DATA_OBJECTS);
+    CHECK((functions != NULL) && (data != NULL));
+    if ((functions == NULL) || (data == NULL)) return;
+    symtab_get_stats(&stats);
+    CHECK((stats.num_evictions == 1) && (stats.num_resident == 1) && (!functions->is_loaded));
+
+    unsigned long alpha = symbol_start(functions, "sample_alpha");
+    unsigned long data_start = symbol_start(data, "sample_data");
+    CHECK((alpha != 0) && (data_start != 0));
+    symtab_get_stats(&stats);
+    CHECK(stats.num_reloads >= 2);
+
+    budget_lookup_t lookups[2] = { { functions, alpha, "sample_alpha", 0 }, { data, data_start + 4, "sample_data", 0 } };
+    pthread_t threads[2];
+    for (int t = 0; t < 2; ++t) CHECK(pthread_create(&threads[t], NULL, lookup_thread, &lookups[t]) == 0);
+    for (int t = 0; t < 2; ++t) pthread_join(threads[t], NULL);
+    CHECK((lookups[0].mismatches == 0) && (lookups[1].mismatches == 0));
+    CHECK((functions->pins == 0) && (data->pins == 0));
+
+    CHECK(symtab_set_budget(0) == 0);
+    symtab_free(functions);
+    symtab_free(data);
+    symtab_get_stats(&stats);
+    CHECK(stats.num_resident == 0);
+}
+
+/**
+ * find_entry
+ *
+ * Find the symbol that starts at the given address (the symbol table must be pinned).
+ */
+static symtab_entry_t * find_entry(symtab_t *symtab, unsigned long start)
+{
+    for (int i = 0; i < symtab->num_entries; ++i) {
+        if (symtab->entries[i].start == start) return &symtab->entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * test_demangle
+ *
+ * Names are kept mangled unless demangling is requested. With lazy demangling, a name is demangled
+ * on its first lookup and the cached result is returned afterwards, while names that are not mangled
+ * are returned as they are, without a copy.
+ */
+static void test_demangle(void)
+{
+    symtab_t *plain = symtab_read_filtered("/proc/self/exe", SYMTAB_FUNCTIONS);
+    symtab_t *lazy = symtab_read_filtered("/proc/self/exe", SYMTAB_FUNCTIONS | SYMTAB_DEMANGLE_LAZY);
+    unsigned long start = symbol_start(plain, SAMPLE_MANGLED);
+    unsigned long alpha = symbol_start(plain, "sample_alpha");
+    CHECK((start != 0) && (alpha != 0));
+    char *name = symtab_translate(plain, start);
+    CHECK_STR(name, SAMPLE_MANGLED);
+    free(name);
+
+    symtab_pin(lazy);
+    symtab_entry_t *entry = find_entry(lazy, start);
+    symtab_entry_t *alpha_entry = find_entry(lazy, alpha);
+    CHECK((entry != NULL) && (alpha_entry != NULL));
+    if ((entry != NULL) && (alpha_entry != NULL))
+    {
+        CHECK(entry->demangled == NULL);
+        name = symtab_translate(lazy, start);
+#if defined(HAVE_CXA_DEMANGLE)
+        CHECK_STR(name, "sample::mangled(int)");
+#else
+        CHECK_STR(name, SAMPLE_MANGLED);
+#endif
+        free(name);
+        CHECK(entry->demangled != NULL);
+        const char *cached = symtab_entry_name(lazy, entry);
+        CHECK((cached == entry->demangled) && (symtab_entry_name(lazy, entry) == cached));
+        CHECK(symtab_entry_name(lazy, alpha_entry) == alpha_entry->name);
+    }
+    symtab_unpin(lazy);
+
+#if defined(HAVE_CXA_DEMANGLE)
+    // Lookups by name match the demangled names
+    int *matches = NULL;
+    CHECK(symtab_lookup_name(lazy, "sample::mangled(int)", SYMTAB_MATCH_EXACT, &matches) == 1);
+    free(matches);
+#endif
+    symtab_free(lazy);
+    symtab_free(plain);
+}
+
+int main(void)
+{
+    test_budget(); // The budget can only be set while no symbol table is resident
+    test_data_index();
+    test_lookup_symbol();
+    test_demangle();
+    return TEST_EXIT();
+}
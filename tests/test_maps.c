@@ -0,0 +1,283 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "maps.h"
+#include "tests.h"
+
+int sample_data[64] = { 1 }; // Data symbol of the sample binary, looked up through the image
+
+__attribute__((noinline)) int sample_function(int x) { return x + sample_data[x & 63]; }
+
+/**
+ * temp_path
+ *
+ * Build the path of a temporary file of the test in TMPDIR.
+ */
+static void temp_path(char *path, size_t size, const char *name)
+{
+    const char *dir = getenv("TMPDIR");
+    snprintf(path, size, "%s/%s-%d", ((dir != NULL) && (dir[0] != '\0') ? dir : "/tmp"), name, (int)getpid());
+}
+
+/**
+ * copy_file
+ *
+ * Copy a file, used to get a sample object whose modification time can be changed.
+ */
+static int copy_file(const char *from, const char *to)
+{
+    char buf[BUFSIZ];
+    ssize_t n;
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ((in < 0) || (out < 0)) return -1;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) n = -1;
+        if (n < 0) break;
+    }
+    close(in);
+    close(out);
+    return (n < 0 ? -1 : 0);
+}
+
+/**
+ * contains_entry
+ *
+ * Check whether an entry is still in the list of all entries.
+ */
+static int contains_entry(maps_t *mapping_list, maps_entry_t *wanted)
+{
+    for (maps_entry_t *entry = mapping_list->all_entries; entry != NULL; entry = entry->next_all) {
+        if (entry == wanted) return 1;
+    }
+    return 0;
+}
+
+/**
+ * test_refresh
+ *
+ * Map and unmap an object, and check that maps_refresh() keeps the entries that did not change,
+ * adds the new mapping and retires the removed one.
+ */
+static void test_refresh(const char *object)
+{
+    maps_t *maps = maps_parse_file("/proc/self/maps", 0);
+    CHECK(maps != NULL);
+    if (maps == NULL) return;
+
+    maps_entry_t *text = search_in_exec_mappings(maps, (unsigned long)sample_function);
+    CHECK(text != NULL);
+    unsigned long generation = maps->generation;
+
+    int fd = open(object, O_RDONLY);
+    void *mapped = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    CHECK(mapped != MAP_FAILED);
+
+    CHECK(maps_refresh(maps) > 0);
+    CHECK(maps->generation > generation);
+    CHECK(contains_entry(maps, text));
+    maps_entry_t *added = search_in_all_mappings(maps, (unsigned long)mapped);
+    CHECK((added != NULL) && (strcmp(added->pathname, object) == 0));
+
+    munmap(mapped, 4096);
+    CHECK(maps_refresh(maps) > 0);
+    CHECK(contains_entry(maps, text));
+    CHECK(!contains_entry(maps, added));
+    CHECK(search_in_all_mappings(maps, (unsigned long)mapped) == NULL);
+    CHECK(maps->retired_entries != NULL);
+    maps_release_retired(maps);
+    CHECK(maps->retired_entries == NULL);
+    CHECK(contains_entry(maps, text));
+    maps_free(maps);
+
+    // The loader counters tell that nothing changed without rescanning
+    maps = maps_from_self(0);
+    CHECK(maps != NULL);
+    if (maps == NULL) return;
+    generation = maps->generation;
+    CHECK(maps_refresh(maps) == 0);
+    CHECK(maps->generation == generation);
+    maps_free(maps);
+
+    // There are no anonymous mappings to attach JIT code to, so the option is ignored instead of failing
+    maps = maps_from_self(OPTION_READ_JIT);
+    CHECK((maps != NULL) && (maps->jit == NULL) && (maps->num_all_entries > 0));
+    maps_free(maps);
+}
+
+/**
+ * test_series
+ *
+ * Append two snapshots around the mapping of an object, and check that the unchanged entries are
+ * shared between them, that lookups honour the epochs, and that the mappings of each object share
+ * a single symbol table.
+ */
+static void test_series(const char *object)
+{
+    maps_series_t *series = maps_series_create(OPTION_READ_SYMTAB);
+    CHECK(series != NULL);
+    if (series == NULL) return;
+
+    maps_version_t *first = maps_series_append(series, "/proc/self/maps", 10);
+    int fd = open(object, O_RDONLY);
+    void *mapped = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    CHECK(mapped != MAP_FAILED);
+    maps_series_append(series, "/proc/self/maps", 20);
+    CHECK((first != NULL) && (series->num_versions == 2));
+    CHECK(maps_series_append(series, "/proc/self/maps", 15) == NULL); // Out of order
+    if ((first == NULL) || (series->num_versions != 2)) {
+        maps_series_free(series);
+        return;
+    }
+    first = &series->versions[0];
+    maps_version_t *second = &series->versions[1];
+
+    CHECK(maps_series_version(series, 5) == NULL);
+    CHECK(maps_series_version(series, 12) == first);
+    CHECK(maps_series_version(series, 25) == second);
+
+    maps_entry_t *text = maps_series_find(series, (unsigned long)sample_function, 10);
+    CHECK(text != NULL);
+    CHECK(maps_series_find(series, (unsigned long)sample_function, 20) == text);
+    CHECK(maps_series_find(series, (unsigned long)mapped, 10) == NULL);
+    maps_entry_t *added = maps_series_find(series, (unsigned long)mapped, 20);
+    CHECK((added != NULL) && (strcmp(added->pathname, object) == 0));
+
+#if defined(HAVE_LIBSYMTAB)
+    // Every mapping of the test binary holds the same symbol table, read once
+    for (int i = 0; i < first->num_entries; ++i) {
+        if (!strcmp(first->entries[i]->pathname, text->pathname)) CHECK(first->entries[i]->symtab == text->symtab);
+    }
+    CHECK(text->symtab != NULL);
+#endif
+
+    munmap(mapped, 4096);
+    maps_series_free(series);
+}
+
+/**
+ * load_corrupted
+ *
+ * Copy an image with one of its header fields changed, and try to load the copy.
+ */
+static maps_image_t * load_corrupted(const char *image_path, size_t field_offset, uint64_t value)
+{
+    char corrupt_path[256];
+    temp_path(corrupt_path, sizeof(corrupt_path), "test_maps.corrupt");
+
+    FILE *in = fopen(image_path, "rb");
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char *data = (char *)malloc(size);
+    if (fread(data, 1, size, in) != (size_t)size) size = 0;
+    fclose(in);
+
+    if (field_offset == offsetof(maps_image_header_t, num_entries)) *(uint32_t *)(data + field_offset) = (uint32_t)value;
+    else memcpy(data + field_offset, &value, sizeof(value));
+
+    FILE *out = fopen(corrupt_path, "wb");
+    fwrite(data, 1, size, out);
+    fclose(out);
+    free(data);
+
+    maps_image_t *image = maps_load_mapped(corrupt_path);
+    unlink(corrupt_path);
+    return image;
+}
+
+/**
+ * test_image
+ *
+ * Save the maps of the process with a sample object mapped, reload the image and compare it,
+ * then check that the image is rejected once the object changed on disk.
+ */
+static void test_image(const char *object)
+{
+    char image_path[256];
+    temp_path(image_path, sizeof(image_path), "test_maps.img");
+
+    int fd = open(object, O_RDONLY);
+    void *mapped = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    CHECK(mapped != MAP_FAILED);
+
+    maps_t *maps = maps_parse_file("/proc/self/maps", OPTION_READ_SYMTAB);
+    CHECK(maps != NULL);
+    if (maps == NULL) return;
+    CHECK(maps_save(maps, image_path) == 0);
+
+    uint64_t num_symbols = 0;
+    maps_image_t *image = maps_load_mapped(image_path);
+    CHECK(image != NULL);
+    if (image != NULL)
+    {
+        num_symbols = image->header->num_symbols;
+        CHECK(image->header->num_entries == (uint32_t)maps->num_all_entries);
+        for (maps_entry_t *entry = maps->all_entries; entry != NULL; entry = entry->next_all)
+        {
+            maps_image_entry_t *image_entry = maps_image_find(image, entry->start);
+            CHECK((image_entry != NULL) && (image_entry->start == entry->start) && (image_entry->end == entry->end));
+            if (image_entry != NULL) CHECK_STR(maps_image_path(image, image_entry), mapping_path(entry));
+        }
+
+        maps_image_entry_t *image_entry = NULL;
+        const char *name = maps_image_translate(image, (unsigned long)&sample_data[10], &image_entry);
+#if defined(HAVE_LIBSYMTAB)
+        CHECK_STR(name, "sample_data");
+#else
+        CHECK_STR(name, UNKNOWN_SYMBOL);
+#endif
+        CHECK(image_entry != NULL);
+        maps_image_close(image);
+    }
+
+    // Counts that wrap the bounds around (here to the actual size of the symbols), and misaligned sections, are rejected instead of read
+    maps_image_t *corrupt = load_corrupted(image_path, offsetof(maps_image_header_t, num_symbols), (1ULL << 59) + num_symbols);
+    CHECK(corrupt == NULL);
+    corrupt = load_corrupted(image_path, offsetof(maps_image_header_t, num_entries), UINT32_MAX);
+    CHECK(corrupt == NULL);
+    corrupt = load_corrupted(image_path, offsetof(maps_image_header_t, symbols_offset), sizeof(maps_image_header_t) + 1);
+    CHECK(corrupt == NULL);
+    corrupt = load_corrupted(image_path, offsetof(maps_image_header_t, strings_size), UINT64_MAX);
+    CHECK(corrupt == NULL);
+
+    // A newer modification time of the object makes the image stale
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { time(NULL) + 10, 0 } };
+    CHECK(utimensat(AT_FDCWD, object, times, 0) == 0);
+    CHECK(maps_load_mapped(image_path) == NULL);
+
+    // So does garbage
+    FILE *garbage = fopen(image_path, "w");
+    fputs("garbage\n", garbage);
+    fclose(garbage);
+    CHECK(maps_load_mapped(image_path) == NULL);
+
+    unlink(image_path);
+    munmap(mapped, 4096);
+    maps_free(maps);
+}
+
+int main(void)
+{
+    char object[256];
+    temp_path(object, sizeof(object), "test_maps.object");
+    if (copy_file("/proc/self/exe", object) != 0) {
+        perror(object);
+        return EXIT_FAILURE;
+    }
+
+    test_refresh(object);
+    test_series(object);
+    test_image(object);
+
+    unlink(object);
+    return TEST_EXIT();
+}
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "pipe_io.h"
+#include "tests.h"
+
+#define LONG_LINE_SIZE (3 * READER_CAPACITY + 17) // Longer than the initial read buffer, to force it to grow
+
+/**
+ * check_location
+ *
+ * Parse a source location line as printed by the addr2line backends and check the result.
+ */
+static void check_location(const char *text, int has_column, const char *file, int line, int column)
+{
+    char buf[256];
+    int parsed_line = -1, parsed_column = -1;
+
+    strcpy(buf, text);
+    parse_source_location(buf, strlen(buf), has_column, &parsed_line, &parsed_column);
+    CHECK_STR(buf, file);
+    CHECK(parsed_line == line);
+    CHECK(parsed_column == column);
+}
+
+/**
+ * test_parse_source_location
+ *
+ * Check the forms printed by elfutils, binutils and llvm-tools, including the discriminators.
+ */
+static void test_parse_source_location(void)
+{
+    check_location("/src/sample.c:42", 0, "/src/sample.c", 42, 0);
+    check_location("/src/sample.c:42:7", 1, "/src/sample.c", 42, 7);
+    check_location("/src/sample.c:42", 1, "/src/sample.c", 42, 0);
+    check_location("/src/sample.c:42 (discriminator 3)", 0, "/src/sample.c", 42, 0);
+    check_location("/src/sample.c:42:7 (discriminator 12)", 1, "/src/sample.c", 42, 7);
+    check_location("/src/dir:with:colons/sample.c:9", 0, "/src/dir:with:colons/sample.c", 9, 0);
+    check_location("??:0", 0, "??", 0, 0);
+    check_location("??:?", 0, "??", 0, 0);
+    check_location("/src/sample.c:?", 0, "/src/sample.c", 0, 0);
+    check_location("", 1, "", 0, 0);
+}
+
+/**
+ * write_records
+ *
+ * Write the output of a fake addr2line command to the pipe, in small pieces so that the
+ * reader sees lines split across reads.
+ */
+static void write_records(int fd)
+{
+    char *long_line = (char *)malloc(LONG_LINE_SIZE + 1);
+    memset(long_line, 'x', LONG_LINE_SIZE);
+    long_line[LONG_LINE_SIZE] = '\n';
+
+    const char *head = "main\n/src/sample.c:42 (discriminator 3)\n";
+    write_with_retry(fd, head, strlen(head));
+    for (size_t written = 0; written < LONG_LINE_SIZE + 1; written += 1000) {
+        size_t piece = (LONG_LINE_SIZE + 1 - written < 1000 ? LONG_LINE_SIZE + 1 - written : 1000);
+        write_with_retry(fd, long_line + written, piece);
+    }
+    write_with_retry(fd, "\n", 1);
+    write_with_retry(fd, "last", 4); // No trailing newline
+    free(long_line);
+}
+
+/**
+ * test_reader
+ *
+ * Read lines from a pipe, including an empty line, a line much longer than the read
+ * buffer and a last line without newline.
+ */
+static void test_reader(void)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        write_records(fds[1]);
+        close(fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+
+    line_reader_t *reader = reader_open(fds[0]);
+    size_t len = 0;
+    char *line = reader_getline(reader, &len);
+    CHECK_STR(line, "main");
+    CHECK(len == 4);
+
+    line = reader_getline(reader, &len);
+    CHECK(line != NULL);
+    if (line != NULL)
+    {
+        int parsed_line = 0, parsed_column = 0;
+        parse_source_location(line, len, 0, &parsed_line, &parsed_column);
+        CHECK_STR(line, "/src/sample.c");
+        CHECK(parsed_line == 42);
+    }
+
+    line = reader_getline(reader, &len);
+    CHECK(line != NULL);
+    CHECK(len == LONG_LINE_SIZE);
+    if (line != NULL) CHECK((line[0] == 'x') && (line[LONG_LINE_SIZE - 1] == 'x') && (line[LONG_LINE_SIZE] == '\0'));
+
+    line = reader_getline(reader, &len);
+    CHECK_STR(line, "");
+    CHECK(len == 0);
+
+    line = reader_getline(reader, &len);
+    CHECK_STR(line, "last");
+    CHECK(reader_getline(reader, &len) == NULL);
+
+    reader_close(reader); // Also closes the pipe
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * test_format_address
+ *
+ * Check the addresses written to the addr2line commands.
+ */
+static void test_format_address(void)
+{
+    char buf[32];
+    CHECK(format_address(buf, (void *)0x401136UL) == 8);
+    CHECK_STR(buf, "0x401136");
+    format_address(buf, (void *)0);
+    CHECK_STR(buf, "0x0");
+    format_address(buf, (void *)~0UL);
+    CHECK_STR(buf, "0xffffffffffffffff");
+}
+
+int main(void)
+{
+    test_parse_source_location();
+    test_reader();
+    test_format_address();
+    return TEST_EXIT();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * Minimal checks shared by the test programs. A failed check is reported and counted, 
+ * and the program exits with the number of failures (0 means success for make check).
+ */
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_STR(actual, expected) do { \
+    const char *actual_str = (actual), *expected_str = (expected); \
+    if ((actual_str == NULL) || (strcmp(actual_str, expected_str) != 0)) { \
+        fprintf(stderr, "%s:%d: check failed: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, \
+                (actual_str != NULL ? actual_str : "(null)"), expected_str); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_EXIT() (failures > 0 ? 1 : 0)